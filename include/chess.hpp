@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <optional>
 #include <unordered_map>
 
@@ -94,10 +95,32 @@ struct Move {
     bool isEnPassant() const { return (flags() & FLAG_EN_PASSANT) != 0; }
     bool isCastle() const { return (flags() & FLAG_CASTLE) != 0; }
     bool isPromotion() const { return (flags() & FLAG_PROMOTION) != 0; }
+
+    // 16-bit storage form for tables (TT, killers, counter moves): from, to, promotion piece
+    // and the special-move kind. The captured piece is restored from the board by unpackMove.
+    static constexpr std::uint16_t PACKED_PROMOTION = 1;
+    static constexpr std::uint16_t PACKED_EN_PASSANT = 2;
+    static constexpr std::uint16_t PACKED_CASTLE = 3;
+
+    std::uint16_t packed() const
+    {
+        std::uint16_t kind = 0;
+        if (isPromotion()) {
+            kind = PACKED_PROMOTION;
+        } else if (isEnPassant()) {
+            kind = PACKED_EN_PASSANT;
+        } else if (isCastle()) {
+            kind = PACKED_CASTLE;
+        }
+        const std::uint16_t promo = isPromotion() ? static_cast<std::uint16_t>(promotionType() - N) : 0;
+        return static_cast<std::uint16_t>(from() | (to() << 6) | (promo << 12) | (kind << 14));
+    }
 };
 
+constexpr int MAX_MOVES = 256;
+
 struct MoveList {
-    std::array<Move, 256> moves{};
+    std::array<Move, MAX_MOVES> moves{};
     int count = 0;
 
     void clear() { count = 0; }
@@ -124,6 +147,7 @@ struct UndoState {
     int halfmoveClock = 0;
     int fullmoveNumber = 1;
     std::uint64_t zobristKey = 0;
+    std::uint64_t pawnKey = 0;
 };
 
 Piece pieceAt(const GameState& gs, int r, int c);
@@ -146,6 +170,7 @@ struct GameState {
     int halfmoveClock = 0;
     int fullmoveNumber = 1;
     std::uint64_t zobristKey = 0;
+    std::uint64_t pawnKey = 0;
     std::unordered_map<std::uint64_t, int> positionHashCounts;
     std::string initialFen;
 
@@ -153,13 +178,92 @@ struct GameState {
     void loadFromFen(const std::string& fen);
 };
 
+// Fixed 32-byte position record for datasets. `pieces` holds one nibble per set bit of
+// `occupancy` in ascending square order (low nibble first), using the pieceOnSquare codes
+// (type, plus 8 for black). `state` is black-to-move in bit 0 and the KQkq rights in bits 1-4;
+// `epSquare` is NO_EP_SQUARE when there is no en-passant target.
+struct PackedPosition {
+    static constexpr std::uint8_t NO_EP_SQUARE = 0xFF;
+
+    Bitboard occupancy = 0;
+    std::array<std::uint8_t, 16> pieces{};
+    std::uint8_t state = 0;
+    std::uint8_t epSquare = NO_EP_SQUARE;
+    std::uint16_t halfmoveClock = 0;
+    std::uint16_t fullmoveNumber = 1;
+    std::uint16_t reserved = 0;
+};
+static_assert(sizeof(PackedPosition) == 32);
+
+// Packing fails for boards with more than 32 pieces; unpacking fails on malformed records and,
+// like parseFen, resets the undo stack and repetition history of the target and sets its
+// initialFen.
+bool packPosition(const GameState& gs, PackedPosition& out);
+bool unpackPosition(const PackedPosition& packed, GameState& gs);
+
+// Allocation-free FEN codec (parseFen only grows initialFen's buffer). parseFen reads the first
+// four fields and optional move counters (anything after them is ignored). Every other field is
+// reset first, so on malformed input it returns false with the pieces read before the error on
+// an otherwise default position, keys to match. writeFen needs MAX_FEN_LENGTH bytes at `out`,
+// writes no terminator and returns the length written.
+constexpr std::size_t MAX_FEN_LENGTH = 112;
+bool parseFen(std::string_view fen, GameState& gs);
+std::size_t writeFen(const GameState& gs, char* out);
+std::string toFen(const GameState& gs);
+
+// Check geometry for the side to move, computed once per node so legality and
+// check status of pseudo-legal moves are known without making them.
+struct CheckInfo {
+    std::array<Bitboard, 7> checkSquares{}; // by PieceType: squares that attack the enemy king
+    Bitboard discoverers = 0;               // own pieces shielding the enemy king from an own slider
+    Bitboard pinned = 0;                    // own pieces shielding the own king from an enemy slider
+    Bitboard checkers = 0;
+    int kingSq = -1;
+    int enemyKingSq = -1;
+
+    bool isLegal(const GameState& gs, const Move& m) const;
+    bool givesCheck(const GameState& gs, const Move& m) const;
+};
+
+CheckInfo computeCheckInfo(const GameState& gs);
+
 bool isSquareAttacked(const GameState& gs, int r, int c, bool byWhite);
+// Attack-table queries on square indices (a8 = 0); slider attacks stop at the first
+// blocker in `occupancy`. attackersTo returns attackers of both colours.
+Bitboard pawnAttacksFrom(int sq, bool white);
+Bitboard knightAttacksFrom(int sq);
+Bitboard kingAttacksFrom(int sq);
+Bitboard bishopAttacksFrom(int sq, Bitboard occupancy);
+Bitboard rookAttacksFrom(int sq, Bitboard occupancy);
+Bitboard attackersTo(const GameState& gs, int sq, Bitboard occupancy);
 bool isInCheck(const GameState& gs, bool white);
 void generatePseudoLegalMoves(const GameState& gs, MoveList& out);
+// Zobrist and pawn keys of the position after `m`, without making it (used to prefetch).
+std::uint64_t keyAfter(const GameState& gs, const Move& m);
+std::uint64_t pawnKeyAfter(const GameState& gs, const Move& m);
 void makeMove(GameState& gs, const Move& m, bool trackHistory = true);
+// Same, with the child keys already computed by keyAfter and pawnKeyAfter.
+void makeMove(GameState& gs, const Move& m, std::uint64_t childKey, std::uint64_t childPawnKey,
+    bool trackHistory = true);
 void undoMove(GameState& gs, bool trackHistory = true);
 void generateLegalMoves(GameState& gs, MoveList& out);
 std::vector<Move> generatePseudoLegalMoves(const GameState& gs);
 std::vector<Move> generateLegalMoves(GameState& gs);
+// Quiescence generators: legal captures plus all promotions, and legal quiet
+// (non-capture, non-promotion) moves that give check.
+void generateLegalTacticalMoves(const GameState& gs, MoveList& out);
+void generateLegalQuietChecks(const GameState& gs, MoveList& out);
+// Cursor forms for callers with their own move storage (the search arena): write from `out`,
+// which must have room for MAX_MOVES, and return one past the last move written.
+Move* generatePseudoLegalMoves(const GameState& gs, Move* out);
+Move* generateLegalMoves(const GameState& gs, Move* out);
+Move* generateLegalTacticalMoves(const GameState& gs, Move* out);
+Move* generateLegalQuietChecks(const GameState& gs, Move* out);
+Move unpackMove(const GameState& gs, std::uint16_t packed);
+// Resolves a SAN token (check/annotation suffixes allowed) against the legal moves; false
+// when it names no legal move or is ambiguous.
+bool parseSanMove(const GameState& gs, std::string_view san, Move& out);
+// SAN for a legal move, with disambiguation and a check or mate suffix.
+std::string moveToSan(const GameState& gs, const Move& m);
 bool hasSufficientMaterial(const GameState& gs);
 std::optional<std::string> checkGameOver(GameState& gs);
\ No newline at end of file
@@ -1,14 +1,78 @@
 #pragma once
 
 #include "chess.hpp"
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
+
+// The per-node search counters are compiled out unless built with -DENGINE_SEARCH_STATS=1
+// (`make SEARCH_STATS=1`, or `make stats` for a bench run with them).
+#ifndef ENGINE_SEARCH_STATS
+#define ENGINE_SEARCH_STATS 0
+#endif
+
+struct SearchCounters {
+	std::uint64_t mainNodes = 0;
+	std::uint64_t qsearchNodes = 0;
+	std::uint64_t ttProbes = 0;
+	std::uint64_t ttHits = 0;
+	std::uint64_t ttCutoffs = 0;
+	std::uint64_t nullMoveTries = 0;
+	std::uint64_t nullMoveCutoffs = 0;
+	std::uint64_t nullMoveVerifyFails = 0;
+	std::uint64_t razorPrunes = 0;
+	std::uint64_t reverseFutilityPrunes = 0;
+	std::uint64_t futilityPrunes = 0;
+	std::uint64_t lmpPrunes = 0;
+	std::uint64_t seePrunes = 0;
+	std::uint64_t lmrSearches = 0;
+	std::uint64_t lmrResearches = 0;
+	std::uint64_t checkExtensions = 0;
+	std::uint64_t singularTries = 0;
+	std::uint64_t singularExtensions = 0;
+	std::uint64_t iidSearches = 0;
+	std::uint64_t qsearchDeltaPrunes = 0;
+	std::uint64_t qsearchSeePrunes = 0;
+	std::uint64_t expandedNodes = 0;
+	std::uint64_t movesSearched = 0;
+	std::uint64_t failHighs = 0;
+	std::uint64_t failHighsFirst = 0;
+};
 
 struct SearchStats {
-	int nodes = 0;
+	std::uint64_t nodes = 0;
 	int depthReached = 0;
 	int bestScore = 0;
 	int timeMs = 0;
 	double nps = 0.0;
+	double effectiveBranching = 0.0;
+	bool hasPonderMove = false;
+	Move ponderMove;
+	bool countersEnabled = ENGINE_SEARCH_STATS != 0;
+	SearchCounters counters;
+	int softLimitMs = 0;
+	int scaledSoftLimitMs = 0;
+	int hardLimitMs = 0;
+	double timeScale = 1.0;
+	int bestMoveChanges = 0;
+	std::string stopReason;
+	std::vector<Move> pv;   // legal from the root; empty for book moves
+	int mateIn = 0;         // moves to mate, negative when mated; 0 for a normal score
+};
+
+// Limits for one search; a zero node budget, mate distance or soft time means "no limit".
+// timeLimitMs is the hard limit; softTimeMs is only checked between iterations.
+struct SearchLimits {
+	int maxDepth = 64;
+	// Searches exactly maxDepth plies; otherwise endgames get a few plies on top of it.
+	bool exactDepth = false;
+	int timeLimitMs = 600000;
+	int softTimeMs = 0;
+	std::uint64_t nodes = 0;
+	int mateInMoves = 0;
+	std::vector<Move> searchMoves;
+	bool useBook = true;
 };
 
 struct EngineTuningParams {
@@ -28,19 +92,45 @@ struct EngineTuningParams {
 
 Move computeBestMove(GameState gs, int depth);
 Move computeBestMove(GameState gs, int maxDepth, int timeLimitMs);
+Move computeBestMove(GameState gs, const SearchLimits& limits);
 SearchStats getLastSearchStats();
+std::string formatSearchCounters(const SearchStats& stats);
+std::string formatTimeUsage(const SearchStats& stats);
 void requestStopSearch();
+void clearSearchHistory();
 void clearStopSearch();
+void setPondering(bool active);
+void ponderHit(int timeLimitMs);
+bool isPondering();
 void setHashSizeMb(int mb);
+void clearHash();
+// Keeps the hash table in memory shared with processes forked after it is allocated, so
+// forked search workers probe and store into one table.
+void setHashShared(bool shared);
 int getHashSizeMb();
+// Search tables and the net are built on first use; returns true if this call built them.
+bool ensureSearchTablesReady();
+std::string getLargePageReport();
+// Builds every lazily initialised component and reports how long each one took.
+std::string getStartupReport();
+bool saveHashFile(const std::string& path);
+bool loadHashFile(const std::string& path);
+// Compiles UCI line files (or the built-in lines when `inputs` is empty) and .pgn files into
+// the binary book at `outPath`; returns the record count, or -1 if it cannot be written.
+int buildOpeningBook(const std::string& outPath, const std::vector<std::string>& inputs);
 void setTuningParams(const EngineTuningParams& p);
 EngineTuningParams getTuningParams();
 void setSyzygyPath(const std::string& path);
 std::string getSyzygyPath();
 void setSyzygyProbeLimit(int pieces);
 int getSyzygyProbeLimit();
+void setMultiPv(int lines);
+int getMultiPv();
 void setSearchInfoOutputEnabled(bool enabled);
 bool isSearchInfoOutputEnabled();
+// Receives each search "info" line (without newline) on the searching thread instead of
+// stdout; an empty sink restores stdout.
+void setSearchInfoSink(std::function<void(const std::string&)> sink);
 void learningStartGame();
 void learningAbortGame();
 void learningFinalizeGame();
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only view of a whole file: mmap on Linux, a heap copy elsewhere. An unreadable or
+// empty file maps to size() == 0.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    std::string_view text() const { return { reinterpret_cast<const char*>(data_), size_ }; }
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+#if !defined(__linux__)
+    std::vector<char> buffer_;
+#endif
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include "chess.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+enum class PgnTokenType {
+    Tag,              // text between the brackets
+    Symbol,           // SAN (or anything else) in the movetext
+    MoveNumber,       // "12." or "12..."
+    Result,           // 1-0, 0-1, 1/2-1/2, *
+    Nag,              // $n
+    Comment,          // text between braces, or after ';' up to the end of the line
+    VariationStart,
+    VariationEnd,
+};
+
+struct PgnToken {
+    PgnTokenType type = PgnTokenType::Symbol;
+    std::string_view text;
+};
+
+// Splits PGN text into tokens in place; token text points into the source and nothing is
+// allocated.
+class PgnTokenizer {
+public:
+    explicit PgnTokenizer(std::string_view text) : text_(text) {}
+
+    bool next(PgnToken& token);
+
+private:
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+// One game from PGN text. Tag names and values, the FEN and the result are views into the
+// source text; moves are the mainline as far as it could be replayed.
+struct PgnGame {
+    std::vector<std::pair<std::string_view, std::string_view>> tags;
+    std::string_view fen;      // from a FEN tag; empty for the standard start
+    std::string_view result;   // result token or Result tag; empty if neither was present
+    std::vector<Move> moves;
+    bool complete = true;      // false when the FEN tag or a move could not be read
+
+    void clear();
+};
+
+// Calls onGame for each game in order. The game object is reused, so callers that keep a game
+// must copy it (its views stay valid as long as `text` does).
+void forEachPgnGame(std::string_view text, const std::function<void(const PgnGame&)>& onGame);
+
+struct PgnReadStats {
+    size_t games = 0;
+    size_t moves = 0;
+    size_t incomplete = 0;
+    size_t bytes = 0;
+};
+
+// Maps `path` and reads it with up to `threads` readers, each taking a slice cut at a game
+// boundary. onGame(reader, game) runs concurrently on the reader threads, so games from
+// different slices arrive in no particular order.
+PgnReadStats readPgnFile(const std::string& path, int threads,
+                         const std::function<void(int, const PgnGame&)>& onGame);
@@ -0,0 +1,6 @@
+#pragma once
+
+// Headless front end shared by the GUI build and the chess-engine binary: --bench, --tune,
+// --build-book, --analyze-epd, --annotate-pgn, --pgn-bench, --startup-report, --server, and
+// the UCI loop when no mode is given.
+int runHeadless(int argc, char** argv);
@@ -1,22 +1,20 @@
 #include "../include/chess.hpp"
+#include <algorithm>
 #include <array>
 #include <cctype>
-#include <cmath>
-#include <random>
-#include <sstream>
 #include <vector>
 
 namespace {
 constexpr int WHITE = 0;
 constexpr int BLACK = 1;
 
-inline bool inBounds(int r, int c) { return r >= 0 && r < 8 && c >= 0 && c < 8; }
-inline int colorIndex(bool white) { return white ? WHITE : BLACK; }
-inline int pieceIndex(int type) { return type - 1; }
-inline int squareOf(int r, int c) { return r * 8 + c; }
-inline int rowOf(int sq) { return sq / 8; }
-inline int colOf(int sq) { return sq % 8; }
-inline Bitboard bitAt(int sq) { return 1ULL << sq; }
+constexpr bool inBounds(int r, int c) { return r >= 0 && r < 8 && c >= 0 && c < 8; }
+constexpr int colorIndex(bool white) { return white ? WHITE : BLACK; }
+constexpr int pieceIndex(int type) { return type - 1; }
+constexpr int squareOf(int r, int c) { return r * 8 + c; }
+constexpr int rowOf(int sq) { return sq / 8; }
+constexpr int colOf(int sq) { return sq % 8; }
+constexpr Bitboard bitAt(int sq) { return 1ULL << sq; }
 inline std::uint8_t encodePiece(const Piece& p) { return p.type == EMPTY ? 0 : static_cast<std::uint8_t>(p.type + (p.white ? 0 : 8)); }
 inline Piece decodePiece(std::uint8_t code)
 {
@@ -33,10 +31,61 @@ struct ZobristKeys {
     Bitboard sideToMove = 0;
 };
 
-ZobristKeys initZobristKeys()
+// std::mt19937_64, evaluable at compile time. The keys must stay bit-identical to the
+// runtime generator they came from: TT files, books and experience are keyed by them.
+class ConstexprMt19937_64 {
+public:
+    constexpr explicit ConstexprMt19937_64(std::uint64_t seed)
+    {
+        state_[0] = seed;
+        for (int i = 1; i < N; ++i) {
+            state_[i] = 6364136223846793005ULL * (state_[i - 1] ^ (state_[i - 1] >> 62)) + static_cast<std::uint64_t>(i);
+        }
+    }
+
+    constexpr std::uint64_t operator()()
+    {
+        if (index_ >= N) {
+            twist();
+        }
+        std::uint64_t x = state_[index_++];
+        x ^= (x >> 29) & 0x5555555555555555ULL;
+        x ^= (x << 17) & 0x71D67FFFEDA60000ULL;
+        x ^= (x << 37) & 0xFFF7EEE000000000ULL;
+        x ^= x >> 43;
+        return x;
+    }
+
+private:
+    static constexpr int N = 312;
+    static constexpr int M = 156;
+    static constexpr std::uint64_t UPPER = 0xFFFFFFFF80000000ULL;
+    static constexpr std::uint64_t LOWER = 0x7FFFFFFFULL;
+
+    constexpr void twist()
+    {
+        for (int i = 0; i < N; ++i) {
+            const std::uint64_t y = (state_[i] & UPPER) | (state_[(i + 1) % N] & LOWER);
+            state_[i] = state_[(i + M) % N] ^ (y >> 1) ^ ((y & 1) ? 0xB5026F5AA96619E9ULL : 0);
+        }
+        index_ = 0;
+    }
+
+    std::array<std::uint64_t, N> state_{};
+    int index_ = N;
+};
+
+// [rand.predef]: the 10000th output of a default-constructed mt19937_64.
+static_assert([] {
+    ConstexprMt19937_64 rng(5489);
+    for (int i = 1; i < 10000; ++i) rng();
+    return rng();
+}() == 9981545732273789042ULL);
+
+constexpr ZobristKeys initZobristKeys()
 {
     ZobristKeys z;
-    std::mt19937_64 rng(0x9E3779B97F4A7C15ULL);
+    ConstexprMt19937_64 rng(0x9E3779B97F4A7C15ULL);
     auto rand64 = [&]() { return static_cast<Bitboard>(rng()); };
 
     for (int color = 0; color < 2; ++color) {
@@ -56,7 +105,7 @@ ZobristKeys initZobristKeys()
     return z;
 }
 
-const ZobristKeys ZOBRIST = initZobristKeys();
+constexpr ZobristKeys ZOBRIST = initZobristKeys();
 
 inline int castlingRightsMask(const GameState& gs)
 {
@@ -108,30 +157,31 @@ Bitboard computeZobristFromState(const GameState& gs)
     return h;
 }
 
-std::vector<std::string> split(const std::string& s, char delimiter)
-{
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
-    }
-    return tokens;
-}
-
-Bitboard popLsb(Bitboard& bb)
+constexpr Bitboard popLsb(Bitboard& bb)
 {
     const Bitboard lsb = bb & -bb;
     bb ^= lsb;
     return lsb;
 }
 
-int lsbSquare(Bitboard bb)
+constexpr int lsbSquare(Bitboard bb)
 {
     return __builtin_ctzll(bb);
 }
 
-int msbSquare(Bitboard bb)
+Bitboard computePawnKeyFromState(const GameState& gs)
+{
+    Bitboard h = 0;
+    for (int color = 0; color < 2; ++color) {
+        Bitboard pawns = gs.bitboards[color][pieceIndex(P)];
+        while (pawns) {
+            h ^= ZOBRIST.piece[color][pieceIndex(P)][lsbSquare(popLsb(pawns))];
+        }
+    }
+    return h;
+}
+
+constexpr int msbSquare(Bitboard bb)
 {
     return 63 - __builtin_clzll(bb);
 }
@@ -177,10 +227,10 @@ Piece pieceAtSqImpl(const GameState& gs, int sq)
     return decodePiece(gs.pieceOnSquare[sq]);
 }
 
-std::array<Bitboard, 64> initKnightAttacks()
+constexpr std::array<Bitboard, 64> initKnightAttacks()
 {
     std::array<Bitboard, 64> attacks{};
-    static constexpr int offsets[8][2] = {
+    constexpr int offsets[8][2] = {
         { -2, -1 }, { -2, 1 }, { -1, -2 }, { -1, 2 },
         { 1, -2 },  { 1, 2 },  { 2, -1 },  { 2, 1 },
     };
@@ -201,7 +251,7 @@ std::array<Bitboard, 64> initKnightAttacks()
     return attacks;
 }
 
-std::array<Bitboard, 64> initKingAttacks()
+constexpr std::array<Bitboard, 64> initKingAttacks()
 {
     std::array<Bitboard, 64> attacks{};
     for (int sq = 0; sq < 64; ++sq) {
@@ -225,7 +275,7 @@ std::array<Bitboard, 64> initKingAttacks()
     return attacks;
 }
 
-std::array<std::array<Bitboard, 64>, 2> initPawnAttacks()
+constexpr std::array<std::array<Bitboard, 64>, 2> initPawnAttacks()
 {
     std::array<std::array<Bitboard, 64>, 2> attacks{};
 
@@ -255,7 +305,7 @@ std::array<std::array<Bitboard, 64>, 2> initPawnAttacks()
     return attacks;
 }
 
-std::array<std::array<Bitboard, 64>, 2> initPawnAttackers(const std::array<std::array<Bitboard, 64>, 2>& pawnAttacks)
+constexpr std::array<std::array<Bitboard, 64>, 2> initPawnAttackers(const std::array<std::array<Bitboard, 64>, 2>& pawnAttacks)
 {
     std::array<std::array<Bitboard, 64>, 2> attackers{};
 
@@ -283,11 +333,11 @@ enum Direction : int {
     SOUTH_EAST = 7
 };
 
-std::array<std::array<Bitboard, 64>, 8> initRays()
+constexpr std::array<std::array<Bitboard, 64>, 8> initRays()
 {
     std::array<std::array<Bitboard, 64>, 8> rays{};
-    static constexpr int dr[8] = { -1, 1, 0, 0, -1, -1, 1, 1 };
-    static constexpr int dc[8] = { 0, 0, -1, 1, -1, 1, -1, 1 };
+    constexpr int dr[8] = { -1, 1, 0, 0, -1, -1, 1, 1 };
+    constexpr int dc[8] = { 0, 0, -1, 1, -1, 1, -1, 1 };
 
     for (int sq = 0; sq < 64; ++sq) {
         const int r = rowOf(sq);
@@ -344,18 +394,44 @@ inline Bitboard rookAttacks(int sq, Bitboard occupancy, const std::array<std::ar
     return rayAttacks(sq, occupancy, dirs, 4, rays);
 }
 
-const std::array<std::array<Bitboard, 64>, 2> PAWN_ATTACKS = initPawnAttacks();
-const std::array<std::array<Bitboard, 64>, 2> PAWN_ATTACKERS = initPawnAttackers(PAWN_ATTACKS);
-const std::array<Bitboard, 64> KNIGHT_ATTACKS = initKnightAttacks();
-const std::array<Bitboard, 64> KING_ATTACKS = initKingAttacks();
-const std::array<std::array<Bitboard, 64>, 8> RAYS = initRays();
+// All fixed tables are built at compile time, so process start runs no initialisers for them.
+constexpr std::array<std::array<Bitboard, 64>, 2> PAWN_ATTACKS = initPawnAttacks();
+constexpr std::array<std::array<Bitboard, 64>, 2> PAWN_ATTACKERS = initPawnAttackers(PAWN_ATTACKS);
+constexpr std::array<Bitboard, 64> KNIGHT_ATTACKS = initKnightAttacks();
+constexpr std::array<Bitboard, 64> KING_ATTACKS = initKingAttacks();
+constexpr std::array<std::array<Bitboard, 64>, 8> RAYS = initRays();
 
-void addMove(MoveList& moves, int fromSq, int toSq, int capturedType = EMPTY,
-    bool isEnPassant = false, bool isCastle = false, bool promotion = false, int promotionType = Q)
+struct LineTables {
+    std::array<std::array<Bitboard, 64>, 64> between{};
+    std::array<std::array<Bitboard, 64>, 64> line{};
+};
+
+// between[a][b]: squares strictly between two aligned squares; line[a][b]: the full
+// rank, file or diagonal through both. Both are empty when a and b are not aligned.
+constexpr LineTables initLineTables(const std::array<std::array<Bitboard, 64>, 8>& rays)
 {
-    if (moves.count >= static_cast<int>(moves.moves.size())) {
-        return;
+    constexpr int opposite[8] = { SOUTH, NORTH, EAST, WEST, SOUTH_EAST, SOUTH_WEST, NORTH_EAST, NORTH_WEST };
+    LineTables t;
+    for (int a = 0; a < 64; ++a) {
+        for (int dir = 0; dir < 8; ++dir) {
+            const Bitboard fullLine = rays[dir][a] | rays[opposite[dir]][a] | bitAt(a);
+            Bitboard targets = rays[dir][a];
+            while (targets) {
+                const int b = lsbSquare(popLsb(targets));
+                t.between[a][b] = rays[dir][a] & rays[opposite[dir]][b];
+                t.line[a][b] = fullLine;
+            }
+        }
     }
+    return t;
+}
+
+constexpr LineTables LINES = initLineTables(RAYS);
+
+// Generators write through a cursor; callers provide room for MAX_MOVES.
+void addMove(Move*& moves, int fromSq, int toSq, int capturedType = EMPTY,
+    bool isEnPassant = false, bool isCastle = false, bool promotion = false, int promotionType = Q)
+{
     Move m;
     m.setFrom(static_cast<std::uint8_t>(fromSq));
     m.setTo(static_cast<std::uint8_t>(toSq));
@@ -373,52 +449,35 @@ void addMove(MoveList& moves, int fromSq, int toSq, int capturedType = EMPTY,
     if (promotion) {
         m.addFlags(Move::FLAG_PROMOTION);
     }
-    moves.moves[moves.count++] = m;
+    *moves++ = m;
 }
 
-void applyMoveNoHistory(GameState& gs, const Move& m)
+template <int Us>
+void applyMoveForSide(GameState& gs, const Move& m)
 {
+    constexpr bool white = (Us == WHITE);
+    constexpr int backRank = white ? 7 : 0;
+    constexpr int pawnPush = white ? -8 : 8;
+
     const int fromSq = m.from();
     const int toSq = m.to();
-    const int fromR = rowOf(fromSq);
-    const int fromC = colOf(fromSq);
-    const int toR = rowOf(toSq);
-    const int toC = colOf(toSq);
+    const int capSq = m.isEnPassant() ? toSq - pawnPush : toSq;
 
     const Piece movingPiece = pieceAtSqImpl(gs, fromSq);
-    Piece capturedPiece { EMPTY, false };
-
-    if (m.isEnPassant()) {
-        capturedPiece = pieceAtSqImpl(gs, squareOf(fromR, toC));
-    } else {
-        capturedPiece = pieceAtSqImpl(gs, toSq);
-    }
+    const Piece capturedPiece = pieceAtSqImpl(gs, capSq);
 
     removePiece(gs, fromSq, movingPiece);
-
-    if (m.isEnPassant()) {
-        const int capSq = squareOf(fromR, toC);
-        removePiece(gs, capSq, capturedPiece);
-    } else if (capturedPiece.type != EMPTY) {
-        removePiece(gs, toSq, capturedPiece);
-    }
+    removePiece(gs, capSq, capturedPiece);
 
     if (m.isCastle()) {
         placePiece(gs, toSq, movingPiece);
 
-        if (toC == 6) {
-            const int rookFrom = squareOf(toR, 7);
-            const int rookTo = squareOf(toR, 5);
-            const Piece rook = pieceAtSqImpl(gs, rookFrom);
-            removePiece(gs, rookFrom, rook);
-            placePiece(gs, rookTo, rook);
-        } else {
-            const int rookFrom = squareOf(toR, 0);
-            const int rookTo = squareOf(toR, 3);
-            const Piece rook = pieceAtSqImpl(gs, rookFrom);
-            removePiece(gs, rookFrom, rook);
-            placePiece(gs, rookTo, rook);
-        }
+        const bool kingSide = colOf(toSq) == 6;
+        const int rookFrom = squareOf(backRank, kingSide ? 7 : 0);
+        const int rookTo = squareOf(backRank, kingSide ? 5 : 3);
+        const Piece rook = pieceAtSqImpl(gs, rookFrom);
+        removePiece(gs, rookFrom, rook);
+        placePiece(gs, rookTo, rook);
     } else {
         Piece placed = movingPiece;
         if (m.isPromotion()) {
@@ -428,40 +487,27 @@ void applyMoveNoHistory(GameState& gs, const Move& m)
     }
 
     if (movingPiece.type == K) {
-        if (movingPiece.white) {
-            gs.wkMoved = true;
-        } else {
-            gs.bkMoved = true;
-        }
-    }
-
-    if (movingPiece.type == R) {
-        if (movingPiece.white) {
-            if (fromR == 7 && fromC == 0)
-                gs.wrAHMoved = true;
-            if (fromR == 7 && fromC == 7)
-                gs.wrHHMoved = true;
-        } else {
-            if (fromR == 0 && fromC == 0)
-                gs.brAHMoved = true;
-            if (fromR == 0 && fromC == 7)
-                gs.brHHMoved = true;
-        }
+        (white ? gs.wkMoved : gs.bkMoved) = true;
+    } else if (movingPiece.type == R) {
+        if (fromSq == squareOf(backRank, 0))
+            (white ? gs.wrAHMoved : gs.brAHMoved) = true;
+        if (fromSq == squareOf(backRank, 7))
+            (white ? gs.wrHHMoved : gs.brHHMoved) = true;
     }
 
     if (capturedPiece.type == R) {
-        if (toR == 0 && toC == 0)
+        if (toSq == squareOf(0, 0))
             gs.brAHMoved = true;
-        if (toR == 0 && toC == 7)
+        if (toSq == squareOf(0, 7))
             gs.brHHMoved = true;
-        if (toR == 7 && toC == 0)
+        if (toSq == squareOf(7, 0))
             gs.wrAHMoved = true;
-        if (toR == 7 && toC == 7)
+        if (toSq == squareOf(7, 7))
             gs.wrHHMoved = true;
     }
 
-    if (movingPiece.type == P && std::abs(fromR - toR) == 2) {
-        gs.enPassantTarget = std::make_pair((fromR + toR) / 2, fromC);
+    if (movingPiece.type == P && toSq - fromSq == 2 * pawnPush) {
+        gs.enPassantTarget = std::make_pair(rowOf(fromSq + pawnPush), colOf(fromSq));
     } else {
         gs.enPassantTarget = std::nullopt;
     }
@@ -471,11 +517,20 @@ void applyMoveNoHistory(GameState& gs, const Move& m)
     } else {
         gs.halfmoveClock++;
     }
-    if (!gs.whiteToMove) {
+    if constexpr (!white) {
         gs.fullmoveNumber++;
     }
 
-    gs.whiteToMove = !gs.whiteToMove;
+    gs.whiteToMove = !white;
+}
+
+void applyMoveNoHistory(GameState& gs, const Move& m)
+{
+    if (gs.whiteToMove) {
+        applyMoveForSide<WHITE>(gs, m);
+    } else {
+        applyMoveForSide<BLACK>(gs, m);
+    }
 }
 }
 
@@ -495,73 +550,310 @@ Piece pieceAtSq(const GameState& gs, int sq)
     return pieceAtSqImpl(gs, sq);
 }
 
-void GameState::loadFromFen(const std::string& fen)
+namespace {
+constexpr char FEN_PIECE_CHARS[] = " PNBRQK  pnbrqk";
+
+// pieceOnSquare code for a FEN piece letter, 0 for anything else.
+constexpr std::uint8_t pieceCodeFromFen(char ch)
 {
-    undoTop = 0;
-    positionHashCounts.clear();
-    positionHashCounts.reserve(512);
-    initialFen = fen;
-    clearBitboards(*this);
+    for (std::uint8_t code = 1; code < 15; ++code) {
+        if (FEN_PIECE_CHARS[code] == ch && ch != ' ') {
+            return code;
+        }
+    }
+    return 0;
+}
 
-    auto parts = split(fen, ' ');
-    if (parts.size() < 4)
-        return;
+constexpr bool validPieceCode(std::uint8_t code)
+{
+    return (code & 0x7) >= P && (code & 0x7) <= K;
+}
+
+// Splits off the next space-separated field, skipping leading spaces.
+std::string_view nextFenField(std::string_view& rest)
+{
+    std::size_t start = 0;
+    while (start < rest.size() && (rest[start] == ' ' || rest[start] == '\t')) {
+        ++start;
+    }
+    std::size_t end = start;
+    while (end < rest.size() && rest[end] != ' ' && rest[end] != '\t') {
+        ++end;
+    }
+    const std::string_view field = rest.substr(start, end - start);
+    rest.remove_prefix(end);
+    return field;
+}
+
+bool parseFenCounter(std::string_view field, int& out)
+{
+    if (field.empty() || field.size() > 9) {
+        return false;
+    }
+    int value = 0;
+    for (char ch : field) {
+        if (ch < '0' || ch > '9') {
+            return false;
+        }
+        value = value * 10 + (ch - '0');
+    }
+    out = value;
+    return true;
+}
+
+char* writeFenCounter(char* out, int value)
+{
+    char digits[12];
+    int n = 0;
+    unsigned v = value < 0 ? 0u : static_cast<unsigned>(value);
+    do {
+        digits[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    while (n > 0) {
+        *out++ = digits[--n];
+    }
+    return out;
+}
 
+void setCastlingRights(GameState& gs, int mask)
+{
+    gs.wrHHMoved = (mask & 1) == 0;
+    gs.wrAHMoved = (mask & 2) == 0;
+    gs.brHHMoved = (mask & 4) == 0;
+    gs.brAHMoved = (mask & 8) == 0;
+    gs.wkMoved = (mask & 3) == 0;
+    gs.bkMoved = (mask & 12) == 0;
+}
+
+// Every field a FEN or packed record sets, at its default: empty board, white to move, no
+// castling or en passant, counters 0 and 1.
+void resetPosition(GameState& gs)
+{
+    clearBitboards(gs);
+    gs.whiteToMove = true;
+    setCastlingRights(gs, 0);
+    gs.enPassantTarget = std::nullopt;
+    gs.halfmoveClock = 0;
+    gs.fullmoveNumber = 1;
+}
+
+// Keys and history for a freshly loaded position.
+void finishLoadedPosition(GameState& gs)
+{
+    gs.undoTop = 0;
+    gs.positionHashCounts.clear();
+    gs.zobristKey = computeZobristFromState(gs);
+    gs.pawnKey = computePawnKeyFromState(gs);
+}
+
+// Reads the FEN fields into a reset position, stopping at the first malformed one.
+bool readFenFields(std::string_view fen, GameState& gs)
+{
+    std::string_view rest = fen;
+    const std::string_view board = nextFenField(rest);
     int r = 0;
     int c = 0;
-    for (char ch : parts[0]) {
+    for (char ch : board) {
         if (ch == '/') {
-            ++r;
+            if (c != 8 || ++r > 7) {
+                return false;
+            }
             c = 0;
-            continue;
-        }
-        if (std::isdigit(static_cast<unsigned char>(ch))) {
+        } else if (ch >= '1' && ch <= '8') {
             c += ch - '0';
-            continue;
+        } else {
+            const std::uint8_t code = pieceCodeFromFen(ch);
+            if (code == 0 || c > 7) {
+                return false;
+            }
+            placePiece(gs, squareOf(r, c), decodePiece(code));
+            ++c;
+        }
+        if (c > 8) {
+            return false;
+        }
+    }
+    if (r != 7 || c != 8) {
+        return false;
+    }
+
+    const std::string_view side = nextFenField(rest);
+    if (side != "w" && side != "b") {
+        return false;
+    }
+    gs.whiteToMove = side == "w";
+
+    const std::string_view castling = nextFenField(rest);
+    int rights = 0;
+    if (castling != "-") {
+        if (castling.empty()) {
+            return false;
+        }
+        for (char ch : castling) {
+            switch (ch) {
+            case 'K': rights |= 1; break;
+            case 'Q': rights |= 2; break;
+            case 'k': rights |= 4; break;
+            case 'q': rights |= 8; break;
+            default: return false;
+            }
+        }
+    }
+    setCastlingRights(gs, rights);
+
+    const std::string_view ep = nextFenField(rest);
+    if (ep != "-") {
+        if (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' || (ep[1] != '3' && ep[1] != '6')) {
+            return false;
+        }
+        gs.enPassantTarget = std::make_pair(8 - (ep[1] - '0'), ep[0] - 'a');
+    }
+
+    const std::string_view halfmove = nextFenField(rest);
+    if (!halfmove.empty()) {
+        if (!parseFenCounter(halfmove, gs.halfmoveClock)) {
+            return false;
+        }
+        const std::string_view fullmove = nextFenField(rest);
+        if (!fullmove.empty() && !parseFenCounter(fullmove, gs.fullmoveNumber)) {
+            return false;
         }
+    }
+    return true;
+}
+}
+
+bool parseFen(std::string_view fen, GameState& gs)
+{
+    resetPosition(gs);
+    const bool ok = readFenFields(fen, gs);
+    gs.initialFen.assign(fen);
+    finishLoadedPosition(gs);
+    return ok;
+}
 
-        Piece p;
-        p.white = std::isupper(static_cast<unsigned char>(ch));
-        switch (std::tolower(static_cast<unsigned char>(ch))) {
-        case 'p': p.type = P; break;
-        case 'n': p.type = N; break;
-        case 'b': p.type = B; break;
-        case 'r': p.type = R; break;
-        case 'q': p.type = Q; break;
-        case 'k': p.type = K; break;
-        default: p.type = EMPTY; break;
+std::size_t writeFen(const GameState& gs, char* out)
+{
+    char* p = out;
+    for (int r = 0; r < 8; ++r) {
+        int empty = 0;
+        for (int c = 0; c < 8; ++c) {
+            const std::uint8_t code = gs.pieceOnSquare[squareOf(r, c)];
+            if (code == 0) {
+                ++empty;
+                continue;
+            }
+            if (empty) {
+                *p++ = static_cast<char>('0' + empty);
+                empty = 0;
+            }
+            *p++ = FEN_PIECE_CHARS[code];
+        }
+        if (empty) {
+            *p++ = static_cast<char>('0' + empty);
         }
+        if (r < 7) {
+            *p++ = '/';
+        }
+    }
 
-        if (inBounds(r, c) && p.type != EMPTY) {
-            placePiece(*this, squareOf(r, c), p);
+    *p++ = ' ';
+    *p++ = gs.whiteToMove ? 'w' : 'b';
+    *p++ = ' ';
+    const int rights = castlingRightsMask(gs);
+    if (rights == 0) {
+        *p++ = '-';
+    } else {
+        for (int i = 0; i < 4; ++i) {
+            if (rights & (1 << i)) {
+                *p++ = "KQkq"[i];
+            }
         }
-        ++c;
+    }
+    *p++ = ' ';
+    if (gs.enPassantTarget.has_value()) {
+        *p++ = static_cast<char>('a' + gs.enPassantTarget->second);
+        *p++ = static_cast<char>('8' - gs.enPassantTarget->first);
+    } else {
+        *p++ = '-';
+    }
+    *p++ = ' ';
+    p = writeFenCounter(p, gs.halfmoveClock);
+    *p++ = ' ';
+    p = writeFenCounter(p, gs.fullmoveNumber);
+    return static_cast<std::size_t>(p - out);
+}
+
+std::string toFen(const GameState& gs)
+{
+    char buf[MAX_FEN_LENGTH];
+    return std::string(buf, writeFen(gs, buf));
+}
+
+bool packPosition(const GameState& gs, PackedPosition& out)
+{
+    if (__builtin_popcountll(gs.occupancyBoth) > 32) {
+        return false;
+    }
+
+    out = PackedPosition {};
+    out.occupancy = gs.occupancyBoth;
+    int index = 0;
+    for (Bitboard occ = gs.occupancyBoth; occ; ++index) {
+        const std::uint8_t code = gs.pieceOnSquare[lsbSquare(popLsb(occ))];
+        out.pieces[index / 2] |= static_cast<std::uint8_t>(code << (4 * (index & 1)));
     }
 
-    whiteToMove = (parts[1] == "w");
+    out.state = static_cast<std::uint8_t>((gs.whiteToMove ? 0 : 1) | (castlingRightsMask(gs) << 1));
+    const int ep = epSquare(gs.enPassantTarget);
+    out.epSquare = ep >= 0 ? static_cast<std::uint8_t>(ep) : PackedPosition::NO_EP_SQUARE;
+    out.halfmoveClock = static_cast<std::uint16_t>(std::clamp(gs.halfmoveClock, 0, 0xFFFF));
+    out.fullmoveNumber = static_cast<std::uint16_t>(std::clamp(gs.fullmoveNumber, 0, 0xFFFF));
+    return true;
+}
 
-    std::string castling = parts[2];
-    wkMoved = (castling.find('K') == std::string::npos && castling.find('Q') == std::string::npos);
-    bkMoved = (castling.find('k') == std::string::npos && castling.find('q') == std::string::npos);
-    wrHHMoved = (castling.find('K') == std::string::npos);
-    wrAHMoved = (castling.find('Q') == std::string::npos);
-    brHHMoved = (castling.find('k') == std::string::npos);
-    brAHMoved = (castling.find('q') == std::string::npos);
+bool unpackPosition(const PackedPosition& packed, GameState& gs)
+{
+    if (__builtin_popcountll(packed.occupancy) > 32 || packed.state > 0x1F) {
+        return false;
+    }
+    const int ep = packed.epSquare;
+    if (ep != PackedPosition::NO_EP_SQUARE && (ep > 63 || (rowOf(ep) != 2 && rowOf(ep) != 5))) {
+        return false;
+    }
 
-    enPassantTarget = std::nullopt;
-    if (parts[3] != "-") {
-        const int ep_c = parts[3][0] - 'a';
-        const int ep_r = 8 - (parts[3][1] - '0');
-        if (inBounds(ep_r, ep_c)) {
-            enPassantTarget = std::make_pair(ep_r, ep_c);
+    resetPosition(gs);
+    int index = 0;
+    for (Bitboard occ = packed.occupancy; occ; ++index) {
+        const int sq = lsbSquare(popLsb(occ));
+        const std::uint8_t code = (packed.pieces[index / 2] >> (4 * (index & 1))) & 0xF;
+        if (!validPieceCode(code)) {
+            finishLoadedPosition(gs);
+            return false;
         }
+        placePiece(gs, sq, decodePiece(code));
     }
 
-    halfmoveClock = (parts.size() > 4) ? std::stoi(parts[4]) : 0;
-    fullmoveNumber = (parts.size() > 5) ? std::stoi(parts[5]) : 1;
+    gs.whiteToMove = (packed.state & 1) == 0;
+    setCastlingRights(gs, packed.state >> 1);
+    if (ep != PackedPosition::NO_EP_SQUARE) {
+        gs.enPassantTarget = std::make_pair(rowOf(ep), colOf(ep));
+    }
+    gs.halfmoveClock = packed.halfmoveClock;
+    gs.fullmoveNumber = packed.fullmoveNumber;
 
-    zobristKey = computeZobristFromState(*this);
+    finishLoadedPosition(gs);
+    char fen[MAX_FEN_LENGTH];
+    gs.initialFen.assign(fen, writeFen(gs, fen));
+    return true;
+}
 
+void GameState::loadFromFen(const std::string& fen)
+{
+    // Malformed input keeps what was read before the error, with keys to match.
+    parseFen(fen, *this);
+    positionHashCounts.reserve(512);
     positionHashCounts[positionHash(*this)]++;
 }
 
@@ -598,6 +890,46 @@ bool isSquareAttacked(const GameState& gs, int r, int c, bool byWhite)
     return false;
 }
 
+Bitboard pawnAttacksFrom(int sq, bool white)
+{
+    return PAWN_ATTACKS[colorIndex(white)][sq];
+}
+
+Bitboard knightAttacksFrom(int sq)
+{
+    return KNIGHT_ATTACKS[sq];
+}
+
+Bitboard kingAttacksFrom(int sq)
+{
+    return KING_ATTACKS[sq];
+}
+
+Bitboard bishopAttacksFrom(int sq, Bitboard occupancy)
+{
+    return bishopAttacks(sq, occupancy, RAYS);
+}
+
+Bitboard rookAttacksFrom(int sq, Bitboard occupancy)
+{
+    return rookAttacks(sq, occupancy, RAYS);
+}
+
+Bitboard attackersTo(const GameState& gs, int sq, Bitboard occupancy)
+{
+    const auto& w = gs.bitboards[WHITE];
+    const auto& b = gs.bitboards[BLACK];
+    const Bitboard bishopsQueens = w[pieceIndex(B)] | w[pieceIndex(Q)] | b[pieceIndex(B)] | b[pieceIndex(Q)];
+    const Bitboard rooksQueens = w[pieceIndex(R)] | w[pieceIndex(Q)] | b[pieceIndex(R)] | b[pieceIndex(Q)];
+
+    return (PAWN_ATTACKERS[WHITE][sq] & w[pieceIndex(P)])
+         | (PAWN_ATTACKERS[BLACK][sq] & b[pieceIndex(P)])
+         | (KNIGHT_ATTACKS[sq] & (w[pieceIndex(N)] | b[pieceIndex(N)]))
+         | (KING_ATTACKS[sq] & (w[pieceIndex(K)] | b[pieceIndex(K)]))
+         | (bishopAttacks(sq, occupancy, RAYS) & bishopsQueens)
+         | (rookAttacks(sq, occupancy, RAYS) & rooksQueens);
+}
+
 bool isInCheck(const GameState& gs, bool white)
 {
     const Bitboard kingBB = gs.bitboards[colorIndex(white)][pieceIndex(K)];
@@ -608,174 +940,449 @@ bool isInCheck(const GameState& gs, bool white)
     return isSquareAttacked(gs, rowOf(kingSq), colOf(kingSq), !white);
 }
 
-void generatePseudoLegalMoves(const GameState& gs, MoveList& moves)
+namespace {
+template <int Us>
+void addCastlingMoves(const GameState& gs, Move*& moves)
 {
-    moves.clear();
-
-    const bool wtm = gs.whiteToMove;
-    const int us = colorIndex(wtm);
-    const int them = colorIndex(!wtm);
-    const Bitboard ownOcc = gs.occupancies[us];
-    const Bitboard enemyOcc = gs.occupancies[them];
-
-    Bitboard pawns = gs.bitboards[us][pieceIndex(P)];
-    while (pawns) {
-        const int sq = lsbSquare(popLsb(pawns));
-        const int r = rowOf(sq);
-        const int c = colOf(sq);
-
-        const int oneStep = wtm ? sq - 8 : sq + 8;
-        if (oneStep >= 0 && oneStep < 64 && !(gs.occupancyBoth & bitAt(oneStep))) {
-            const int toR = rowOf(oneStep);
-            const bool isPromotion = (wtm && toR == 0) || (!wtm && toR == 7);
-            if (isPromotion) {
-                for (int pt : { Q, R, B, N }) {
-                    addMove(moves, sq, oneStep, EMPTY, false, false, true, pt);
-                }
-            } else {
-                addMove(moves, sq, oneStep);
-            }
-
-            if ((wtm && r == 6) || (!wtm && r == 1)) {
-                const int twoStep = wtm ? sq - 16 : sq + 16;
-                if (!(gs.occupancyBoth & bitAt(twoStep))) {
-                    addMove(moves, sq, twoStep);
-                }
-            }
-        }
+    constexpr bool white = (Us == WHITE);
+    constexpr int rank = white ? 7 : 0;
+    constexpr Bitboard kingSidePath = bitAt(squareOf(rank, 5)) | bitAt(squareOf(rank, 6));
+    constexpr Bitboard queenSidePath = bitAt(squareOf(rank, 1)) | bitAt(squareOf(rank, 2)) | bitAt(squareOf(rank, 3));
 
-        Bitboard captures = PAWN_ATTACKS[us][sq] & enemyOcc;
-        while (captures) {
-            const int toSq = lsbSquare(popLsb(captures));
-            const int capturedType = pieceAtSqImpl(gs, toSq).type;
-            const int toR = rowOf(toSq);
-            const bool isPromotion = (wtm && toR == 0) || (!wtm && toR == 7);
-            if (isPromotion) {
-                for (int pt : { Q, R, B, N }) {
-                    addMove(moves, sq, toSq, capturedType, false, false, true, pt);
-                }
-            } else {
-                addMove(moves, sq, toSq, capturedType);
-            }
-        }
+    if ((white ? gs.wkMoved : gs.bkMoved) || isInCheck(gs, white)) {
+        return;
+    }
 
-        if (gs.enPassantTarget) {
-            const auto [er, ec] = *gs.enPassantTarget;
-            if ((wtm && r == 3) || (!wtm && r == 4)) {
-                if (std::abs(c - ec) == 1 && ((wtm && er == r - 1) || (!wtm && er == r + 1))) {
-                    addMove(moves, sq, squareOf(er, ec), P, true, false, false, Q);
-                }
-            }
+    if (!(white ? gs.wrHHMoved : gs.brHHMoved) && !(gs.occupancyBoth & kingSidePath)) {
+        if (!isSquareAttacked(gs, rank, 5, !white) && !isSquareAttacked(gs, rank, 6, !white)) {
+            addMove(moves, squareOf(rank, 4), squareOf(rank, 6), EMPTY, false, true);
         }
     }
-
-    Bitboard knights = gs.bitboards[us][pieceIndex(N)];
-    while (knights) {
-        const int sq = lsbSquare(popLsb(knights));
-        Bitboard attacks = KNIGHT_ATTACKS[sq] & ~ownOcc;
-        while (attacks) {
-            const int toSq = lsbSquare(popLsb(attacks));
-            const int capturedType = (enemyOcc & bitAt(toSq))
-                ? static_cast<int>(pieceAtSqImpl(gs, toSq).type)
-                : static_cast<int>(EMPTY);
-            addMove(moves, sq, toSq, capturedType);
+    if (!(white ? gs.wrAHMoved : gs.brAHMoved) && !(gs.occupancyBoth & queenSidePath)) {
+        if (!isSquareAttacked(gs, rank, 3, !white) && !isSquareAttacked(gs, rank, 2, !white)) {
+            addMove(moves, squareOf(rank, 4), squareOf(rank, 2), EMPTY, false, true);
         }
     }
+}
 
-    Bitboard bishops = gs.bitboards[us][pieceIndex(B)];
-    while (bishops) {
-        const int sq = lsbSquare(popLsb(bishops));
-        Bitboard attacks = bishopAttacks(sq, gs.occupancyBoth, RAYS) & ~ownOcc;
-        while (attacks) {
-            const int toSq = lsbSquare(popLsb(attacks));
-            const int capturedType = (enemyOcc & bitAt(toSq))
-                ? static_cast<int>(pieceAtSqImpl(gs, toSq).type)
-                : static_cast<int>(EMPTY);
-            addMove(moves, sq, toSq, capturedType);
+// Pieces of either colour that are the only blocker between `kingSq` and a slider of
+// `sliderColor`: pinned pieces for the king's side, discovered-check candidates otherwise.
+Bitboard sliderBlockers(const GameState& gs, int kingSq, int sliderColor)
+{
+    const auto& s = gs.bitboards[sliderColor];
+    Bitboard snipers = (rookAttacks(kingSq, 0, RAYS) & (s[pieceIndex(R)] | s[pieceIndex(Q)]))
+                     | (bishopAttacks(kingSq, 0, RAYS) & (s[pieceIndex(B)] | s[pieceIndex(Q)]));
+    Bitboard blockers = 0;
+    while (snipers) {
+        const int sniperSq = lsbSquare(popLsb(snipers));
+        const Bitboard between = LINES.between[kingSq][sniperSq] & gs.occupancyBoth;
+        if (between && !(between & (between - 1))) {
+            blockers |= between;
         }
     }
+    return blockers;
+}
 
-    Bitboard rooks = gs.bitboards[us][pieceIndex(R)];
-    while (rooks) {
-        const int sq = lsbSquare(popLsb(rooks));
-        Bitboard attacks = rookAttacks(sq, gs.occupancyBoth, RAYS) & ~ownOcc;
-        while (attacks) {
-            const int toSq = lsbSquare(popLsb(attacks));
-            const int capturedType = (enemyOcc & bitAt(toSq))
-                ? static_cast<int>(pieceAtSqImpl(gs, toSq).type)
-                : static_cast<int>(EMPTY);
-            addMove(moves, sq, toSq, capturedType);
-        }
+void addTargets(Move*& moves, const GameState& gs, int fromSq, Bitboard targets)
+{
+    while (targets) {
+        const int toSq = lsbSquare(popLsb(targets));
+        addMove(moves, fromSq, toSq, pieceAtSqImpl(gs, toSq).type);
     }
+}
 
-    Bitboard queens = gs.bitboards[us][pieceIndex(Q)];
-    while (queens) {
-        const int sq = lsbSquare(popLsb(queens));
-        Bitboard attacks = (bishopAttacks(sq, gs.occupancyBoth, RAYS) | rookAttacks(sq, gs.occupancyBoth, RAYS)) & ~ownOcc;
-        while (attacks) {
-            const int toSq = lsbSquare(popLsb(attacks));
-            const int capturedType = (enemyOcc & bitAt(toSq))
-                ? static_cast<int>(pieceAtSqImpl(gs, toSq).type)
-                : static_cast<int>(EMPTY);
-            addMove(moves, sq, toSq, capturedType);
-        }
-    }
-
-    Bitboard king = gs.bitboards[us][pieceIndex(K)];
-    if (king) {
-        const int sq = lsbSquare(king);
-        Bitboard attacks = KING_ATTACKS[sq] & ~ownOcc;
-        while (attacks) {
-            const int toSq = lsbSquare(popLsb(attacks));
-            const int capturedType = (enemyOcc & bitAt(toSq))
-                ? static_cast<int>(pieceAtSqImpl(gs, toSq).type)
-                : static_cast<int>(EMPTY);
-            addMove(moves, sq, toSq, capturedType);
-        }
-
-        if (!isInCheck(gs, wtm)) {
-            const Bitboard fMask = bitAt(squareOf(wtm ? 7 : 0, 5));
-            const Bitboard gMask = bitAt(squareOf(wtm ? 7 : 0, 6));
-            const Bitboard bMask = bitAt(squareOf(wtm ? 7 : 0, 1));
-            const Bitboard cMask = bitAt(squareOf(wtm ? 7 : 0, 2));
-            const Bitboard dMask = bitAt(squareOf(wtm ? 7 : 0, 3));
-
-            if (wtm) {
-                if (!gs.wkMoved && !gs.wrHHMoved && !(gs.occupancyBoth & (fMask | gMask))) {
-                    if (!isSquareAttacked(gs, 7, 5, false) && !isSquareAttacked(gs, 7, 6, false)) {
-                        addMove(moves, squareOf(7, 4), squareOf(7, 6), EMPTY, false, true);
-                    }
-                }
-                if (!gs.wkMoved && !gs.wrAHMoved && !(gs.occupancyBoth & (bMask | cMask | dMask))) {
-                    if (!isSquareAttacked(gs, 7, 3, false) && !isSquareAttacked(gs, 7, 2, false)) {
-                        addMove(moves, squareOf(7, 4), squareOf(7, 2), EMPTY, false, true);
-                    }
-                }
-            } else {
-                if (!gs.bkMoved && !gs.brHHMoved && !(gs.occupancyBoth & (fMask | gMask))) {
-                    if (!isSquareAttacked(gs, 0, 5, true) && !isSquareAttacked(gs, 0, 6, true)) {
-                        addMove(moves, squareOf(0, 4), squareOf(0, 6), EMPTY, false, true);
-                    }
-                }
-                if (!gs.bkMoved && !gs.brAHMoved && !(gs.occupancyBoth & (bMask | cMask | dMask))) {
-                    if (!isSquareAttacked(gs, 0, 3, true) && !isSquareAttacked(gs, 0, 2, true)) {
-                        addMove(moves, squareOf(0, 4), squareOf(0, 2), EMPTY, false, true);
-                    }
-                }
-            }
+Move* keepLegal(const GameState& gs, Move* first, Move* last, const CheckInfo& ci)
+{
+    Move* kept = first;
+    for (Move* m = first; m != last; ++m) {
+        if (ci.isLegal(gs, *m)) {
+            *kept++ = *m;
         }
     }
-
+    return kept;
 }
 
-std::vector<Move> generatePseudoLegalMoves(const GameState& gs)
+void setListEnd(MoveList& list, const Move* last)
 {
-    MoveList list;
+    list.count = static_cast<int>(last - list.moves.data());
+}
+
+constexpr Bitboard FILE_A_BB = 0x0101010101010101ULL;
+constexpr Bitboard FILE_H_BB = FILE_A_BB << 7;
+constexpr Bitboard rankBB(int r) { return 0xFFULL << (r * 8); }
+
+template <int Delta>
+constexpr Bitboard shiftBy(Bitboard b)
+{
+    return Delta > 0 ? b << Delta : b >> -Delta;
+}
+
+// Pawn directions and ranks for one side; white moves towards a8 (lower squares).
+template <int Us>
+struct PawnGeometry {
+    static constexpr int push = Us == WHITE ? -8 : 8;
+    static constexpr int captureWest = push - 1;
+    static constexpr int captureEast = push + 1;
+    static constexpr Bitboard promotionFrom = rankBB(Us == WHITE ? 1 : 6);
+    static constexpr Bitboard doublePushVia = rankBB(Us == WHITE ? 5 : 2);
+};
+
+// Captures plus every promotion (qsearch), check evasions, or everything.
+enum GenType { GEN_CAPTURES, GEN_EVASIONS, GEN_ALL };
+
+template <int Delta>
+void addPawnMoves(Move*& moves, const GameState& gs, Bitboard targets)
+{
+    while (targets) {
+        const int toSq = lsbSquare(popLsb(targets));
+        addMove(moves, toSq - Delta, toSq, pieceAtSqImpl(gs, toSq).type);
+    }
+}
+
+template <int Delta>
+void addPromotions(Move*& moves, const GameState& gs, Bitboard targets)
+{
+    while (targets) {
+        const int toSq = lsbSquare(popLsb(targets));
+        const int capturedType = pieceAtSqImpl(gs, toSq).type;
+        for (int pt : { Q, R, B, N }) {
+            addMove(moves, toSq - Delta, toSq, capturedType, false, false, true, pt);
+        }
+    }
+}
+
+template <int Us, GenType Type>
+void generatePawnMoves(const GameState& gs, Move*& moves, Bitboard captureMask, Bitboard quietMask)
+{
+    using G = PawnGeometry<Us>;
+    const Bitboard pawns = gs.bitboards[Us][pieceIndex(P)];
+    const Bitboard promoting = pawns & G::promotionFrom;
+    const Bitboard others = pawns & ~G::promotionFrom;
+    const Bitboard empty = ~gs.occupancyBoth;
+
+    if constexpr (Type != GEN_CAPTURES) {
+        const Bitboard single = shiftBy<G::push>(others) & empty;
+        const Bitboard twice = shiftBy<G::push>(single & G::doublePushVia) & empty;
+        addPawnMoves<G::push>(moves, gs, single & quietMask);
+        addPawnMoves<2 * G::push>(moves, gs, twice & quietMask);
+    }
+
+    if (promoting) {
+        // Quiet promotions count as tactical moves, so the capture mask alone never hides them.
+        const Bitboard pushMask = (Type == GEN_EVASIONS) ? quietMask : empty;
+        addPromotions<G::push>(moves, gs, shiftBy<G::push>(promoting) & pushMask);
+        addPromotions<G::captureWest>(moves, gs, shiftBy<G::captureWest>(promoting & ~FILE_A_BB) & captureMask);
+        addPromotions<G::captureEast>(moves, gs, shiftBy<G::captureEast>(promoting & ~FILE_H_BB) & captureMask);
+    }
+
+    addPawnMoves<G::captureWest>(moves, gs, shiftBy<G::captureWest>(others & ~FILE_A_BB) & captureMask);
+    addPawnMoves<G::captureEast>(moves, gs, shiftBy<G::captureEast>(others & ~FILE_H_BB) & captureMask);
+
+    if (gs.enPassantTarget) {
+        // Evasion masks cannot express "captures the checker en passant"; legality sorts it out.
+        const int epSq = epSquare(gs.enPassantTarget);
+        Bitboard attackers = others & PAWN_ATTACKERS[Us][epSq];
+        while (attackers) {
+            addMove(moves, lsbSquare(popLsb(attackers)), epSq, P, true, false, false, Q);
+        }
+    }
+}
+
+template <int Pt>
+Bitboard pieceAttacks(int sq, Bitboard occupancy)
+{
+    if constexpr (Pt == N) {
+        return KNIGHT_ATTACKS[sq];
+    } else if constexpr (Pt == B) {
+        return bishopAttacks(sq, occupancy, RAYS);
+    } else if constexpr (Pt == R) {
+        return rookAttacks(sq, occupancy, RAYS);
+    } else if constexpr (Pt == Q) {
+        return bishopAttacks(sq, occupancy, RAYS) | rookAttacks(sq, occupancy, RAYS);
+    } else {
+        return KING_ATTACKS[sq];
+    }
+}
+
+template <int Us, int Pt>
+void generatePieceMoves(const GameState& gs, Move*& moves, Bitboard targets)
+{
+    Bitboard pieces = gs.bitboards[Us][pieceIndex(Pt)];
+    while (pieces) {
+        const int sq = lsbSquare(popLsb(pieces));
+        addTargets(moves, gs, sq, pieceAttacks<Pt>(sq, gs.occupancyBoth) & targets);
+    }
+}
+
+template <int Us, GenType Type>
+void generateMovesFor(const GameState& gs, Move*& moves)
+{
+    const Bitboard kingBB = gs.bitboards[Us][pieceIndex(K)];
+    Bitboard captureMask = gs.occupancies[Us ^ 1];
+    Bitboard quietMask = (Type == GEN_CAPTURES) ? 0 : ~gs.occupancyBoth;
+
+    if constexpr (Type == GEN_EVASIONS) {
+        // King steps first; other pieces may only capture a lone checker or block it.
+        const int kingSq = lsbSquare(kingBB);
+        addTargets(moves, gs, kingSq, KING_ATTACKS[kingSq] & ~gs.occupancies[Us]);
+
+        const Bitboard checkers = attackersTo(gs, kingSq, gs.occupancyBoth) & gs.occupancies[Us ^ 1];
+        if (checkers & (checkers - 1)) {
+            return;
+        }
+        const Bitboard block = checkers | LINES.between[kingSq][lsbSquare(checkers)];
+        captureMask &= block;
+        quietMask &= block;
+    }
+
+    const Bitboard targets = captureMask | quietMask;
+    generatePawnMoves<Us, Type>(gs, moves, captureMask, quietMask);
+    generatePieceMoves<Us, N>(gs, moves, targets);
+    generatePieceMoves<Us, B>(gs, moves, targets);
+    generatePieceMoves<Us, R>(gs, moves, targets);
+    generatePieceMoves<Us, Q>(gs, moves, targets);
+
+    if constexpr (Type != GEN_EVASIONS) {
+        if (kingBB) {
+            addTargets(moves, gs, lsbSquare(kingBB), KING_ATTACKS[lsbSquare(kingBB)] & targets);
+        }
+        if constexpr (Type == GEN_ALL) {
+            addCastlingMoves<Us>(gs, moves);
+        }
+    }
+}
+
+// The single colour dispatch per node; everything below it is specialised on the side.
+template <GenType Type>
+Move* generateMoves(const GameState& gs, Move* moves)
+{
+    if (gs.whiteToMove) {
+        generateMovesFor<WHITE, Type>(gs, moves);
+    } else {
+        generateMovesFor<BLACK, Type>(gs, moves);
+    }
+    return moves;
+}
+} // namespace
+
+CheckInfo computeCheckInfo(const GameState& gs)
+{
+    const int us = colorIndex(gs.whiteToMove);
+    const int them = us ^ 1;
+    CheckInfo ci;
+
+    const Bitboard ownKing = gs.bitboards[us][pieceIndex(K)];
+    if (ownKing) {
+        ci.kingSq = lsbSquare(ownKing);
+        ci.pinned = sliderBlockers(gs, ci.kingSq, them) & gs.occupancies[us];
+        ci.checkers = attackersTo(gs, ci.kingSq, gs.occupancyBoth) & gs.occupancies[them];
+    }
+
+    const Bitboard enemyKing = gs.bitboards[them][pieceIndex(K)];
+    if (enemyKing) {
+        const int ksq = lsbSquare(enemyKing);
+        ci.enemyKingSq = ksq;
+        ci.discoverers = sliderBlockers(gs, ksq, us) & gs.occupancies[us];
+        ci.checkSquares[P] = PAWN_ATTACKERS[us][ksq];
+        ci.checkSquares[N] = KNIGHT_ATTACKS[ksq];
+        ci.checkSquares[B] = bishopAttacks(ksq, gs.occupancyBoth, RAYS);
+        ci.checkSquares[R] = rookAttacks(ksq, gs.occupancyBoth, RAYS);
+        ci.checkSquares[Q] = ci.checkSquares[B] | ci.checkSquares[R];
+    }
+    return ci;
+}
+
+// Legality of a pseudo-legal move. Castling is fully checked by the generator, so only
+// king steps, en passant, pins and check evasions need work here.
+bool CheckInfo::isLegal(const GameState& gs, const Move& m) const
+{
+    if (kingSq < 0) {
+        return false;
+    }
+
+    const int them = colorIndex(!gs.whiteToMove);
+    const int fromSq = m.from();
+    const int toSq = m.to();
+
+    if (fromSq == kingSq) {
+        if (m.isCastle()) {
+            return true;
+        }
+        return !(attackersTo(gs, toSq, gs.occupancyBoth ^ bitAt(fromSq)) & gs.occupancies[them]);
+    }
+
+    if (m.isEnPassant()) {
+        const int capSq = squareOf(rowOf(fromSq), colOf(toSq));
+        const Bitboard occ = (gs.occupancyBoth ^ bitAt(fromSq) ^ bitAt(capSq)) | bitAt(toSq);
+        return !(attackersTo(gs, kingSq, occ) & gs.occupancies[them] & ~bitAt(capSq));
+    }
+
+    if (checkers) {
+        if (checkers & (checkers - 1)) {
+            return false;
+        }
+        const int checkerSq = lsbSquare(checkers);
+        if (!((LINES.between[kingSq][checkerSq] | checkers) & bitAt(toSq))) {
+            return false;
+        }
+    }
+
+    return !(pinned & bitAt(fromSq)) || (LINES.line[kingSq][fromSq] & bitAt(toSq));
+}
+
+bool CheckInfo::givesCheck(const GameState& gs, const Move& m) const
+{
+    if (enemyKingSq < 0) {
+        return false;
+    }
+
+    const int us = colorIndex(gs.whiteToMove);
+    const int fromSq = m.from();
+    const int toSq = m.to();
+    const Bitboard enemyKing = bitAt(enemyKingSq);
+
+    if (m.isPromotion()) {
+        // The promoted piece sees through the square the pawn just left.
+        const Bitboard occ = (gs.occupancyBoth ^ bitAt(fromSq)) | bitAt(toSq);
+        Bitboard attacks = 0;
+        switch (m.promotionType()) {
+        case N: attacks = KNIGHT_ATTACKS[toSq]; break;
+        case B: attacks = bishopAttacks(toSq, occ, RAYS); break;
+        case R: attacks = rookAttacks(toSq, occ, RAYS); break;
+        default: attacks = bishopAttacks(toSq, occ, RAYS) | rookAttacks(toSq, occ, RAYS); break;
+        }
+        if (attacks & enemyKing) {
+            return true;
+        }
+    } else if (checkSquares[gs.pieceOnSquare[fromSq] & 0x7] & bitAt(toSq)) {
+        return true;
+    }
+
+    if ((discoverers & bitAt(fromSq)) && !(LINES.line[enemyKingSq][fromSq] & bitAt(toSq))) {
+        return true;
+    }
+
+    if (m.isEnPassant()) {
+        // Removing two pawns from one rank can open a line the blocker tables never saw.
+        const int capSq = squareOf(rowOf(fromSq), colOf(toSq));
+        const Bitboard occ = (gs.occupancyBoth ^ bitAt(fromSq) ^ bitAt(capSq)) | bitAt(toSq);
+        const auto& own = gs.bitboards[us];
+        return (bishopAttacks(enemyKingSq, occ, RAYS) & (own[pieceIndex(B)] | own[pieceIndex(Q)]))
+            || (rookAttacks(enemyKingSq, occ, RAYS) & (own[pieceIndex(R)] | own[pieceIndex(Q)]));
+    }
+
+    if (m.isCastle()) {
+        const int rank = rowOf(toSq);
+        const bool kingSide = colOf(toSq) == 6;
+        const int rookFrom = squareOf(rank, kingSide ? 7 : 0);
+        const int rookTo = squareOf(rank, kingSide ? 5 : 3);
+        const Bitboard occ = (gs.occupancyBoth ^ bitAt(fromSq) ^ bitAt(rookFrom)) | bitAt(toSq) | bitAt(rookTo);
+        return (rookAttacks(rookTo, occ, RAYS) & enemyKing) != 0;
+    }
+
+    return false;
+}
+
+Move* generatePseudoLegalMoves(const GameState& gs, Move* out)
+{
+    return generateMoves<GEN_ALL>(gs, out);
+}
+
+void generatePseudoLegalMoves(const GameState& gs, MoveList& moves)
+{
+    setListEnd(moves, generatePseudoLegalMoves(gs, moves.moves.data()));
+}
+
+std::vector<Move> generatePseudoLegalMoves(const GameState& gs)
+{
+    MoveList list;
     generatePseudoLegalMoves(gs, list);
     return std::vector<Move>(list.begin(), list.end());
 }
 
+std::uint64_t keyAfter(const GameState& gs, const Move& m)
+{
+    const int fromSq = m.from();
+    const int toSq = m.to();
+    const int capSq = m.isEnPassant() ? squareOf(rowOf(fromSq), colOf(toSq)) : toSq;
+    const Piece moved = pieceAtSqImpl(gs, fromSq);
+    const Piece captured = pieceAtSqImpl(gs, capSq);
+    Piece placed = moved;
+    if (m.isPromotion()) {
+        placed.type = m.promotionType();
+    }
+
+    Bitboard key = gs.zobristKey ^ ZOBRIST.sideToMove;
+    key ^= pieceZobrist(moved, fromSq) ^ pieceZobrist(placed, toSq) ^ pieceZobrist(captured, capSq);
+
+    if (m.isCastle()) {
+        const bool kingSide = colOf(toSq) == 6;
+        const Piece rook { R, moved.white };
+        key ^= pieceZobrist(rook, squareOf(rowOf(toSq), kingSide ? 7 : 0));
+        key ^= pieceZobrist(rook, squareOf(rowOf(toSq), kingSide ? 5 : 3));
+    }
+
+    // Castling rights lost exactly as applyMoveForSide clears the moved flags.
+    const int oldCastleMask = castlingRightsMask(gs);
+    int newCastleMask = oldCastleMask;
+    if (moved.type == K) {
+        newCastleMask &= moved.white ? ~3 : ~12;
+    } else if (moved.type == R) {
+        const int backRank = moved.white ? 7 : 0;
+        if (fromSq == squareOf(backRank, 7))
+            newCastleMask &= moved.white ? ~1 : ~4;
+        if (fromSq == squareOf(backRank, 0))
+            newCastleMask &= moved.white ? ~2 : ~8;
+    }
+    if (captured.type == R) {
+        if (toSq == squareOf(0, 0))
+            newCastleMask &= ~8;
+        if (toSq == squareOf(0, 7))
+            newCastleMask &= ~4;
+        if (toSq == squareOf(7, 0))
+            newCastleMask &= ~2;
+        if (toSq == squareOf(7, 7))
+            newCastleMask &= ~1;
+    }
+    key ^= ZOBRIST.castling[oldCastleMask] ^ ZOBRIST.castling[newCastleMask];
+
+    const int oldEpSq = epSquare(gs.enPassantTarget);
+    if (oldEpSq >= 0) {
+        key ^= ZOBRIST.enPassant[oldEpSq];
+    }
+    if (moved.type == P && (toSq - fromSq == 16 || fromSq - toSq == 16)) {
+        key ^= ZOBRIST.enPassant[(fromSq + toSq) / 2];
+    }
+    return key;
+}
+
+std::uint64_t pawnKeyAfter(const GameState& gs, const Move& m)
+{
+    const int fromSq = m.from();
+    const int toSq = m.to();
+    const int capSq = m.isEnPassant() ? squareOf(rowOf(fromSq), colOf(toSq)) : toSq;
+    const Piece moved = pieceAtSqImpl(gs, fromSq);
+    const Piece captured = pieceAtSqImpl(gs, capSq);
+
+    Bitboard key = gs.pawnKey;
+    if (moved.type == P) {
+        key ^= pieceZobrist(moved, fromSq);
+        if (!m.isPromotion()) {
+            key ^= pieceZobrist(moved, toSq);
+        }
+    }
+    if (captured.type == P) {
+        key ^= pieceZobrist(captured, capSq);
+    }
+    return key;
+}
+
 void makeMove(GameState& gs, const Move& m, bool trackHistory)
+{
+    makeMove(gs, m, keyAfter(gs, m), pawnKeyAfter(gs, m), trackHistory);
+}
+
+void makeMove(GameState& gs, const Move& m, std::uint64_t childKey, std::uint64_t childPawnKey, bool trackHistory)
 {
     UndoState undo;
     undo.move = m;
@@ -790,60 +1397,20 @@ void makeMove(GameState& gs, const Move& m, bool trackHistory)
     undo.halfmoveClock = gs.halfmoveClock;
     undo.fullmoveNumber = gs.fullmoveNumber;
     undo.zobristKey = gs.zobristKey;
+    undo.pawnKey = gs.pawnKey;
 
     const int fromSq = m.from();
     const int toSq = m.to();
-    const int fromR = rowOf(fromSq);
-    const int toR = rowOf(toSq);
-    const int toC = colOf(toSq);
 
     undo.movedPiece = pieceAtSqImpl(gs, fromSq);
-    const Piece captured = m.isEnPassant() ? pieceAtSqImpl(gs, squareOf(fromR, toC)) : pieceAtSqImpl(gs, toSq);
+    const Piece captured = pieceAtSqImpl(gs, m.isEnPassant() ? squareOf(rowOf(fromSq), colOf(toSq)) : toSq);
     undo.capturedPiece = captured;
     undo.hadCapture = (captured.type != EMPTY);
 
-    Bitboard key = gs.zobristKey;
-    const int oldCastleMask = castlingRightsMask(gs);
-    const int oldEpSq = epSquare(gs.enPassantTarget);
-
-    key ^= ZOBRIST.sideToMove;
-    key ^= ZOBRIST.castling[oldCastleMask];
-    if (oldEpSq >= 0) {
-        key ^= ZOBRIST.enPassant[oldEpSq];
-    }
-
-    key ^= pieceZobrist(undo.movedPiece, fromSq);
-
-    if (m.isEnPassant()) {
-        const int capSq = squareOf(fromR, toC);
-        key ^= pieceZobrist(captured, capSq);
-    } else if (captured.type != EMPTY) {
-        key ^= pieceZobrist(captured, toSq);
-    }
-
-    Piece placedPiece = undo.movedPiece;
-    if (m.isPromotion()) {
-        placedPiece.type = m.promotionType();
-    }
-    key ^= pieceZobrist(placedPiece, toSq);
-
-    if (m.isCastle()) {
-        const int rookFrom = (toC == 6) ? squareOf(toR, 7) : squareOf(toR, 0);
-        const int rookTo = (toC == 6) ? squareOf(toR, 5) : squareOf(toR, 3);
-        const Piece rook { R, undo.movedPiece.white };
-        key ^= pieceZobrist(rook, rookFrom);
-        key ^= pieceZobrist(rook, rookTo);
-    }
-
     applyMoveNoHistory(gs, m);
 
-    const int newCastleMask = castlingRightsMask(gs);
-    key ^= ZOBRIST.castling[newCastleMask];
-    const int newEpSq = epSquare(gs.enPassantTarget);
-    if (newEpSq >= 0) {
-        key ^= ZOBRIST.enPassant[newEpSq];
-    }
-    gs.zobristKey = key;
+    gs.zobristKey = childKey;
+    gs.pawnKey = childPawnKey;
 
     if (gs.undoTop < static_cast<int>(gs.undoStack.size())) {
         gs.undoStack[gs.undoTop++] = undo;
@@ -889,6 +1456,7 @@ void undoMove(GameState& gs, bool trackHistory)
     gs.halfmoveClock = undo.halfmoveClock;
     gs.fullmoveNumber = undo.fullmoveNumber;
     gs.zobristKey = undo.zobristKey;
+    gs.pawnKey = undo.pawnKey;
 
     const Piece movedNow = pieceAtSqImpl(gs, toSq);
     removePiece(gs, toSq, movedNow);
@@ -921,23 +1489,16 @@ void undoMove(GameState& gs, bool trackHistory)
 
 }
 
+Move* generateLegalMoves(const GameState& gs, Move* out)
+{
+    const CheckInfo ci = computeCheckInfo(gs);
+    Move* last = ci.checkers ? generateMoves<GEN_EVASIONS>(gs, out) : generateMoves<GEN_ALL>(gs, out);
+    return keepLegal(gs, out, last, ci);
+}
+
 void generateLegalMoves(GameState& gs, MoveList& out)
 {
-    out.clear();
-    const bool sideToCheck = gs.whiteToMove;
-    MoveList pseudo;
-    generatePseudoLegalMoves(gs, pseudo);
-
-    for (int i = 0; i < pseudo.count; ++i) {
-        const Move& m = pseudo.moves[i];
-        makeMove(gs, m, false);
-        if (!isInCheck(gs, sideToCheck)) {
-            if (out.count < static_cast<int>(out.moves.size())) {
-                out.moves[out.count++] = m;
-            }
-        }
-        undoMove(gs, false);
-    }
+    setListEnd(out, generateLegalMoves(gs, out.moves.data()));
 }
 
 std::vector<Move> generateLegalMoves(GameState& gs)
@@ -947,6 +1508,105 @@ std::vector<Move> generateLegalMoves(GameState& gs)
     return std::vector<Move>(list.begin(), list.end());
 }
 
+Move* generateLegalTacticalMoves(const GameState& gs, Move* out)
+{
+    Move* last = generateMoves<GEN_CAPTURES>(gs, out);
+    return keepLegal(gs, out, last, computeCheckInfo(gs));
+}
+
+void generateLegalTacticalMoves(const GameState& gs, MoveList& out)
+{
+    setListEnd(out, generateLegalTacticalMoves(gs, out.moves.data()));
+}
+
+Move* generateLegalQuietChecks(const GameState& gs, Move* out)
+{
+    Move* const first = out;
+
+    const bool wtm = gs.whiteToMove;
+    const int us = colorIndex(wtm);
+    const CheckInfo ci = computeCheckInfo(gs);
+    if (ci.kingSq < 0 || ci.enemyKingSq < 0) {
+        return out;
+    }
+
+    const Bitboard empty = ~gs.occupancyBoth;
+
+    // A discovered-check candidate checks from any square off its line to the enemy king.
+    auto checkingTargets = [&](int fromSq, Bitboard targets, int pieceType) {
+        if (ci.discoverers & bitAt(fromSq)) {
+            return targets & (ci.checkSquares[pieceType] | ~LINES.line[ci.enemyKingSq][fromSq]);
+        }
+        return targets & ci.checkSquares[pieceType];
+    };
+
+    Bitboard pawns = gs.bitboards[us][pieceIndex(P)];
+    while (pawns) {
+        const int sq = lsbSquare(popLsb(pawns));
+        const int r = rowOf(sq);
+        if ((wtm && r == 1) || (!wtm && r == 6)) {
+            continue;
+        }
+
+        const int oneStep = wtm ? sq - 8 : sq + 8;
+        Bitboard pushes = empty & bitAt(oneStep);
+        if (pushes && ((wtm && r == 6) || (!wtm && r == 1))) {
+            pushes |= empty & bitAt(wtm ? sq - 16 : sq + 16);
+        }
+        Bitboard targets = checkingTargets(sq, pushes, P);
+        while (targets) {
+            addMove(out, sq, lsbSquare(popLsb(targets)));
+        }
+    }
+
+    Bitboard knights = gs.bitboards[us][pieceIndex(N)];
+    while (knights) {
+        const int sq = lsbSquare(popLsb(knights));
+        addTargets(out, gs, sq, checkingTargets(sq, KNIGHT_ATTACKS[sq] & empty, N));
+    }
+
+    Bitboard bishops = gs.bitboards[us][pieceIndex(B)];
+    while (bishops) {
+        const int sq = lsbSquare(popLsb(bishops));
+        addTargets(out, gs, sq, checkingTargets(sq, bishopAttacks(sq, gs.occupancyBoth, RAYS) & empty, B));
+    }
+
+    Bitboard rooks = gs.bitboards[us][pieceIndex(R)];
+    while (rooks) {
+        const int sq = lsbSquare(popLsb(rooks));
+        addTargets(out, gs, sq, checkingTargets(sq, rookAttacks(sq, gs.occupancyBoth, RAYS) & empty, R));
+    }
+
+    Bitboard queens = gs.bitboards[us][pieceIndex(Q)];
+    while (queens) {
+        const int sq = lsbSquare(popLsb(queens));
+        const Bitboard attacks = bishopAttacks(sq, gs.occupancyBoth, RAYS) | rookAttacks(sq, gs.occupancyBoth, RAYS);
+        addTargets(out, gs, sq, checkingTargets(sq, attacks & empty, Q));
+    }
+
+    addTargets(out, gs, ci.kingSq, checkingTargets(ci.kingSq, KING_ATTACKS[ci.kingSq] & empty, K));
+
+    std::array<Move, 2> castles;
+    Move* castlesEnd = castles.data();
+    if (wtm) {
+        addCastlingMoves<WHITE>(gs, castlesEnd);
+    } else {
+        addCastlingMoves<BLACK>(gs, castlesEnd);
+    }
+    for (const Move* m = castles.data(); m != castlesEnd; ++m) {
+        if (ci.givesCheck(gs, *m)) {
+            *out++ = *m;
+        }
+    }
+
+    return keepLegal(gs, first, out, ci);
+}
+
+void generateLegalQuietChecks(const GameState& gs, MoveList& out)
+{
+    setListEnd(out, generateLegalQuietChecks(gs, out.moves.data()));
+}
+
 bool hasSufficientMaterial(const GameState& gs)
 {
     const Bitboard wP = gs.bitboards[WHITE][pieceIndex(P)];
@@ -996,43 +1656,30 @@ bool hasSufficientMaterial(const GameState& gs)
 
 std::string boardToString(const GameState& gs)
 {
-    std::stringstream ss;
+    std::string out;
+    out.reserve(72);
     for (int sq = 0; sq < 64; ++sq) {
-        const Piece p = pieceAtSqImpl(gs, sq);
-        if (p.type == EMPTY) {
-            ss << '.';
-        } else {
-            char ch = '?';
-            switch (p.type) {
-            case P: ch = 'p'; break;
-            case N: ch = 'n'; break;
-            case B: ch = 'b'; break;
-            case R: ch = 'r'; break;
-            case Q: ch = 'q'; break;
-            case K: ch = 'k'; break;
-            }
-            ss << (p.white ? static_cast<char>(std::toupper(ch)) : ch);
-        }
+        const std::uint8_t code = gs.pieceOnSquare[sq];
+        out.push_back(code == 0 ? '.' : FEN_PIECE_CHARS[code]);
     }
 
     // Repetition identity must include side-to-move, castling rights, and en-passant target.
-    ss << ' ' << (gs.whiteToMove ? 'w' : 'b');
-
-    std::string castling;
-    if (!gs.wkMoved && !gs.wrHHMoved) castling.push_back('K');
-    if (!gs.wkMoved && !gs.wrAHMoved) castling.push_back('Q');
-    if (!gs.bkMoved && !gs.brHHMoved) castling.push_back('k');
-    if (!gs.bkMoved && !gs.brAHMoved) castling.push_back('q');
-    if (castling.empty()) castling = "-";
-    ss << ' ' << castling;
-
-    if (gs.enPassantTarget.has_value()) {
-        ss << ' ' << static_cast<char>('a' + gs.enPassantTarget->second);
-    } else {
-        ss << " -";
+    out.push_back(' ');
+    out.push_back(gs.whiteToMove ? 'w' : 'b');
+    out.push_back(' ');
+    const int rights = castlingRightsMask(gs);
+    if (rights == 0) {
+        out.push_back('-');
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (rights & (1 << i)) {
+            out.push_back("KQkq"[i]);
+        }
     }
 
-    return ss.str();
+    out.push_back(' ');
+    out.push_back(gs.enPassantTarget.has_value() ? static_cast<char>('a' + gs.enPassantTarget->second) : '-');
+    return out;
 }
 
 std::uint64_t positionHash(const GameState& gs)
@@ -1045,6 +1692,238 @@ std::uint64_t recomputePositionHash(const GameState& gs)
     return computeZobristFromState(gs);
 }
 
+Move unpackMove(const GameState& gs, std::uint16_t packed)
+{
+    const int fromSq = packed & 0x3F;
+    const int toSq = (packed >> 6) & 0x3F;
+    const int kind = packed >> 14;
+
+    Move m(static_cast<std::uint8_t>(fromSq), static_cast<std::uint8_t>(toSq));
+    if (kind == Move::PACKED_CASTLE) {
+        m.addFlags(Move::FLAG_CASTLE);
+        return m;
+    }
+    if (kind == Move::PACKED_EN_PASSANT) {
+        m.setCapturedType(P);
+        m.addFlags(Move::FLAG_CAPTURE | Move::FLAG_EN_PASSANT);
+        return m;
+    }
+    if (kind == Move::PACKED_PROMOTION) {
+        m.setPromotionType(static_cast<std::uint8_t>(N + ((packed >> 12) & 0x3)));
+        m.addFlags(Move::FLAG_PROMOTION);
+    }
+    const Piece captured = pieceAtSqImpl(gs, toSq);
+    if (captured.type != EMPTY) {
+        m.setCapturedType(captured.type);
+        m.addFlags(Move::FLAG_CAPTURE);
+    }
+    return m;
+}
+
+// SAN is resolved from the destination square backwards: the attack tables give the own
+// pieces of the named type that reach it, the disambiguation narrows them, and only those
+// candidates are checked for legality. Castling goes through the generator, which already
+// knows about rights and attacked transit squares.
+bool parseSanMove(const GameState& gs, std::string_view san, Move& out)
+{
+    while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?')) {
+        san.remove_suffix(1);
+    }
+    if (san.size() < 2) {
+        return false;
+    }
+
+    if (san[0] == 'O' || san[0] == '0') {
+        const bool queenSide = san.size() >= 5;
+        Move legal[MAX_MOVES];
+        Move* const end = generateLegalMoves(gs, legal);
+        for (Move* m = legal; m != end; ++m) {
+            if (m->isCastle() && (colOf(m->to()) == 2) == queenSide) {
+                out = *m;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::uint8_t piece = P;
+    size_t i = 0;
+    switch (san[0]) {
+        case 'N': piece = N; ++i; break;
+        case 'B': piece = B; ++i; break;
+        case 'R': piece = R; ++i; break;
+        case 'Q': piece = Q; ++i; break;
+        case 'K': piece = K; ++i; break;
+        default: break;
+    }
+
+    std::uint8_t promo = EMPTY;
+    const auto promoOf = [](char c) -> std::uint8_t {
+        switch (std::toupper(static_cast<unsigned char>(c))) {
+            case 'N': return N;
+            case 'B': return B;
+            case 'R': return R;
+            case 'Q': return Q;
+            default: return EMPTY;
+        }
+    };
+    if (piece == P && !std::isdigit(static_cast<unsigned char>(san.back()))) {
+        promo = promoOf(san.back());
+        if (promo == EMPTY) {
+            return false;
+        }
+        san.remove_suffix(1);
+        if (!san.empty() && san.back() == '=') {
+            san.remove_suffix(1);
+        }
+    }
+    if (san.size() < i + 2) {
+        return false;
+    }
+
+    const char toFile = san[san.size() - 2];
+    const char toRank = san[san.size() - 1];
+    if (toFile < 'a' || toFile > 'h' || toRank < '1' || toRank > '8') {
+        return false;
+    }
+    const int toSq = squareOf('8' - toRank, toFile - 'a');
+
+    Bitboard fromMask = ~0ULL;
+    for (size_t k = i; k + 2 < san.size(); ++k) {
+        const char c = san[k];
+        if (c >= 'a' && c <= 'h') {
+            fromMask &= FILE_A_BB << (c - 'a');
+        } else if (c >= '1' && c <= '8') {
+            fromMask &= rankBB('8' - c);
+        } else if (c != 'x' && c != '-') {
+            return false;
+        }
+    }
+
+    const int us = colorIndex(gs.whiteToMove);
+    const Bitboard own = gs.bitboards[us][pieceIndex(piece)];
+    const Bitboard occ = gs.occupancyBoth;
+    if (gs.occupancies[us] & bitAt(toSq)) {
+        return false;
+    }
+    const std::uint8_t capturedType = pieceAtSqImpl(gs, toSq).type;
+    const int epSq = epSquare(gs.enPassantTarget);
+
+    Bitboard candidates = 0;
+    switch (piece) {
+        case N: candidates = KNIGHT_ATTACKS[toSq]; break;
+        case B: candidates = bishopAttacks(toSq, occ, RAYS); break;
+        case R: candidates = rookAttacks(toSq, occ, RAYS); break;
+        case Q: candidates = bishopAttacks(toSq, occ, RAYS) | rookAttacks(toSq, occ, RAYS); break;
+        case K: candidates = KING_ATTACKS[toSq]; break;
+        default: {
+            if (capturedType != EMPTY || toSq == epSq) {
+                candidates = PAWN_ATTACKERS[us][toSq];
+            } else {
+                // Pushes: one square back, or two from the start rank through an empty square.
+                const int back = gs.whiteToMove ? 8 : -8;
+                const int one = toSq + back;
+                if (one >= 0 && one < 64) {
+                    candidates = bitAt(one);
+                    const int startRow = gs.whiteToMove ? 6 : 1;
+                    const int two = one + back;
+                    if (!(occ & bitAt(one)) && two >= 0 && two < 64 && rowOf(two) == startRow) {
+                        candidates = bitAt(two);
+                    }
+                }
+            }
+            const int lastRow = gs.whiteToMove ? 0 : 7;
+            if ((rowOf(toSq) == lastRow) != (promo != EMPTY)) {
+                return false;
+            }
+            break;
+        }
+    }
+    candidates &= own & fromMask;
+    if (!candidates) {
+        return false;
+    }
+
+    const CheckInfo ci = computeCheckInfo(gs);
+    int matches = 0;
+    while (candidates) {
+        const int fromSq = lsbSquare(popLsb(candidates));
+        Move m(static_cast<std::uint8_t>(fromSq), static_cast<std::uint8_t>(toSq));
+        if (capturedType != EMPTY) {
+            m.setCapturedType(capturedType);
+            m.addFlags(Move::FLAG_CAPTURE);
+        } else if (piece == P && toSq == epSq) {
+            m.setCapturedType(P);
+            m.addFlags(Move::FLAG_CAPTURE | Move::FLAG_EN_PASSANT);
+        }
+        if (promo != EMPTY) {
+            m.setPromotionType(promo);
+            m.addFlags(Move::FLAG_PROMOTION);
+        }
+        if (ci.isLegal(gs, m)) {
+            out = m;
+            ++matches;
+        }
+    }
+    return matches == 1;
+}
+
+std::string moveToSan(const GameState& gs, const Move& m)
+{
+    std::string san;
+    if (m.isCastle()) {
+        san = colOf(m.to()) == 2 ? "O-O-O" : "O-O";
+    } else {
+        const std::uint8_t piece = pieceAtSqImpl(gs, m.from()).type;
+        const auto fileChar = [](int sq) { return static_cast<char>('a' + colOf(sq)); };
+        const auto rankChar = [](int sq) { return static_cast<char>('8' - rowOf(sq)); };
+        if (piece == P) {
+            if (m.isCapture()) {
+                san += fileChar(m.from());
+            }
+        } else {
+            san += "PNBRQK"[piece - P];
+            // Disambiguate by file, then rank, then both, as the other candidates require.
+            Move legal[MAX_MOVES];
+            Move* const end = generateLegalMoves(gs, legal);
+            bool ambiguous = false, sameFile = false, sameRank = false;
+            for (Move* o = legal; o != end; ++o) {
+                if (o->to() != m.to() || o->from() == m.from() || pieceAtSqImpl(gs, o->from()).type != piece) continue;
+                ambiguous = true;
+                sameFile |= colOf(o->from()) == colOf(m.from());
+                sameRank |= rowOf(o->from()) == rowOf(m.from());
+            }
+            if (ambiguous) {
+                if (!sameFile) {
+                    san += fileChar(m.from());
+                } else if (!sameRank) {
+                    san += rankChar(m.from());
+                } else {
+                    san += fileChar(m.from());
+                    san += rankChar(m.from());
+                }
+            }
+        }
+        if (m.isCapture()) {
+            san += 'x';
+        }
+        san += fileChar(m.to());
+        san += rankChar(m.to());
+        if (m.isPromotion()) {
+            san += '=';
+            san += "PNBRQK"[m.promotionType() - P];
+        }
+    }
+
+    GameState after = gs;
+    makeMove(after, m, false);
+    if (isInCheck(after, after.whiteToMove)) {
+        Move reply[MAX_MOVES];
+        san += generateLegalMoves(after, reply) == reply ? '#' : '+';
+    }
+    return san;
+}
+
 std::optional<std::string> checkGameOver(GameState& gs)
 {
     auto legalMoves = generateLegalMoves(gs);
@@ -1,23 +1,44 @@
 #include "../include/engine.hpp"
 #include "../include/chess.hpp"
+#include "../include/mapped_file.hpp"
+#include "../include/pgn.hpp"
+#include "../include/polyglot_random.hpp"
 #include <algorithm>
 #include <array>
 #include <cassert>
 #include <chrono>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <memory>
 #include <optional>
 #include <random>
+#include <sstream>
 #include <string>
 #include <atomic>
 #include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 static constexpr int INF         =  1000000000;
 static constexpr int MATE_SCORE  =  1000000;
 static constexpr int DRAW_SCORE  =  0;
@@ -51,12 +72,25 @@ inline bool isValidMove(const Move& m)
 static constexpr int MAX_PLY     = 64;   
 static constexpr int MAX_KILLERS = 2; 
 static constexpr int PV_MAX_PLY  = 256;
+static constexpr int MAX_MULTI_PV = 64;
+static constexpr int MOVE_ARENA_SIZE = 512 * MAX_MOVES;   // one full list per undo-stack ply
+
+#if ENGINE_SEARCH_STATS
+#define SEARCH_STAT(field) (++ss.counters.field)
+#else
+#define SEARCH_STAT(field) ((void)0)
+#endif
 
 static std::atomic<bool> g_stopRequested { false };
+static std::atomic<bool> g_ponderActive { false };
+static std::atomic<int> g_ponderHitLimitMs { -1 };
+static std::atomic<long long> g_ponderHitAtNs { 0 };
 static bool g_searchInfoOutputEnabled = true;
+static std::function<void(const std::string&)> g_searchInfoSink;
 static EngineTuningParams g_tuningParams {};
 static std::string g_syzygyPath;
 static int g_syzygyProbeLimit = 6;
+static int g_multiPv = 1;
 
 #if defined(__has_include)
 #if __has_include("fathom/tbprobe.h")
@@ -207,37 +241,321 @@ static int hangingPieceScore(const GameState& gs)
     return blackDanger - whiteDanger;
 }
 
-static bool isPassedPawnAt(const GameState& gs, int sq, bool white)
+// Pawn structure is evaluated set-wise. Squares run a8 = 0 .. h1 = 63, so white pawns
+// advance towards lower indices (>> 8) and black pawns towards higher ones (<< 8).
+static constexpr uint64_t FILE_A_BB = 0x0101010101010101ULL;
+static constexpr uint64_t FILE_H_BB = FILE_A_BB << 7;
+
+// Kogge-Stone style file fills: every square on the file towards rank 8 / rank 1.
+static constexpr uint64_t fillTowardsRank8(uint64_t b)
 {
-    const uint64_t enemyPawns = gs.bitboards[white ? 1 : 0][P - 1];
-    const int r = rowOfSq(sq);
-    const int c = colOfSq(sq);
+    b |= b >> 8;
+    b |= b >> 16;
+    b |= b >> 32;
+    return b;
+}
 
-    if (white) {
-        for (int rr = r - 1; rr >= 0; --rr) {
-            for (int cc = std::max(0, c - 1); cc <= std::min(7, c + 1); ++cc) {
-                if (enemyPawns & (1ULL << (rr * 8 + cc))) {
-                    return false;
-                }
-            }
+static constexpr uint64_t fillTowardsRank1(uint64_t b)
+{
+    b |= b << 8;
+    b |= b << 16;
+    b |= b << 32;
+    return b;
+}
+
+static constexpr uint64_t shiftEast(uint64_t b) { return (b << 1) & ~FILE_A_BB; }
+static constexpr uint64_t shiftWest(uint64_t b) { return (b >> 1) & ~FILE_H_BB; }
+
+static constexpr uint64_t pawnFrontSpans(uint64_t pawns, bool white)
+{
+    return white ? fillTowardsRank8(pawns >> 8) : fillTowardsRank1(pawns << 8);
+}
+
+static constexpr uint64_t pawnAttackSet(uint64_t pawns, bool white)
+{
+    const uint64_t pushed = white ? (pawns >> 8) : (pawns << 8);
+    return shiftEast(pushed) | shiftWest(pushed);
+}
+
+// Pawn-shield squares one and two ranks in front of a king (own side's direction) on the
+// king file and both neighbours; files[] holds those files as a file bitmask.
+struct KingShelterMasks {
+    std::array<std::array<uint64_t, 64>, 2> front1{};
+    std::array<std::array<uint64_t, 64>, 2> front2{};
+    std::array<uint8_t, 8> files{};
+};
+
+static constexpr KingShelterMasks KING_SHELTER_MASKS = [] {
+    KingShelterMasks m{};
+    for (int c = 0; c < 8; ++c) {
+        const unsigned f = 1u << c;
+        m.files[c] = static_cast<uint8_t>(f | ((f << 1) & 0xFF) | (f >> 1));
+    }
+    for (int side = 0; side < 2; ++side) {
+        for (int sq = 0; sq < 64; ++sq) {
+            const uint64_t king = 1ULL << sq;
+            const uint64_t around = king | shiftEast(king) | shiftWest(king);
+            m.front1[side][sq] = side == 0 ? (around >> 8) : (around << 8);
+            m.front2[side][sq] = side == 0 ? (around >> 16) : (around << 16);
         }
-    } else {
-        for (int rr = r + 1; rr < 8; ++rr) {
-            for (int cc = std::max(0, c - 1); cc <= std::min(7, c + 1); ++cc) {
-                if (enemyPawns & (1ULL << (rr * 8 + cc))) {
-                    return false;
-                }
-            }
+    }
+    return m;
+}();
+
+// Large tables (TT, pawn cache, net weights) are backed by huge pages where the OS allows it:
+// explicit hugetlb pages first, then transparent huge pages via madvise, then plain pages.
+enum class PageMode : uint8_t { Normal, Transparent, HugeTlb };
+
+static const char* pageModeName(PageMode mode)
+{
+    switch (mode) {
+        case PageMode::HugeTlb: return "hugetlb";
+        case PageMode::Transparent: return "thp";
+        default: return "normal";
+    }
+}
+
+static constexpr size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+struct PageAllocation {
+    void* ptr = nullptr;
+    size_t bytes = 0;
+    PageMode mode = PageMode::Normal;
+    bool mapped = false;
+};
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+static bool transparentHugePagesAvailable()
+{
+    static const bool available = [] {
+        std::ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string line;
+        return std::getline(in, line) && line.find("[never]") == std::string::npos;
+    }();
+    return available;
+}
+#endif
+
+// A shared allocation stays shared with processes forked after it is made (server workers);
+// it uses hugetlbfs pages when available and normal pages otherwise.
+static PageAllocation allocatePages(size_t bytes, bool shared = false)
+{
+    PageAllocation a;
+#if defined(__linux__)
+    const size_t rounded = (bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+    if (shared) {
+        void* p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            return { p, rounded, PageMode::HugeTlb, true };
+        }
+        p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            return { p, rounded, PageMode::Normal, true };
+        }
+    }
+    void* p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        return { p, rounded, PageMode::HugeTlb, true };
+    }
+
+    // THP only backs 2 MB aligned ranges, so over-map by one huge page and trim both ends.
+    const size_t span = rounded + HUGE_PAGE_BYTES;
+    p = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED) {
+        char* raw = static_cast<char*>(p);
+        const uintptr_t addr = reinterpret_cast<uintptr_t>(raw);
+        char* aligned = raw + (((addr + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1)) - addr);
+        const size_t head = static_cast<size_t>(aligned - raw);
+        const size_t tail = span - head - rounded;
+        if (head) munmap(raw, head);
+        if (tail) munmap(aligned + rounded, tail);
+
+        PageMode mode = PageMode::Normal;
+#if defined(MADV_HUGEPAGE)
+        if (transparentHugePagesAvailable() && madvise(aligned, rounded, MADV_HUGEPAGE) == 0) {
+            mode = PageMode::Transparent;
         }
+#endif
+        return { aligned, rounded, mode, true };
     }
+#endif
+    a.ptr = ::operator new(bytes, std::align_val_t{ 64 });
+    a.bytes = bytes;
+    return a;
+}
 
-    return true;
+static void freePages(PageAllocation& a)
+{
+    if (!a.ptr) return;
+#if defined(__linux__)
+    if (a.mapped) {
+        munmap(a.ptr, a.bytes);
+        a = {};
+        return;
+    }
+#endif
+    ::operator delete(a.ptr, std::align_val_t{ 64 });
+    a = {};
+}
+
+// Fills with one thread per 64 MB (up to the core count): first touch of a multi-GB table
+// is dominated by page faults, which scale across cores.
+template <typename T>
+static void parallelFill(T* first, size_t count, const T& value)
+{
+    const size_t bytes = count * sizeof(T);
+    const size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    const size_t threads = std::clamp<size_t>(bytes / (64ULL * 1024 * 1024), 1, hw);
+    if (threads == 1) {
+        std::fill(first, first + count, value);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    const size_t chunk = (count + threads - 1) / threads;
+    for (size_t t = 0; t < threads; ++t) {
+        const size_t begin = std::min(count, t * chunk);
+        const size_t end = std::min(count, begin + chunk);
+        workers.emplace_back([=] { std::fill(first + begin, first + end, value); });
+    }
+    for (std::thread& w : workers) {
+        w.join();
+    }
 }
 
-static int sidePasserEndgamePressure(const GameState& gs, bool white)
+// Fixed-size array on huge-page backed memory; elements are value-initialised on reset().
+template <typename T>
+class LargePageArray {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+
+public:
+    LargePageArray() = default;
+    explicit LargePageArray(size_t count) { reset(count); }
+    ~LargePageArray() { freePages(alloc_); }
+    LargePageArray(const LargePageArray&) = delete;
+    LargePageArray& operator=(const LargePageArray&) = delete;
+
+    void reset(size_t count, bool shared = false)
+    {
+        // Release first so a resize never holds both tables at once.
+        freePages(alloc_);
+        count_ = 0;
+        alloc_ = allocatePages(std::max<size_t>(1, count) * sizeof(T), shared);
+        count_ = count;
+        fill(T{});
+    }
+
+    void fill(const T& value) { parallelFill(data(), count_, value); }
+
+    T* data() { return static_cast<T*>(alloc_.ptr); }
+    const T* data() const { return static_cast<const T*>(alloc_.ptr); }
+    T& operator[](size_t i) { return data()[i]; }
+    const T& operator[](size_t i) const { return data()[i]; }
+    size_t size() const { return count_; }
+    PageMode mode() const { return alloc_.mode; }
+
+private:
+    PageAllocation alloc_;
+    size_t count_ = 0;
+};
+
+// Everything here depends only on the pawns, except the king shelter, which is cached for
+// the king square it was last computed for.
+struct PawnEvalEntry {
+    uint64_t key = 0;
+    uint64_t passed[2] = { 0, 0 };
+    uint64_t attackSpan[2] = { 0, 0 };   // squares the side's pawns attack now or after advancing
+    int pawnStructure = 0;
+    uint8_t files[2] = { 0, 0 };
+    int8_t shelterKingSq[2] = { -1, -1 };
+    int16_t shelterPenalty[2] = { 0, 0 };
+
+    uint8_t openFiles() const { return static_cast<uint8_t>(~(files[0] | files[1])); }
+    uint8_t halfOpenFiles(int side) const { return static_cast<uint8_t>(~files[side]); }
+};
+
+static constexpr size_t PAWN_EVAL_SIZE = 1 << 16;
+
+struct PawnEvalCache {
+    LargePageArray<PawnEvalEntry> table;   // allocated by ensureSearchTablesReady()
+
+    void ensureAllocated()
+    {
+        if (table.size() == 0) {
+            table.reset(PAWN_EVAL_SIZE);
+        }
+    }
+
+    static uint64_t makeKey(const GameState& gs)
+    {
+        // gs.pawnKey is maintained incrementally by makeMove; 0 marks an empty slot.
+        return gs.pawnKey ? gs.pawnKey : 1;
+    }
+
+    PawnEvalEntry& slot(uint64_t key)
+    {
+        return table[key & (PAWN_EVAL_SIZE - 1)];
+    }
+
+    void prefetch(uint64_t pawnKey) const
+    {
+        __builtin_prefetch(&table[(pawnKey ? pawnKey : 1) & (PAWN_EVAL_SIZE - 1)]);
+    }
+} static pawnEvalCache;
+
+static void computePawnEntry(const GameState& gs, PawnEvalEntry& e)
+{
+    int sideScore[2] = { 0, 0 };
+
+    for (int side = 0; side < 2; ++side) {
+        const bool white = side == 0;
+        const uint64_t own = gs.bitboards[side][P - 1];
+        const uint64_t enemy = gs.bitboards[side ^ 1][P - 1];
+
+        const uint64_t enemySpans = pawnFrontSpans(enemy, !white);
+        e.passed[side] = own & ~(enemySpans | shiftEast(enemySpans) | shiftWest(enemySpans));
+        const uint64_t attacks = pawnAttackSet(own, white);
+        e.attackSpan[side] = white ? fillTowardsRank8(attacks) : fillTowardsRank1(attacks);
+        e.files[side] = static_cast<uint8_t>(fillTowardsRank8(own) & 0xFF);
+        e.shelterKingSq[side] = -1;
+
+        const unsigned files = e.files[side];
+        const int islands = popcount64(files & ~(files << 1));
+        const int isolatedFiles = popcount64(files & ~((files << 1) | (files >> 1)));
+        const int doubled = popcount64(own & pawnFrontSpans(own, white));
+
+        int score = -std::max(0, islands - 1) * 8;
+        score -= doubled * 24;
+        score -= isolatedFiles * 20;
+
+        uint64_t passed = e.passed[side];
+        while (passed) {
+            const int r = rowOfSq(lsbSquare64(popLsb64(passed)));
+            const int rank = white ? (7 - r) : r;
+            score += 8 + rank * rank * 2;
+        }
+        sideScore[side] = score;
+    }
+
+    e.pawnStructure = sideScore[0] - sideScore[1];
+}
+
+static PawnEvalEntry& pawnEntry(const GameState& gs)
+{
+    const uint64_t key = PawnEvalCache::makeKey(gs);
+    PawnEvalEntry& e = pawnEvalCache.slot(key);
+    if (e.key != key) {
+        computePawnEntry(gs, e);
+        e.key = key;
+    }
+    return e;
+}
+
+static int sidePasserEndgamePressure(const GameState& gs, const PawnEvalEntry& pawnInfo, bool white)
 {
     int pressure = 0;
-    uint64_t pawns = gs.bitboards[white ? 0 : 1][P - 1];
+    uint64_t pawns = pawnInfo.passed[white ? 0 : 1];
 
     const int ownKingSq = lsbSquare64(gs.bitboards[white ? 0 : 1][K - 1]);
     const int enemyKingSq = lsbSquare64(gs.bitboards[white ? 1 : 0][K - 1]);
@@ -248,10 +566,6 @@ static int sidePasserEndgamePressure(const GameState& gs, bool white)
 
     while (pawns) {
         const int sq = lsbSquare64(popLsb64(pawns));
-        if (!isPassedPawnAt(gs, sq, white)) {
-            continue;
-        }
-
         const int r = rowOfSq(sq);
         const int c = colOfSq(sq);
         const int advance = white ? (7 - r) : r;
@@ -293,7 +607,7 @@ static int sidePasserEndgamePressure(const GameState& gs, bool white)
     return pressure;
 }
 
-static int sideEndgamePawnPlanScore(const GameState& gs, bool white)
+static int sideEndgamePawnPlanScore(const GameState& gs, const PawnEvalEntry& pawnInfo, bool white)
 {
     int score = 0;
     const int side = white ? 0 : 1;
@@ -306,13 +620,9 @@ static int sideEndgamePawnPlanScore(const GameState& gs, bool white)
     const int enemyKr = rowOfSq(enemyKingSq);
     const int enemyKc = colOfSq(enemyKingSq);
 
-    uint64_t ownPawns = gs.bitboards[side][P - 1];
-    while (ownPawns) {
-        const int sq = lsbSquare64(popLsb64(ownPawns));
-        if (!isPassedPawnAt(gs, sq, white)) {
-            continue;
-        }
-
+    uint64_t ownPassers = pawnInfo.passed[side];
+    while (ownPassers) {
+        const int sq = lsbSquare64(popLsb64(ownPassers));
         const int r = rowOfSq(sq);
         const int c = colOfSq(sq);
         const int advance = white ? (7 - r) : r;
@@ -344,13 +654,9 @@ static int sideEndgamePawnPlanScore(const GameState& gs, bool white)
         score += std::max(0, p);
     }
 
-    uint64_t enemyPawns = gs.bitboards[enemy][P - 1];
-    while (enemyPawns) {
-        const int sq = lsbSquare64(popLsb64(enemyPawns));
-        if (!isPassedPawnAt(gs, sq, !white)) {
-            continue;
-        }
-
+    uint64_t enemyPassers = pawnInfo.passed[enemy];
+    while (enemyPassers) {
+        const int sq = lsbSquare64(popLsb64(enemyPassers));
         const int r = rowOfSq(sq);
         const int c = colOfSq(sq);
         const int enemyAdvance = white ? r : (7 - r);
@@ -388,27 +694,84 @@ uint64_t computeHash(const GameState& gs)
 
 enum TTFlag : uint8_t { TT_EXACT, TT_LOWER, TT_UPPER };
 
+// A probed entry, copied out of the table: the best move is kept in packed form and restored
+// against the probing position.
 struct TTEntry {
-    uint64_t hash    = 0;
-    int      score   = 0;
-    int      depth   = -1;
-    TTFlag   flag    = TT_EXACT;
-    Move     bestMove = invalidMove();
+    uint64_t hash     = 0;
+    int32_t  score    = 0;
+    int8_t   depth    = -1;
+    TTFlag   flag     = TT_EXACT;
+    uint16_t bestMove = 0;
+
+    Move move(const GameState& gs) const { return bestMove ? unpackMove(gs, bestMove) : invalidMove(); }
+};
+
+// 16 bytes as stored: score, depth, flag and move packed into `data`, and the position key
+// XORed with it. Forked server workers write one shared table without locks, so a slot can
+// be read half-written; such a slot fails the key check and counts as a miss.
+struct TTSlot {
+    uint64_t check = 0;
+    uint64_t data  = 0;
+
+    static uint64_t pack(const TTEntry& e) {
+        return static_cast<uint32_t>(e.score)
+            | static_cast<uint64_t>(static_cast<uint8_t>(e.depth)) << 32
+            | static_cast<uint64_t>(e.flag) << 40
+            | static_cast<uint64_t>(e.bestMove) << 48;
+    }
+
+    TTEntry load() const {
+        const uint64_t d = __atomic_load_n(&data, __ATOMIC_RELAXED);
+        const uint64_t c = __atomic_load_n(&check, __ATOMIC_RELAXED);
+        TTEntry e;
+        e.hash = c ^ d;
+        e.score = static_cast<int32_t>(static_cast<uint32_t>(d));
+        e.depth = static_cast<int8_t>(static_cast<uint8_t>(d >> 32));
+        e.flag = static_cast<TTFlag>(static_cast<uint8_t>(d >> 40));
+        e.bestMove = static_cast<uint16_t>(d >> 48);
+        return e;
+    }
+
+    void save(const TTEntry& e) {
+        const uint64_t d = pack(e);
+        __atomic_store_n(&check, e.hash ^ d, __ATOMIC_RELAXED);
+        __atomic_store_n(&data, d, __ATOMIC_RELAXED);
+    }
 };
 
 struct TranspositionTable {
-    std::vector<TTEntry> table;
+    LargePageArray<TTSlot> table;
     size_t mask = 0;
     int hashMb = DEFAULT_HASH_MB;
+    bool shared = false;   // mapped so forked server workers use the same table
+
+    // The table is allocated on first use (ensureAllocated); until then a resize only records
+    // the size, so startup and `setoption Hash` before the first isready cost nothing.
+    void resizeMb(int mb) {
+        hashMb = std::clamp(mb, 1, 2048);
+        if (table.size() > 0) {
+            allocate();
+        }
+    }
 
-    TranspositionTable() {
-        resizeMb(DEFAULT_HASH_MB);
+    void ensureAllocated() {
+        if (table.size() == 0) {
+            allocate();
+        }
     }
 
-    void resizeMb(int mb) {
-        mb = std::clamp(mb, 1, 2048);
-        const size_t bytes = static_cast<size_t>(mb) * 1024ULL * 1024ULL;
-        const size_t entryBytes = sizeof(TTEntry);
+    void setShared(bool s) {
+        if (s != shared) {
+            shared = s;
+            if (table.size() > 0) {
+                table.reset(table.size(), shared);
+            }
+        }
+    }
+
+    void allocate() {
+        const size_t bytes = static_cast<size_t>(hashMb) * 1024ULL * 1024ULL;
+        const size_t entryBytes = sizeof(TTSlot);
         size_t targetEntries = bytes / std::max<size_t>(1, entryBytes);
 
         size_t pow2 = 1;
@@ -419,22 +782,33 @@ struct TranspositionTable {
             pow2 = 1024;
         }
 
-        table.assign(pow2, TTEntry{});
+        if (table.size() == pow2) {
+            clear();
+        } else {
+            table.reset(pow2, shared);
+        }
         mask = pow2 - 1;
-        hashMb = mb;
     }
 
-    TTEntry* probe(uint64_t hash) {
-        TTEntry* e = &table[hash & mask];
-        return (e->hash == hash) ? e : nullptr;
+    void prefetch(uint64_t hash) const { __builtin_prefetch(&table[hash & mask]); }
+
+    std::optional<TTEntry> probe(uint64_t hash) const {
+        const TTEntry e = table[hash & mask].load();
+        if (e.hash != hash) {
+            return std::nullopt;
+        }
+        return e;
     }
 
     void store(uint64_t hash, int score, int depth, TTFlag flag, const Move& best) {
-        TTEntry& e = table[hash & mask];
+        TTSlot& slot = table[hash & mask];
+        const TTEntry e = slot.load();
+        const int8_t storedDepth = static_cast<int8_t>(std::clamp(depth, -1, 127));
+        const uint16_t packedBest = isValidMove(best) ? best.packed() : 0;
         // Always replace same-position entries when depth is not worse.
         if (e.hash == hash) {
-            if (depth > e.depth || flag == TT_EXACT || e.bestMove.value == 0xFFFFFFFFu) {
-                e = { hash, score, depth, flag, best };
+            if (depth > e.depth || flag == TT_EXACT || e.bestMove == 0) {
+                slot.save({ hash, score, storedDepth, flag, packedBest });
             }
             return;
         }
@@ -444,17 +818,17 @@ struct TranspositionTable {
             return;
         }
 
-        e = { hash, score, depth, flag, best };
+        slot.save({ hash, score, storedDepth, flag, packedBest });
     }
 
-    void clear() { std::fill(table.begin(), table.end(), TTEntry{}); }
+    void clear() { table.fill(TTSlot{}); }
 } static tt;
 
 
 
 struct SearchState {
-    Move killers[MAX_PLY][MAX_KILLERS];
-    Move counterMoves[2][64][64];
+    uint16_t killers[MAX_PLY][MAX_KILLERS];   // Move::packed(), 0 = empty
+    uint16_t counterMoves[2][64][64];
     std::array<int16_t, 2 * 64 * 64 * 64> continuation{};
     int  history[2][8][8][8][8]; 
     std::array<Move, 1024> pathMoves{};
@@ -462,33 +836,70 @@ struct SearchState {
     std::array<int, PV_MAX_PLY> pvLength{};
     std::array<uint64_t, 1024> hashHistory{};
     int hashCount = 0;
-    int  nodes = 0;
+    std::uint64_t nodes = 0;
     std::array<int, 1024> evalCoreNoKingStack{};
     int evalPly = 0;
     bool evalActive = false;
     bool stopped = false;
     std::chrono::steady_clock::time_point startTime;
     int  timeLimitMs = 5000;
+    std::uint64_t nodeLimit = 0;
+    SearchCounters counters{};
+    unsigned searchesSinceContinuationAge = 0;
+    std::array<Move, MOVE_ARENA_SIZE> moveArena{};
+    int moveArenaTop = 0;
+
+    SearchState() { clearHistory(); }
 
-    void clear() {
+    // Per-search reset. Move-ordering tables survive between searches and are aged instead;
+    // only clearHistory() (ucinewgame) wipes them.
+    void beginSearch() {
         nodes = 0;
+        counters = SearchCounters {};
         hashCount = 0;
+        moveArenaTop = 0;
         evalPly = 0;
         evalActive = false;
         stopped = false;
+        for (auto& m : pathMoves)
+            m = invalidMove();
+        pvLength.fill(0);
+        ageHistory();
+    }
+
+    // The next root is usually two plies deeper, so killers shift down by two plies. Butterfly
+    // history loses a quarter per search; the 512 KB continuation table is halved every
+    // fourth search so aging never costs a full pass per move.
+    void ageHistory() {
+        for (int ply = 0; ply + 2 < MAX_PLY; ++ply)
+            for (int k = 0; k < MAX_KILLERS; ++k)
+                killers[ply][k] = killers[ply + 2][k];
+        for (int ply = MAX_PLY - 2; ply < MAX_PLY; ++ply)
+            for (auto& k : killers[ply])
+                k = 0;
+        if ((++searchesSinceContinuationAge & 3) == 0) {
+            for (auto& v : continuation)
+                v = static_cast<int16_t>(v / 2);
+        }
+        for (auto& a : history)
+            for (auto& b : a)
+                for (auto& c : b)
+                    for (auto& d : c)
+                        for (auto& e : d)
+                            e -= e / 4;
+    }
+
+    void clearHistory() {
         for (auto& ply : killers)
             for (auto& k : ply)
-                k = invalidMove();
+                k = 0;
         for (auto& side : counterMoves)
             for (auto& from : side)
                 for (auto& to : from)
-                    to = invalidMove();
-        for (auto& m : pathMoves)
-            m = invalidMove();
+                    to = 0;
         for (auto& row : pvTable)
             for (auto& m : row)
                 m = invalidMove();
-        pvLength.fill(0);
         continuation.fill(0);
         for (auto& a : history)
             for (auto& b : a)
@@ -500,10 +911,28 @@ struct SearchState {
 
     bool timeUp() {
         if (g_stopRequested.load(std::memory_order_relaxed)) return true;
+        // Node budgets are checked every node so `go nodes` results are exactly reproducible.
+        if (nodeLimit != 0 && nodes >= nodeLimit) return true;
         if ((nodes & 4095) != 0) return false;
+        // While pondering only an explicit stop or ponderhit can end the search.
+        if (g_ponderActive.load(std::memory_order_acquire)) return false;
+        return clockElapsedMs() >= hardLimitMs();
+    }
+
+    // Time spent on our own clock; after ponderhit it starts at the hit, not at the ponder search.
+    long long clockElapsedMs() const {
         auto now = std::chrono::steady_clock::now();
-        return std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count()
-               >= timeLimitMs;
+        if (g_ponderHitLimitMs.load(std::memory_order_relaxed) >= 0) {
+            const std::chrono::steady_clock::time_point hitAt {
+                std::chrono::steady_clock::duration(g_ponderHitAtNs.load(std::memory_order_relaxed)) };
+            return std::chrono::duration_cast<std::chrono::milliseconds>(now - hitAt).count();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count();
+    }
+
+    int hardLimitMs() const {
+        const int ponderHitLimit = g_ponderHitLimitMs.load(std::memory_order_relaxed);
+        return ponderHitLimit >= 0 ? ponderHitLimit : timeLimitMs;
     }
 } static ss;
 
@@ -624,8 +1053,8 @@ static void addBookLine(std::unordered_map<std::uint64_t, std::vector<Move>>& bo
     }
 }
 
-static void loadBookLinesFromFile(std::unordered_map<std::uint64_t, std::vector<Move>>& book,
-                                  const std::string& path)
+template <typename Fn>
+static void forEachBookFileLine(const std::string& path, Fn&& add)
 {
     std::ifstream in(path);
     if (!in.is_open()) {
@@ -653,209 +1082,851 @@ static void loadBookLinesFromFile(std::unordered_map<std::uint64_t, std::vector<
         }
 
         if (!moves.empty()) {
-            addBookLine(book, moves);
+            add(moves);
         }
     }
 }
 
+// Built-in lines plus the optional text line files; the source for both the in-memory
+// fallback book and --build-book.
+template <typename Fn>
+static void forEachBookLine(Fn&& add)
+{
+    // Open games (1.e4 e5)
+    add({"e2e4","e7e5","g1f3","b8c6","f1c4","g8f6","d2d3","f8c5"});
+    add({"e2e4","e7e5","g1f3","b8c6","f1b5","a7a6","b5a4","g8f6"});
+    add({"e2e4","e7e5","g1f3","b8c6","f1b5","g8f6","e1g1","f8e7"});
+    add({"e2e4","e7e5","g1f3","b8c6","f1c4","f8c5","c2c3","g8f6"});
+    add({"e2e4","e7e5","g1f3","b8c6","f1c4","f8c5","b2b4","c5b4"});
+    add({"e2e4","e7e5","g1f3","b8c6","d2d4","e5d4","f3d4","g8f6"});
+    add({"e2e4","e7e5","b1c3","g8f6","f2f4","d7d5","f4e5","f6e4"});
+    add({"e2e4","e7e5","f2f4","e5f4","g1f3","g7g5","h2h4","g5g4"});
+    add({"e2e4","e7e5","g1f3","g8f6","f3e5","d7d6","e5f3","f6e4"});
+    add({"e2e4","e7e5","g1f3","d7d6","d2d4","e5d4","f3d4","g8f6"});
+
+    // Sicilian Defence
+    add({"e2e4","c7c5","g1f3","d7d6","d2d4","c5d4","f3d4","g8f6"});
+    add({"e2e4","c7c5","g1f3","d7d6","d2d4","c5d4","f3d4","b8c6"});
+    add({"e2e4","c7c5","g1f3","d7d6","d2d4","c5d4","f3d4","g8f6","b1c3","a7a6"});
+    add({"e2e4","c7c5","g1f3","b8c6","d2d4","c5d4","f3d4","g7g6"});
+    add({"e2e4","c7c5","c2c3","d7d5","e4d5","d8d5","d2d4","b8c6"});
+    add({"e2e4","c7c5","d2d4","c5d4","c2c3","d4c3","b1c3","b8c6"});
+
+    // French Defence
+    add({"e2e4","e7e6","d2d4","d7d5","b1c3","g8f6","c1g5","f8e7"});
+    add({"e2e4","e7e6","d2d4","d7d5","e4e5","c7c5","c2c3","b8c6"});
+    add({"e2e4","e7e6","d2d4","d7d5","b1d2","c7c5","e4d5","e6d5"});
+
+    // Caro-Kann
+    add({"e2e4","c7c6","d2d4","d7d5","b1c3","d5e4","c3e4","c8f5"});
+    add({"e2e4","c7c6","d2d4","d7d5","e4e5","c8f5","g1f3","e7e6"});
+
+    // Scandinavian / Alekhine / Pirc / Modern
+    add({"e2e4","d7d5","e4d5","d8d5","b1c3","d5a5","d2d4","g8f6"});
+    add({"e2e4","g8f6","e4e5","f6d5","d2d4","d7d6","g1f3","c8g4"});
+    add({"e2e4","d7d6","d2d4","g8f6","b1c3","g7g6","g1f3","f8g7"});
+    add({"e2e4","g7g6","d2d4","f8g7","b1c3","d7d6","g1f3","a7a6"});
+
+    // Queen pawn openings
+    add({"d2d4","d7d5","c2c4","e7e6","b1c3","g8f6","c1g5","f8e7"});
+    add({"d2d4","d7d5","c2c4","d5c4","g1f3","g8f6","e2e3","e7e6"});
+    add({"d2d4","d7d5","c2c4","c7c6","b1c3","g8f6","g1f3","d5c4"});
+    add({"d2d4","d7d5","g1f3","g8f6","c1f4","e7e6","e2e3","c7c5"});
+    add({"d2d4","d7d5","g1f3","g8f6","e2e3","e7e6","f1d3","c7c5"});
+
+    // Indian defences
+    add({"d2d4","g8f6","c2c4","e7e6","g1f3","d7d5","b1c3","f8e7"});
+    add({"d2d4","g8f6","c2c4","e7e6","b1c3","f8b4","e2e3","e8g8"});
+    add({"d2d4","g8f6","c2c4","e7e6","g1f3","b7b6","g2g3","c8b7"});
+    add({"d2d4","g8f6","c2c4","g7g6","b1c3","f8g7","e2e4","d7d6"});
+    add({"d2d4","g8f6","c2c4","g7g6","b1c3","d7d5","c4d5","f6d5"});
+    add({"d2d4","g8f6","c2c4","c7c5","d4d5","e7e6","b1c3","e6d5"});
+
+    // English / Reti / flank systems
+    add({"c2c4","e7e5","b1c3","g8f6","g2g3","d7d5","c4d5","f6d5"});
+    add({"c2c4","c7c5","b1c3","b8c6","g2g3","g7g6","f1g2","f8g7"});
+    add({"g1f3","d7d5","d2d4","g8f6","c2c4","e7e6","b1c3","f8e7"});
+    add({"g1f3","d7d5","c2c4","e7e6","g2g3","g8f6","f1g2","f8e7"});
+    add({"f2f4","d7d5","g1f3","g8f6","e2e3","g7g6","b2b3","f8g7"});
+
+    // Keep a few sharp/forcing sidelines for variety.
+    add({"g1f3","d7d5","d2d4","g8f6","c2c4","e7e6","b1c3","f8e7"});
+    add({"e2e4","b8c6","d2d4","d7d5","b1c3","d5e4","d4d5","c6b8"});
+
+    // Optional external book file for large libraries.
+    forEachBookFileLine("assets/opening_book_lines.txt", add);
+    forEachBookFileLine("assets/book_lines.txt", add);
+    forEachBookFileLine("opening_book_lines.txt", add);
+}
+
 static const std::unordered_map<std::uint64_t, std::vector<Move>>& openingBook()
 {
     static const std::unordered_map<std::uint64_t, std::vector<Move>> book = [] {
         std::unordered_map<std::uint64_t, std::vector<Move>> b;
-
-        // Open games (1.e4 e5)
-        addBookLine(b, {"e2e4","e7e5","g1f3","b8c6","f1c4","g8f6","d2d3","f8c5"});
-        addBookLine(b, {"e2e4","e7e5","g1f3","b8c6","f1b5","a7a6","b5a4","g8f6"});
-        addBookLine(b, {"e2e4","e7e5","g1f3","b8c6","f1b5","g8f6","e1g1","f8e7"});
-        addBookLine(b, {"e2e4","e7e5","g1f3","b8c6","f1c4","f8c5","c2c3","g8f6"});
-        addBookLine(b, {"e2e4","e7e5","g1f3","b8c6","f1c4","f8c5","b2b4","c5b4"});
-        addBookLine(b, {"e2e4","e7e5","g1f3","b8c6","d2d4","e5d4","f3d4","g8f6"});
-        addBookLine(b, {"e2e4","e7e5","b1c3","g8f6","f2f4","d7d5","f4e5","f6e4"});
-        addBookLine(b, {"e2e4","e7e5","f2f4","e5f4","g1f3","g7g5","h2h4","g5g4"});
-        addBookLine(b, {"e2e4","e7e5","g1f3","g8f6","f3e5","d7d6","e5f3","f6e4"});
-        addBookLine(b, {"e2e4","e7e5","g1f3","d7d6","d2d4","e5d4","f3d4","g8f6"});
-
-        // Sicilian Defence
-        addBookLine(b, {"e2e4","c7c5","g1f3","d7d6","d2d4","c5d4","f3d4","g8f6"});
-        addBookLine(b, {"e2e4","c7c5","g1f3","d7d6","d2d4","c5d4","f3d4","b8c6"});
-        addBookLine(b, {"e2e4","c7c5","g1f3","d7d6","d2d4","c5d4","f3d4","g8f6","b1c3","a7a6"});
-        addBookLine(b, {"e2e4","c7c5","g1f3","b8c6","d2d4","c5d4","f3d4","g7g6"});
-        addBookLine(b, {"e2e4","c7c5","c2c3","d7d5","e4d5","d8d5","d2d4","b8c6"});
-        addBookLine(b, {"e2e4","c7c5","d2d4","c5d4","c2c3","d4c3","b1c3","b8c6"});
-
-        // French Defence
-        addBookLine(b, {"e2e4","e7e6","d2d4","d7d5","b1c3","g8f6","c1g5","f8e7"});
-        addBookLine(b, {"e2e4","e7e6","d2d4","d7d5","e4e5","c7c5","c2c3","b8c6"});
-        addBookLine(b, {"e2e4","e7e6","d2d4","d7d5","b1d2","c7c5","e4d5","e6d5"});
-
-        // Caro-Kann
-        addBookLine(b, {"e2e4","c7c6","d2d4","d7d5","b1c3","d5e4","c3e4","c8f5"});
-        addBookLine(b, {"e2e4","c7c6","d2d4","d7d5","e4e5","c8f5","g1f3","e7e6"});
-
-        // Scandinavian / Alekhine / Pirc / Modern
-        addBookLine(b, {"e2e4","d7d5","e4d5","d8d5","b1c3","d5a5","d2d4","g8f6"});
-        addBookLine(b, {"e2e4","g8f6","e4e5","f6d5","d2d4","d7d6","g1f3","c8g4"});
-        addBookLine(b, {"e2e4","d7d6","d2d4","g8f6","b1c3","g7g6","g1f3","f8g7"});
-        addBookLine(b, {"e2e4","g7g6","d2d4","f8g7","b1c3","d7d6","g1f3","a7a6"});
-
-        // Queen pawn openings
-        addBookLine(b, {"d2d4","d7d5","c2c4","e7e6","b1c3","g8f6","c1g5","f8e7"});
-        addBookLine(b, {"d2d4","d7d5","c2c4","d5c4","g1f3","g8f6","e2e3","e7e6"});
-        addBookLine(b, {"d2d4","d7d5","c2c4","c7c6","b1c3","g8f6","g1f3","d5c4"});
-        addBookLine(b, {"d2d4","d7d5","g1f3","g8f6","c1f4","e7e6","e2e3","c7c5"});
-        addBookLine(b, {"d2d4","d7d5","g1f3","g8f6","e2e3","e7e6","f1d3","c7c5"});
-
-        // Indian defences
-        addBookLine(b, {"d2d4","g8f6","c2c4","e7e6","g1f3","d7d5","b1c3","f8e7"});
-        addBookLine(b, {"d2d4","g8f6","c2c4","e7e6","b1c3","f8b4","e2e3","e8g8"});
-        addBookLine(b, {"d2d4","g8f6","c2c4","e7e6","g1f3","b7b6","g2g3","c8b7"});
-        addBookLine(b, {"d2d4","g8f6","c2c4","g7g6","b1c3","f8g7","e2e4","d7d6"});
-        addBookLine(b, {"d2d4","g8f6","c2c4","g7g6","b1c3","d7d5","c4d5","f6d5"});
-        addBookLine(b, {"d2d4","g8f6","c2c4","c7c5","d4d5","e7e6","b1c3","e6d5"});
-
-        // English / Reti / flank systems
-        addBookLine(b, {"c2c4","e7e5","b1c3","g8f6","g2g3","d7d5","c4d5","f6d5"});
-        addBookLine(b, {"c2c4","c7c5","b1c3","b8c6","g2g3","g7g6","f1g2","f8g7"});
-        addBookLine(b, {"g1f3","d7d5","d2d4","g8f6","c2c4","e7e6","b1c3","f8e7"});
-        addBookLine(b, {"g1f3","d7d5","c2c4","e7e6","g2g3","g8f6","f1g2","f8e7"});
-        addBookLine(b, {"f2f4","d7d5","g1f3","g8f6","e2e3","g7g6","b2b3","f8g7"});
-
-        // Keep a few sharp/forcing sidelines for variety.
-        addBookLine(b, {"g1f3","d7d5","d2d4","g8f6","c2c4","e7e6","b1c3","f8e7"});
-        addBookLine(b, {"e2e4","b8c6","d2d4","d7d5","b1c3","d5e4","d4d5","c6b8"});
-
-        // Optional external book file for large libraries.
-        loadBookLinesFromFile(b, "assets/opening_book_lines.txt");
-        loadBookLinesFromFile(b, "assets/book_lines.txt");
-        loadBookLinesFromFile(b, "opening_book_lines.txt");
-
+        forEachBookLine([&](const std::vector<std::string>& line) { addBookLine(b, line); });
         return b;
     }();
 
     return book;
 }
 
-struct ExperienceMoveStat {
-    Move move = invalidMove();
-    int sumScore = 0;
-    int visits = 0;
+// Compiled book: sorted 16-byte big-endian records in the Polyglot layout (key, move, weight,
+// learn). Keys are Polyglot keys (bookKey) and moves use the Polyglot encoding, with castling
+// written as king-takes-own-rook, so Polyglot .bin books can be used as-is. The file is mapped
+// read-only and searched in place, so lookup costs neither startup time nor heap.
+static constexpr int BOOK_MAX_PLY = 20;
+static constexpr const char* BINARY_BOOK_PATH = "assets/opening_book.bin";
+static constexpr size_t BOOK_RECORD_BYTES = 16;
+
+struct BookRecord {
+    uint64_t key = 0;
+    uint16_t move = 0;
+    uint16_t weight = 0;
+    uint32_t learn = 0;
 };
 
-static std::unordered_map<uint64_t, std::vector<ExperienceMoveStat>> g_experienceBook;
-static bool g_experienceLoaded = false;
-static std::mutex g_experienceMutex;
-static constexpr int EXPERIENCE_MAX_VISITS = 30000;
-static std::unordered_map<uint64_t, std::vector<ExperienceMoveStat>> g_pendingExperience;
-static bool g_learningGameActive = true;
-static bool g_experienceLearningEnabled = true;
+// Polyglot hashes the en-passant file only when a pawn of the side to move stands beside the
+// pawn that just made the double step.
+static uint64_t bookKey(const GameState& gs)
+{
+    uint64_t key = 0;
+    for (int color = 0; color < 2; ++color) {
+        for (int type = P; type <= K; ++type) {
+            const int kind = 2 * (type - 1) + (color == 0 ? 1 : 0);
+            uint64_t pieces = gs.bitboards[color][type - 1];
+            while (pieces) {
+                const int sq = lsbSquare64(popLsb64(pieces));
+                key ^= POLYGLOT_RANDOM[64 * kind + 8 * (7 - rowOfSq(sq)) + colOfSq(sq)];
+            }
+        }
+    }
 
-static std::string experiencePath()
+    if (!gs.wkMoved && !gs.wrHHMoved) key ^= POLYGLOT_RANDOM[POLYGLOT_CASTLING + 0];
+    if (!gs.wkMoved && !gs.wrAHMoved) key ^= POLYGLOT_RANDOM[POLYGLOT_CASTLING + 1];
+    if (!gs.bkMoved && !gs.brHHMoved) key ^= POLYGLOT_RANDOM[POLYGLOT_CASTLING + 2];
+    if (!gs.bkMoved && !gs.brAHMoved) key ^= POLYGLOT_RANDOM[POLYGLOT_CASTLING + 3];
+
+    if (gs.enPassantTarget.has_value()) {
+        const int file = gs.enPassantTarget->second;
+        const int pawnRow = gs.whiteToMove ? 3 : 4;
+        const uint64_t ownPawns = gs.bitboards[gs.whiteToMove ? 0 : 1][P - 1];
+        const uint64_t beside = (file > 0 ? 1ULL << (pawnRow * 8 + file - 1) : 0)
+            | (file < 7 ? 1ULL << (pawnRow * 8 + file + 1) : 0);
+        if (ownPawns & beside) {
+            key ^= POLYGLOT_RANDOM[POLYGLOT_EN_PASSANT + file];
+        }
+    }
+
+    if (gs.whiteToMove) {
+        key ^= POLYGLOT_RANDOM[POLYGLOT_TURN];
+    }
+    return key;
+}
+
+// The start-position key published with the Polyglot format.
+static_assert([] {
+    constexpr const char* backRank = "rnbqkbnr";
+    constexpr const char* kinds = "pPnNbBrRqQkK";
+    const auto kindOf = [&](char c) {
+        int k = 0;
+        while (kinds[k] != c) ++k;
+        return k;
+    };
+    uint64_t key = 0;
+    for (int file = 0; file < 8; ++file) {
+        key ^= POLYGLOT_RANDOM[64 * kindOf(static_cast<char>(backRank[file] - 32)) + file];
+        key ^= POLYGLOT_RANDOM[64 * kindOf('P') + 8 + file];
+        key ^= POLYGLOT_RANDOM[64 * kindOf('p') + 48 + file];
+        key ^= POLYGLOT_RANDOM[64 * kindOf(backRank[file]) + 56 + file];
+    }
+    for (int i = 0; i < 4; ++i) key ^= POLYGLOT_RANDOM[POLYGLOT_CASTLING + i];
+    return key ^ POLYGLOT_RANDOM[POLYGLOT_TURN];
+}() == 0x463B96181691FC9CULL);
+
+static uint16_t polyglotMove(const Move& m)
 {
-    return "assets/experience_book.txt";
+    const auto pgSquare = [](int sq) { return (7 - rowOfSq(sq)) * 8 + colOfSq(sq); };
+    int to = m.to();
+    if (m.isCastle()) {
+        to = rowOfSq(m.from()) * 8 + (colOfSq(m.to()) == 6 ? 7 : 0);
+    }
+    const int promo = m.isPromotion() ? m.promotionType() - 1 : 0;
+    return static_cast<uint16_t>(pgSquare(to) | (pgSquare(m.from()) << 6) | (promo << 12));
 }
 
-static void loadExperienceBookIfNeeded()
+static uint64_t readBigEndian(const unsigned char* p, int bytes)
 {
-    if (!g_experienceLearningEnabled) {
-        return;
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) {
+        v = (v << 8) | p[i];
     }
-    std::lock_guard<std::mutex> lock(g_experienceMutex);
-    if (g_experienceLoaded) {
-        return;
+    return v;
+}
+
+static void writeBigEndian(unsigned char* p, uint64_t v, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i) {
+        p[i] = static_cast<unsigned char>(v & 0xFF);
+        v >>= 8;
     }
+}
 
-    std::ifstream in(experiencePath());
-    if (!in.is_open()) {
-        g_experienceLoaded = true;
-        return;
+class BinaryBook {
+public:
+    explicit BinaryBook(const std::string& path)
+        : file_(path), count_(file_.size() / BOOK_RECORD_BYTES)
+    {
     }
 
-    uint64_t hash = 0;
-    uint32_t moveValue = 0;
-    int sumScore = 0;
-    int visits = 0;
-    while (in >> hash >> moveValue >> sumScore >> visits) {
-        if (visits <= 0) {
-            continue;
-        }
-        Move m;
-        m.value = moveValue;
-        if (!isValidMove(m)) {
-            continue;
-        }
+    size_t size() const { return count_; }
 
-        auto& vec = g_experienceBook[hash];
-        bool merged = false;
-        for (auto& e : vec) {
-            if (sameMoveIdentity(e.move, m)) {
-                e.sumScore = std::clamp(e.sumScore + sumScore, -50000000, 50000000);
-                e.visits = std::min(EXPERIENCE_MAX_VISITS, e.visits + visits);
-                merged = true;
-                break;
+    uint64_t keyAt(size_t i) const { return readBigEndian(file_.data() + i * BOOK_RECORD_BYTES, 8); }
+
+    BookRecord record(size_t i) const
+    {
+        const unsigned char* p = file_.data() + i * BOOK_RECORD_BYTES;
+        return { readBigEndian(p, 8), static_cast<uint16_t>(readBigEndian(p + 8, 2)),
+                 static_cast<uint16_t>(readBigEndian(p + 10, 2)), static_cast<uint32_t>(readBigEndian(p + 12, 4)) };
+    }
+
+    size_t lowerBound(uint64_t key) const
+    {
+        size_t lo = 0;
+        size_t hi = count_;
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (keyAt(mid) < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
             }
         }
-        if (!merged) {
-            ExperienceMoveStat e;
-            e.move = m;
-            e.sumScore = std::clamp(sumScore, -50000000, 50000000);
-            e.visits = std::min(EXPERIENCE_MAX_VISITS, visits);
-            vec.push_back(e);
-        }
+        return lo;
     }
 
-    g_experienceLoaded = true;
+private:
+    MappedFile file_;
+    size_t count_ = 0;
+};
+
+static const BinaryBook& binaryBook()
+{
+    static const BinaryBook book(BINARY_BOOK_PATH);
+    return book;
 }
 
-static void saveExperienceBook()
+static void appendBookRecord(std::vector<BookRecord>& records, const GameState& gs, const Move& m, uint16_t weight)
 {
-    if (!g_experienceLearningEnabled) {
-        return;
-    }
-    std::lock_guard<std::mutex> lock(g_experienceMutex);
-    std::ofstream out(experiencePath(), std::ios::trunc);
-    if (!out.is_open()) {
-        return;
-    }
+    records.push_back({ bookKey(gs), polyglotMove(m), weight, 0 });
+}
 
-    for (const auto& [hash, vec] : g_experienceBook) {
-        for (const auto& e : vec) {
-            if (!isValidMove(e.move) || e.visits <= 0) {
-                continue;
-            }
-            out << hash << ' ' << e.move.value << ' ' << e.sumScore << ' ' << e.visits << '\n';
+static void addBookLineRecords(std::vector<BookRecord>& records, const std::vector<std::string>& line)
+{
+    GameState gs;
+    gs.initStandard();
+    for (size_t ply = 0; ply < line.size() && ply < static_cast<size_t>(BOOK_MAX_PLY); ++ply) {
+        Move m;
+        if (!findLegalMoveByUci(gs, line[ply], m)) {
+            break;
         }
+        appendBookRecord(records, gs, m, 1);
+        makeMove(gs, m, false);
     }
 }
 
-static void updateExperienceBookEntry(uint64_t hash, const Move& move, int score)
+// PGN games weigh each move by the result for the side that played it: win 2, draw or
+// unknown 1, loss 0 (kept, but never chosen), as Polyglot does.
+static void addPgnRecords(std::vector<BookRecord>& records, const std::string& path)
 {
-    auto& vec = g_experienceBook[hash];
-    for (auto& e : vec) {
-        if (sameMoveIdentity(e.move, move)) {
-            e.sumScore = std::clamp(e.sumScore + score, -50000000, 50000000);
-            e.visits = std::min(EXPERIENCE_MAX_VISITS, e.visits + 1);
-            return;
+    // Large files are split across reader threads; records are sorted and merged afterwards,
+    // so the order games arrive in does not matter.
+    const int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::vector<BookRecord>> perReader(static_cast<size_t>(threads));
+    readPgnFile(path, threads, [&](int reader, const PgnGame& game) {
+        std::vector<BookRecord>& out = perReader[static_cast<size_t>(reader)];
+        GameState replay;
+        if (game.fen.empty()) {
+            replay.initStandard();
+        } else {
+            replay.loadFromFen(std::string(game.fen));
+        }
+        const int whiteScore = game.result == "1-0" ? 2 : (game.result == "0-1" ? 0 : 1);
+        for (size_t i = 0; i < game.moves.size() && i < static_cast<size_t>(BOOK_MAX_PLY); ++i) {
+            const int score = replay.whiteToMove ? whiteScore : 2 - whiteScore;
+            appendBookRecord(out, replay, game.moves[i], static_cast<uint16_t>(score));
+            makeMove(replay, game.moves[i], false);
         }
+    });
+    for (const std::vector<BookRecord>& part : perReader) {
+        records.insert(records.end(), part.begin(), part.end());
     }
-
-    ExperienceMoveStat e;
-    e.move = move;
-    e.sumScore = score;
-    e.visits = 1;
-    vec.push_back(e);
 }
 
-static void recordPendingExperience(uint64_t hash, const Move& move, int score)
+int buildOpeningBook(const std::string& outPath, const std::vector<std::string>& inputs)
 {
-    if (!g_experienceLearningEnabled || !g_learningGameActive || !isValidMove(move)) {
-        return;
+    std::vector<BookRecord> records;
+    const auto addLine = [&](const std::vector<std::string>& line) { addBookLineRecords(records, line); };
+    if (inputs.empty()) {
+        forEachBookLine(addLine);
+    }
+    for (const std::string& path : inputs) {
+        const std::string ext = std::filesystem::path(path).extension().string();
+        if (ext == ".pgn" || ext == ".PGN") {
+            addPgnRecords(records, path);
+        } else {
+            forEachBookFileLine(path, addLine);
+        }
+    }
+
+    std::sort(records.begin(), records.end(), [](const BookRecord& a, const BookRecord& b) {
+        return a.key != b.key ? a.key < b.key : a.move < b.move;
+    });
+
+    // Merge duplicate (key, move) pairs, then rescale any position whose weights overflow 16 bits.
+    std::vector<std::pair<BookRecord, uint64_t>> merged;
+    for (const BookRecord& r : records) {
+        if (!merged.empty() && merged.back().first.key == r.key && merged.back().first.move == r.move) {
+            merged.back().second += r.weight;
+        } else {
+            merged.push_back({ r, r.weight });
+        }
+    }
+
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        return -1;
+    }
+    std::vector<unsigned char> chunk;
+    chunk.reserve(4096 * BOOK_RECORD_BYTES);
+    for (size_t begin = 0; begin < merged.size();) {
+        size_t end = begin;
+        uint64_t maxWeight = 0;
+        while (end < merged.size() && merged[end].first.key == merged[begin].first.key) {
+            maxWeight = std::max(maxWeight, merged[end].second);
+            ++end;
+        }
+        for (size_t k = begin; k < end; ++k) {
+            uint64_t w = merged[k].second;
+            if (maxWeight > 0xFFFF) {
+                w = std::max<uint64_t>(w ? 1 : 0, w * 0xFFFF / maxWeight);
+            }
+            unsigned char rec[BOOK_RECORD_BYTES];
+            writeBigEndian(rec, merged[k].first.key, 8);
+            writeBigEndian(rec + 8, merged[k].first.move, 2);
+            writeBigEndian(rec + 10, w, 2);
+            writeBigEndian(rec + 12, 0, 4);
+            chunk.insert(chunk.end(), rec, rec + BOOK_RECORD_BYTES);
+        }
+        if (chunk.size() >= 4000 * BOOK_RECORD_BYTES) {
+            out.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+            chunk.clear();
+        }
+        begin = end;
+    }
+    out.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+    if (!out) {
+        return -1;
+    }
+    return static_cast<int>(merged.size());
+}
+
+struct ExperienceMoveStat {
+    Move move = invalidMove();
+    int sumScore = 0;
+    int visits = 0;
+};
+
+// Experience is kept as fixed 16-byte records: a sorted, mmapped base file searched in place,
+// plus an append-only log of per-game deltas that is merged into a new base in the background
+// once it grows. Both files carry a generation; a log applies only on top of a base whose
+// generation is not newer than its own, so a compaction interrupted at any point neither loses
+// nor double-counts a game. Several engine processes may share the files; see
+// ExperienceFileLock.
+struct ExperienceRecord {
+    uint64_t key = 0;
+    uint16_t move = 0;     // Move::packed()
+    uint16_t visits = 0;
+    int32_t sumScore = 0;
+};
+static_assert(sizeof(ExperienceRecord) == 16);
+
+struct ExperienceFileHeader {
+    char magic[8] = {};
+    uint64_t generation = 0;
+    uint64_t count = 0;     // base only; logs run to end of file
+};
+static_assert(sizeof(ExperienceFileHeader) == 24);
+
+static constexpr char EXPERIENCE_BASE_MAGIC[8] = { 'I', 'K', 'E', 'X', 'P', 'B', '0', '1' };
+static constexpr char EXPERIENCE_LOG_MAGIC[8] = { 'I', 'K', 'E', 'X', 'P', 'L', '0', '1' };
+static constexpr int EXPERIENCE_MAX_VISITS = 30000;
+static constexpr int EXPERIENCE_MAX_SUM = 50000000;
+static constexpr size_t EXPERIENCE_MIN_COMPACT_RECORDS = 4096;
+
+static bool experienceRecordLess(const ExperienceRecord& a, const ExperienceRecord& b)
+{
+    return a.key != b.key ? a.key < b.key : a.move < b.move;
+}
+
+static void mergeExperienceRecord(ExperienceRecord& into, const ExperienceRecord& delta)
+{
+    into.sumScore = std::clamp(into.sumScore + delta.sumScore, -EXPERIENCE_MAX_SUM, EXPERIENCE_MAX_SUM);
+    into.visits = static_cast<uint16_t>(std::min(EXPERIENCE_MAX_VISITS, into.visits + delta.visits));
+}
+
+// Folds adjacent duplicate (key, move) pairs of a sorted vector.
+static void foldExperienceRecords(std::vector<ExperienceRecord>& records)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (out > 0 && records[out - 1].key == records[i].key && records[out - 1].move == records[i].move) {
+            mergeExperienceRecord(records[out - 1], records[i]);
+        } else {
+            records[out++] = records[i];
+        }
+    }
+    records.resize(out);
+}
+
+static void normalizeExperienceRecords(std::vector<ExperienceRecord>& records)
+{
+    std::sort(records.begin(), records.end(), experienceRecordLess);
+    foldExperienceRecords(records);
+}
+
+class ExperienceBase {
+public:
+    explicit ExperienceBase(const std::string& path) : file_(path)
+    {
+        ExperienceFileHeader h;
+        if (file_.size() < sizeof(h)) {
+            return;
+        }
+        std::memcpy(&h, file_.data(), sizeof(h));
+        if (std::memcmp(h.magic, EXPERIENCE_BASE_MAGIC, sizeof(h.magic)) != 0
+            || file_.size() < sizeof(h) + h.count * sizeof(ExperienceRecord)) {
+            return;
+        }
+        generation_ = h.generation;
+        count_ = h.count;
+        records_ = reinterpret_cast<const ExperienceRecord*>(file_.data() + sizeof(h));
+    }
+
+    uint64_t generation() const { return generation_; }
+    size_t size() const { return count_; }
+    const ExperienceRecord* begin() const { return records_; }
+    const ExperienceRecord* end() const { return records_ + count_; }
+
+    // Records for `key`, sorted by move.
+    std::pair<const ExperienceRecord*, const ExperienceRecord*> find(uint64_t key) const
+    {
+        const ExperienceRecord probe{ key, 0, 0, 0 };
+        const ExperienceRecord* first = std::lower_bound(begin(), end(), probe, experienceRecordLess);
+        const ExperienceRecord* last = first;
+        while (last != end() && last->key == key) {
+            ++last;
+        }
+        return { first, last };
+    }
+
+private:
+    MappedFile file_;
+    uint64_t generation_ = 0;
+    size_t count_ = 0;
+    const ExperienceRecord* records_ = nullptr;
+};
+
+// Deltas are held as immutable sorted segments, so snapshots share them instead of copying.
+using ExperienceSegment = std::shared_ptr<const std::vector<ExperienceRecord>>;
+
+// Writer state, guarded by g_experienceMutex.
+static std::shared_ptr<const ExperienceBase> g_experienceBase;
+static std::vector<ExperienceSegment> g_experienceCompacting;   // frozen deltas being merged
+static std::vector<ExperienceSegment> g_experienceDelta;        // deltas since the last rotation, oldest first
+static bool g_experienceCompactionFailed = false;
+static std::atomic<bool> g_experienceLoaded{ false };
+static std::mutex g_experienceMutex;
+static std::unordered_map<uint64_t, std::vector<ExperienceMoveStat>> g_pendingExperience;
+static bool g_learningGameActive = true;
+static bool g_experienceLearningEnabled = true;
+
+// Readers never take g_experienceMutex: writers publish an immutable snapshot after every
+// change and readers load whichever one is current (read-copy-update).
+struct ExperienceSnapshot {
+    std::shared_ptr<const ExperienceBase> base;
+    std::vector<ExperienceSegment> segments;
+};
+static std::atomic<std::shared_ptr<const ExperienceSnapshot>> g_experienceSnapshot;
+
+// Caller holds g_experienceMutex. Costs one pointer per segment, not one copy per record.
+static void publishExperienceSnapshot()
+{
+    auto snap = std::make_shared<ExperienceSnapshot>();
+    snap->base = g_experienceBase;
+    snap->segments.reserve(g_experienceCompacting.size() + g_experienceDelta.size());
+    snap->segments.insert(snap->segments.end(), g_experienceCompacting.begin(), g_experienceCompacting.end());
+    snap->segments.insert(snap->segments.end(), g_experienceDelta.begin(), g_experienceDelta.end());
+    g_experienceSnapshot.store(std::move(snap), std::memory_order_release);
+}
+
+// Adds sorted, folded records as the newest delta segment. While it is at least half the size
+// of the one before, the two are merged, so there are O(log n) segments and each record is
+// merged O(log n) times. Caller holds g_experienceMutex.
+static void pushExperienceSegment(std::vector<ExperienceRecord> records)
+{
+    while (!g_experienceDelta.empty() && records.size() * 2 >= g_experienceDelta.back()->size()) {
+        const std::vector<ExperienceRecord>& prev = *g_experienceDelta.back();
+        std::vector<ExperienceRecord> merged;
+        merged.reserve(prev.size() + records.size());
+        std::merge(prev.begin(), prev.end(), records.begin(), records.end(), std::back_inserter(merged),
+                   experienceRecordLess);
+        foldExperienceRecords(merged);
+        records = std::move(merged);
+        g_experienceDelta.pop_back();
+    }
+    if (!records.empty()) {
+        g_experienceDelta.push_back(std::make_shared<const std::vector<ExperienceRecord>>(std::move(records)));
+    }
+}
+
+static size_t experienceDeltaRecords()
+{
+    size_t n = 0;
+    for (const ExperienceSegment& segment : g_experienceDelta) {
+        n += segment->size();
+    }
+    return n;
+}
+
+struct ExperienceCompactor {
+    std::thread worker;
+    std::atomic<bool> running{ false };
+
+    ~ExperienceCompactor()
+    {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+} static g_experienceCompactor;
+
+static std::string experiencePath()
+{
+    return "assets/experience_book.txt";
+}
+
+static std::string experienceBasePath()
+{
+    return "assets/experience.bin";
+}
+
+static std::string experienceLogPath()
+{
+    return "assets/experience.log";
+}
+
+static std::string experienceOldLogPath()
+{
+    return "assets/experience.log.old";
+}
+
+// Appends, log rotation and the swap to a new base run under an exclusive flock on this file,
+// so several engine processes can learn into one store.
+static std::string experienceLockPath()
+{
+    return "assets/experience.lock";
+}
+
+// Takes an exclusive flock on `path` and returns the descriptor holding it, or -1 when the file
+// is missing (and not `create`) or, unless `wait`, another process holds the lock.
+static int lockExperienceFile(const std::string& path, bool create, bool wait)
+{
+#if defined(__linux__)
+    const int fd = open(path.c_str(), (create ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    int rc;
+    while ((rc = flock(fd, wait ? LOCK_EX : LOCK_EX | LOCK_NB)) != 0 && errno == EINTR) {
+    }
+    if (rc != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    // Without flock the store supports a single writer.
+    std::error_code ec;
+    return create || std::filesystem::exists(path, ec) ? 0 : -1;
+#endif
+}
+
+static void unlockExperienceFile(int fd)
+{
+#if defined(__linux__)
+    if (fd >= 0) {
+        close(fd);
+    }
+#else
+    (void)fd;
+#endif
+}
+
+class ExperienceFileLock {
+public:
+    ExperienceFileLock() : fd_(lockExperienceFile(experienceLockPath(), true, true)) {}
+    ~ExperienceFileLock() { unlockExperienceFile(fd_); }
+    ExperienceFileLock(const ExperienceFileLock&) = delete;
+    ExperienceFileLock& operator=(const ExperienceFileLock&) = delete;
+
+private:
+    int fd_;
+};
+
+static bool readExperienceHeader(const std::string& path, const char (&magic)[8], ExperienceFileHeader& h)
+{
+    std::ifstream in(path, std::ios::binary);
+    return in.read(reinterpret_cast<char*>(&h), sizeof(h)) && std::memcmp(h.magic, magic, sizeof(h.magic)) == 0;
+}
+
+// Appends the records of a log file to `out` when it applies on top of `baseGeneration`.
+static bool readExperienceLog(const std::string& path, uint64_t baseGeneration,
+                              std::vector<ExperienceRecord>& out, uint64_t& generation)
+{
+    std::ifstream in(path, std::ios::binary);
+    ExperienceFileHeader h;
+    if (!in.read(reinterpret_cast<char*>(&h), sizeof(h))
+        || std::memcmp(h.magic, EXPERIENCE_LOG_MAGIC, sizeof(h.magic)) != 0
+        || h.generation < baseGeneration) {
+        return false;
+    }
+    generation = h.generation;
+    ExperienceRecord r;
+    while (in.read(reinterpret_cast<char*>(&r), sizeof(r))) {
+        out.push_back(r);
+    }
+    return true;
+}
+
+// Generation a new log is stamped with: the one the pending compaction will give the base,
+// or the base's own. Read from disk, since another process may have rotated or compacted.
+// Caller holds the experience file lock.
+static uint64_t freshExperienceLogGeneration()
+{
+    ExperienceFileHeader h;
+    uint64_t generation = 0;
+    if (readExperienceHeader(experienceBasePath(), EXPERIENCE_BASE_MAGIC, h)) {
+        generation = h.generation;
+    }
+    if (readExperienceHeader(experienceOldLogPath(), EXPERIENCE_LOG_MAGIC, h)) {
+        generation = std::max(generation, h.generation + 1);
+    }
+    return generation;
+}
+
+// Caller holds the experience file lock.
+static void appendExperienceLog(const std::vector<ExperienceRecord>& records)
+{
+    std::error_code ec;
+    const bool fresh = !std::filesystem::exists(experienceLogPath(), ec) || std::filesystem::file_size(experienceLogPath(), ec) == 0;
+    std::ofstream out(experienceLogPath(), std::ios::binary | std::ios::app);
+    if (!out.is_open()) {
+        return;
+    }
+    if (fresh) {
+        ExperienceFileHeader h;
+        std::memcpy(h.magic, EXPERIENCE_LOG_MAGIC, sizeof(h.magic));
+        h.generation = freshExperienceLogGeneration();
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    }
+    out.write(reinterpret_cast<const char*>(records.data()),
+              static_cast<std::streamsize>(records.size() * sizeof(ExperienceRecord)));
+}
+
+// Replaces the in-memory store with what is on disk: the base, a rotated log still waiting to
+// be compacted, and the current log, which together include every process's games.
+// Caller holds g_experienceMutex and the experience file lock.
+static void readExperienceStore()
+{
+    g_experienceBase = std::make_shared<const ExperienceBase>(experienceBasePath());
+    g_experienceCompacting.clear();
+    g_experienceDelta.clear();
+    const uint64_t baseGeneration = g_experienceBase->generation();
+    uint64_t generation = 0;
+    std::vector<ExperienceRecord> logged;
+    readExperienceLog(experienceOldLogPath(), baseGeneration, logged, generation);
+    readExperienceLog(experienceLogPath(), baseGeneration, logged, generation);
+    normalizeExperienceRecords(logged);
+    pushExperienceSegment(std::move(logged));
+}
+
+static void loadExperienceBookIfNeeded()
+{
+    if (!g_experienceLearningEnabled || g_experienceLoaded.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_experienceMutex);
+    if (g_experienceLoaded.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    ExperienceFileLock fileLock;
+    readExperienceStore();
+
+    // One-time import of the old text format into the log.
+    if (g_experienceBase->size() == 0 && g_experienceDelta.empty()) {
+        std::ifstream in(experiencePath());
+        uint64_t hash = 0;
+        uint32_t moveValue = 0;
+        int sumScore = 0;
+        int visits = 0;
+        std::vector<ExperienceRecord> imported;
+        while (in >> hash >> moveValue >> sumScore >> visits) {
+            Move m;
+            m.value = moveValue;
+            if (visits <= 0 || !isValidMove(m)) {
+                continue;
+            }
+            imported.push_back({ hash, m.packed(), static_cast<uint16_t>(std::min(EXPERIENCE_MAX_VISITS, visits)),
+                                 std::clamp(sumScore, -EXPERIENCE_MAX_SUM, EXPERIENCE_MAX_SUM) });
+        }
+        if (!imported.empty()) {
+            appendExperienceLog(imported);
+            normalizeExperienceRecords(imported);
+            pushExperienceSegment(std::move(imported));
+        }
+    }
+
+    publishExperienceSnapshot();
+    g_experienceLoaded.store(true, std::memory_order_release);
+}
+
+// Merges the rotated log into a new base. Both inputs are read from disk rather than from this
+// process's memory, so games that other processes logged are kept. `oldLogFd` holds a flock on
+// the rotated log for the whole merge; a process that finds the log unlocked knows its
+// compactor died and takes it over.
+static void compactExperience(int oldLogFd)
+{
+    const ExperienceBase base(experienceBasePath());
+    std::vector<ExperienceRecord> rotated;
+    uint64_t rotatedGeneration = 0;
+    // A rotated log older than the base was merged already and only needs removing.
+    const bool applies = readExperienceLog(experienceOldLogPath(), base.generation(), rotated, rotatedGeneration);
+    normalizeExperienceRecords(rotated);
+
+    const std::string tmpPath = experienceBasePath() + ".tmp";
+    bool ok = !applies;
+    if (applies) {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        ExperienceFileHeader h;
+        std::memcpy(h.magic, EXPERIENCE_BASE_MAGIC, sizeof(h.magic));
+        h.generation = rotatedGeneration + 1;
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+        std::vector<ExperienceRecord> chunk;
+        chunk.reserve(1 << 16);
+        const auto flush = [&] {
+            out.write(reinterpret_cast<const char*>(chunk.data()),
+                      static_cast<std::streamsize>(chunk.size() * sizeof(ExperienceRecord)));
+            h.count += chunk.size();
+            chunk.clear();
+        };
+        const ExperienceRecord* a = base.begin();
+        auto b = rotated.cbegin();
+        while (a != base.end() || b != rotated.cend()) {
+            ExperienceRecord r;
+            if (b == rotated.cend() || (a != base.end() && experienceRecordLess(*a, *b))) {
+                r = *a++;
+            } else if (a == base.end() || experienceRecordLess(*b, *a)) {
+                r = *b++;
+            } else {
+                r = *a++;
+                mergeExperienceRecord(r, *b++);
+            }
+            chunk.push_back(r);
+            if (chunk.size() == chunk.capacity()) {
+                flush();
+            }
+        }
+        flush();
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.close();
+        ok = static_cast<bool>(out);
+    }
+
+    std::lock_guard<std::mutex> lock(g_experienceMutex);
+    {
+        ExperienceFileLock fileLock;
+        std::error_code ec;
+        if (ok && applies) {
+            std::filesystem::rename(tmpPath, experienceBasePath(), ec);
+            ok = !ec;
+        }
+        if (ok) {
+            std::filesystem::remove(experienceOldLogPath(), ec);
+            readExperienceStore();
+            publishExperienceSnapshot();
+        } else {
+            // The rotated log stays on disk, so nothing is lost; stop rotating in this process.
+            std::filesystem::remove(tmpPath, ec);
+            g_experienceCompactionFailed = true;
+        }
+        unlockExperienceFile(oldLogFd);
+    }
+    g_experienceCompactor.running.store(false, std::memory_order_release);
+}
+
+// Caller holds g_experienceMutex and the experience file lock.
+static void maybeStartExperienceCompaction()
+{
+    const size_t threshold = std::max(EXPERIENCE_MIN_COMPACT_RECORDS, g_experienceBase->size() / 8);
+    if (experienceDeltaRecords() < threshold || g_experienceCompactionFailed
+        || g_experienceCompactor.running.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    // A rotated log that is still locked is being compacted by another process. One left
+    // unlocked was abandoned mid-compaction and is merged before the log rotates again.
+    std::error_code ec;
+    const bool abandoned = std::filesystem::exists(experienceOldLogPath(), ec);
+    if (!abandoned) {
+        // Rotate the log: new games go to a fresh log stamped with the generation the new
+        // base will carry, so it applies whether or not the compaction finishes.
+        std::filesystem::rename(experienceLogPath(), experienceOldLogPath(), ec);
+        if (ec) {
+            return;
+        }
+        appendExperienceLog({});
+    }
+    const int oldLogFd = lockExperienceFile(experienceOldLogPath(), false, false);
+    if (oldLogFd < 0) {
+        return;
+    }
+    if (!abandoned) {
+        g_experienceCompacting = std::move(g_experienceDelta);
+        g_experienceDelta.clear();
+        publishExperienceSnapshot();
+    }
+
+    if (g_experienceCompactor.worker.joinable()) {
+        g_experienceCompactor.worker.join();
+    }
+    g_experienceCompactor.running.store(true, std::memory_order_release);
+    g_experienceCompactor.worker = std::thread(compactExperience, oldLogFd);
+}
+
+static void recordPendingExperience(uint64_t hash, const Move& move, int score)
+{
+    if (!g_experienceLearningEnabled || !g_learningGameActive || !isValidMove(move)) {
+        return;
     }
 
     std::lock_guard<std::mutex> lock(g_experienceMutex);
     auto& vec = g_pendingExperience[hash];
     for (auto& e : vec) {
         if (sameMoveIdentity(e.move, move)) {
-            e.sumScore = std::clamp(e.sumScore + score, -50000000, 50000000);
+            e.sumScore = std::clamp(e.sumScore + score, -EXPERIENCE_MAX_SUM, EXPERIENCE_MAX_SUM);
             e.visits = std::min(EXPERIENCE_MAX_VISITS, e.visits + 1);
             return;
         }
@@ -868,35 +1939,91 @@ static void recordPendingExperience(uint64_t hash, const Move& move, int score)
     vec.push_back(e);
 }
 
-static int experienceMoveBias(uint64_t hash, const Move& move)
+struct RootExperience {
+    uint16_t move = 0;   // Move::packed()
+    int bias = 0;
+};
+
+// Ordering bias of every move with experience in one position, read from the current snapshot
+// without taking the writer lock. computeBestMove takes this once per search for the root.
+static std::vector<RootExperience> experienceForPosition(uint64_t key)
 {
+    std::vector<RootExperience> out;
     if (!g_experienceLearningEnabled) {
-        return 0;
+        return out;
     }
     loadExperienceBookIfNeeded();
-    std::lock_guard<std::mutex> lock(g_experienceMutex);
-
-    auto it = g_experienceBook.find(hash);
-    if (it == g_experienceBook.end()) {
-        return 0;
+    const std::shared_ptr<const ExperienceSnapshot> snap = g_experienceSnapshot.load(std::memory_order_acquire);
+    if (!snap) {
+        return out;
+    }
+
+    const auto [baseFirst, baseLast] = snap->base->find(key);
+    std::vector<ExperienceRecord> stats(baseFirst, baseLast);
+    const ExperienceRecord probe{ key, 0, 0, 0 };
+    for (const ExperienceSegment& segment : snap->segments) {
+        for (auto it = std::lower_bound(segment->begin(), segment->end(), probe, experienceRecordLess);
+             it != segment->end() && it->key == key; ++it) {
+            stats.push_back(*it);
+        }
     }
+    normalizeExperienceRecords(stats);
 
-    for (const auto& e : it->second) {
-        if (!sameMoveIdentity(e.move, move) || e.visits <= 0) {
+    for (const ExperienceRecord& r : stats) {
+        if (r.visits == 0) {
             continue;
         }
-        const int avg = e.sumScore / e.visits;
-        const int conf = std::min(120, e.visits * 4);
-        return std::clamp((avg * conf) / 160, -240, 240);
+        const int avg = r.sumScore / r.visits;
+        const int conf = std::min(120, r.visits * 4);
+        out.push_back({ r.move, std::clamp((avg * conf) / 160, -240, 240) });
     }
-
-    return 0;
+    return out;
 }
 
 static Move bookMoveForPosition(GameState& gs)
 {
     const int ply = (gs.fullmoveNumber - 1) * 2 + (gs.whiteToMove ? 0 : 1);
-    if (ply >= 20) {
+    if (ply >= BOOK_MAX_PLY) {
+        return invalidMove();
+    }
+
+    static thread_local std::mt19937 rng(std::random_device{}());
+
+    // The compiled book, when present, replaces the text lines entirely. A miss costs only the
+    // binary search; on a hit the records are matched to legal moves in fixed local storage.
+    const BinaryBook& bin = binaryBook();
+    if (bin.size() > 0) {
+        const uint64_t key = bookKey(gs);
+        const size_t first = bin.lowerBound(key);
+        if (first == bin.size() || bin.keyAt(first) != key) {
+            return invalidMove();
+        }
+
+        MoveList legal;
+        generateLegalMoves(gs, legal);
+        std::array<uint32_t, MAX_MOVES> weight;
+        weight.fill(0);
+        uint32_t total = 0;
+        for (size_t i = first; i < bin.size() && bin.keyAt(i) == key; ++i) {
+            const BookRecord r = bin.record(i);
+            for (int k = 0; k < legal.count; ++k) {
+                if (polyglotMove(legal.moves[k]) == r.move) {
+                    weight[static_cast<size_t>(k)] += r.weight;
+                    total += r.weight;
+                    break;
+                }
+            }
+        }
+        if (total == 0) {
+            return invalidMove();
+        }
+        uint32_t pick = std::uniform_int_distribution<uint32_t>(0, total - 1)(rng);
+        for (int k = 0; k < legal.count; ++k) {
+            if (pick < weight[static_cast<size_t>(k)]) {
+                return legal.moves[k];
+            }
+            pick -= weight[static_cast<size_t>(k)];
+        }
         return invalidMove();
     }
 
@@ -909,6 +2036,7 @@ static Move bookMoveForPosition(GameState& gs)
 
     MoveList legal;
     generateLegalMoves(gs, legal);
+
     std::vector<Move> candidates;
     candidates.reserve(it->second.size());
     for (const Move& bm : it->second) {
@@ -921,7 +2049,6 @@ static Move bookMoveForPosition(GameState& gs)
     }
 
     if (!candidates.empty()) {
-        static thread_local std::mt19937 rng(std::random_device{}());
         std::uniform_int_distribution<size_t> dist(0, candidates.size() - 1);
         return candidates[dist(rng)];
     }
@@ -929,52 +2056,6 @@ static Move bookMoveForPosition(GameState& gs)
     return invalidMove();
 }
 
-struct PawnEvalEntry {
-    uint64_t key = 0;
-    int pawnStructure = 0;
-    int rookOpenFile = 0;
-};
-
-static constexpr size_t PAWN_EVAL_SIZE = 1 << 19;
-
-struct PawnEvalCache {
-    std::vector<PawnEvalEntry> table;
-
-    PawnEvalCache() : table(PAWN_EVAL_SIZE) {}
-
-    static uint64_t makeKey(const GameState& gs)
-    {
-        uint64_t w = gs.bitboards[0][P - 1];
-        uint64_t b = gs.bitboards[1][P - 1];
-
-        // splitmix64-style mixing for a compact pawn signature.
-        auto mix = [](uint64_t x) {
-            x += 0x9e3779b97f4a7c15ULL;
-            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
-            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
-            return x ^ (x >> 31);
-        };
-
-        uint64_t key = mix(w) ^ (mix(b) << 1);
-        if (key == 0) key = 1;
-        return key;
-    }
-
-    PawnEvalEntry* probe(uint64_t key)
-    {
-        PawnEvalEntry* e = &table[key & (PAWN_EVAL_SIZE - 1)];
-        return (e->key == key) ? e : nullptr;
-    }
-
-    void store(uint64_t key, int pawnStructure, int rookOpenFile)
-    {
-        PawnEvalEntry& e = table[key & (PAWN_EVAL_SIZE - 1)];
-        e.key = key;
-        e.pawnStructure = pawnStructure;
-        e.rookOpenFile = rookOpenFile;
-    }
-} static pawnEvalCache;
-
 static inline int scoreToTT(int score, int ply)
 {
     if (score > MATE_SCORE - MAX_PLY) return score + ply;
@@ -1038,6 +2119,37 @@ struct HashHistoryGuard {
     }
 };
 
+// A node's move list, carved from ss.moveArena just above its parent's list and released on
+// return, so the lists along a search line sit back to back instead of as 1 KB stack arrays.
+struct MoveArenaFrame {
+    Move* first = nullptr;
+    int count = 0;
+    int base = 0;
+
+    MoveArenaFrame() : base(ss.moveArenaTop)
+    {
+        if (base + MAX_MOVES <= MOVE_ARENA_SIZE) {
+            first = ss.moveArena.data() + base;
+        }
+    }
+
+    ~MoveArenaFrame() { ss.moveArenaTop = base; }
+
+    bool available() const { return first != nullptr; }
+
+    // Claims [first, last) so child nodes allocate above it; a later commit replaces the list.
+    void commit(Move* last)
+    {
+        count = static_cast<int>(last - first);
+        ss.moveArenaTop = base + count;
+    }
+
+    bool empty() const { return count == 0; }
+    Move& operator[](int i) { return first[i]; }
+    Move* begin() { return first; }
+    Move* end() { return first + count; }
+};
+
 
 static bool isEndgame(const GameState& gs)
 {
@@ -1108,102 +2220,6 @@ static bool hasMatingMaterial(const GameState& gs, bool white)
     return false;
 }
 
-static uint8_t pawnFileMask(const GameState& gs, bool white)
-{
-    uint8_t mask = 0;
-    uint64_t pawns = gs.bitboards[white ? 0 : 1][P - 1];
-    while (pawns) {
-        int sq = lsbSquare64(popLsb64(pawns));
-        mask |= static_cast<uint8_t>(1u << colOfSq(sq));
-    }
-    return mask;
-}
-
-static int pawnStructureScoreRaw(const GameState& gs)
-{
-    int score = 0;
-
-    const uint64_t wPawns = gs.bitboards[0][P - 1];
-    const uint64_t bPawns = gs.bitboards[1][P - 1];
-
-    uint8_t wFiles = pawnFileMask(gs, true);
-    uint8_t bFiles = pawnFileMask(gs, false);
-
-    auto pawnIslands = [](uint8_t files) {
-        int islands = 0;
-        bool inIsland = false;
-        for (int c = 0; c < 8; ++c) {
-            const bool has = ((files >> c) & 1) != 0;
-            if (has && !inIsland) {
-                islands++;
-                inIsland = true;
-            } else if (!has) {
-                inIsland = false;
-            }
-        }
-        return islands;
-    };
-
-    const int whiteIslands = pawnIslands(wFiles);
-    const int blackIslands = pawnIslands(bFiles);
-    score -= std::max(0, whiteIslands - 1) * 8;
-    score += std::max(0, blackIslands - 1) * 8;
-
-    for (int c = 0; c < 8; c++) {
-        bool wHas = (wFiles >> c) & 1;
-        bool bHas = (bFiles >> c) & 1;
-        uint64_t fileMask = 0x0101010101010101ULL << c;
-        int wCount = popcount64(wPawns & fileMask);
-        int bCount = popcount64(bPawns & fileMask);
-        if (wCount > 1) score -= 24 * (wCount - 1);
-        if (bCount > 1) score += 24 * (bCount - 1);
-
-        bool wLeft  = (c > 0) && ((wFiles >> (c-1)) & 1);
-        bool wRight = (c < 7) && ((wFiles >> (c+1)) & 1);
-        if (wHas && !wLeft && !wRight) score -= 20;
-
-        bool bLeft  = (c > 0) && ((bFiles >> (c-1)) & 1);
-        bool bRight = (c < 7) && ((bFiles >> (c+1)) & 1);
-        if (bHas && !bLeft && !bRight) score += 20;
-    }
-
-    uint64_t wp = wPawns;
-    while (wp) {
-        const int sq = lsbSquare64(popLsb64(wp));
-        const int r = rowOfSq(sq);
-        const int c = colOfSq(sq);
-        uint64_t frontMask = 0;
-        for (int rr = r - 1; rr >= 0; --rr) {
-            for (int cc = std::max(0, c - 1); cc <= std::min(7, c + 1); ++cc) {
-                frontMask |= (1ULL << (rr * 8 + cc));
-            }
-        }
-        if ((bPawns & frontMask) == 0) {
-            int rank = 7 - r;
-            score += 8 + rank * rank * 2;
-        }
-    }
-
-    uint64_t bp = bPawns;
-    while (bp) {
-        const int sq = lsbSquare64(popLsb64(bp));
-        const int r = rowOfSq(sq);
-        const int c = colOfSq(sq);
-        uint64_t frontMask = 0;
-        for (int rr = r + 1; rr < 8; ++rr) {
-            for (int cc = std::max(0, c - 1); cc <= std::min(7, c + 1); ++cc) {
-                frontMask |= (1ULL << (rr * 8 + cc));
-            }
-        }
-        if ((wPawns & frontMask) == 0) {
-            int rank = r;
-            score -= 8 + rank * rank * 2;
-        }
-    }
-
-    return score;
-}
-
 static int loosePawnScore(const GameState& gs)
 {
     auto sidePenalty = [&](bool white) {
@@ -1231,48 +2247,41 @@ static int loosePawnScore(const GameState& gs)
     return blackPenalty - whitePenalty;
 }
 
-static int rookOpenFileBonusRaw(const GameState& gs)
+static int rookOpenFileBonus(const GameState& gs, const PawnEvalEntry& pawnInfo)
 {
     int score = 0;
-    uint8_t wFiles = pawnFileMask(gs, true);
-    uint8_t bFiles = pawnFileMask(gs, false);
+    const uint8_t open = pawnInfo.openFiles();
 
-    uint64_t wr = gs.bitboards[0][R - 1];
-    while (wr) {
-        const int c = colOfSq(lsbSquare64(popLsb64(wr)));
-        bool noFriendly = ((wFiles >> c) & 1) == 0;
-        bool noEnemy = ((bFiles >> c) & 1) == 0;
-        if (noFriendly && noEnemy)
-            score += 20;
-        else if (noFriendly)
-            score += 10;
-    }
-
-    uint64_t br = gs.bitboards[1][R - 1];
-    while (br) {
-        const int c = colOfSq(lsbSquare64(popLsb64(br)));
-        bool noFriendly = ((bFiles >> c) & 1) == 0;
-        bool noEnemy = ((wFiles >> c) & 1) == 0;
-        if (noFriendly && noEnemy)
-            score -= 20;
-        else if (noFriendly)
-            score -= 10;
+    for (int side = 0; side < 2; ++side) {
+        const uint8_t halfOpen = pawnInfo.halfOpenFiles(side);
+        int sideScore = 0;
+        uint64_t rooks = gs.bitboards[side][R - 1];
+        while (rooks) {
+            const int c = colOfSq(lsbSquare64(popLsb64(rooks)));
+            if ((open >> c) & 1)
+                sideScore += 20;
+            else if ((halfOpen >> c) & 1)
+                sideScore += 10;
+        }
+        score += (side == 0) ? sideScore : -sideScore;
     }
     return score;
 }
 
-static void pawnEvalTerms(const GameState& gs, int& pawnStructure, int& rookOpenFile)
+// Knights and bishops on relative ranks 4-6, defended by a pawn, on a square no enemy pawn can
+// ever attack.
+static int outpostScore(const GameState& gs, const PawnEvalEntry& pawnInfo)
 {
-    const uint64_t key = PawnEvalCache::makeKey(gs);
-    if (PawnEvalEntry* e = pawnEvalCache.probe(key)) {
-        pawnStructure = e->pawnStructure;
-        rookOpenFile = e->rookOpenFile;
-        return;
+    static constexpr uint64_t OUTPOST_RANKS[2] = { 0x000000FFFFFF0000ULL, 0x0000FFFFFF000000ULL };
+    int score = 0;
+    for (int side = 0; side < 2; ++side) {
+        const uint64_t outposts = OUTPOST_RANKS[side] & ~pawnInfo.attackSpan[side ^ 1]
+            & pawnAttackSet(gs.bitboards[side][P - 1], side == 0);
+        const int sideScore = 20 * popcount64(gs.bitboards[side][N - 1] & outposts)
+            + 10 * popcount64(gs.bitboards[side][B - 1] & outposts);
+        score += (side == 0) ? sideScore : -sideScore;
     }
-
-    pawnStructure = pawnStructureScoreRaw(gs);
-    rookOpenFile = rookOpenFileBonusRaw(gs);
-    pawnEvalCache.store(key, pawnStructure, rookOpenFile);
+    return score;
 }
 
 static int bishopPairBonus(const GameState& gs)
@@ -1348,70 +2357,42 @@ static int openingPrinciplesScore(const GameState& gs)
     return score;
 }
 
-static int lightweightKingSafetyScore(const GameState& gs, bool eg)
+static int kingShelterPenalty(const GameState& gs, PawnEvalEntry& pawnInfo, int side)
 {
-    if (eg) {
-        return 0;
+    const int kingSq = lsbSquare64(gs.bitboards[side][K - 1]);
+    if (pawnInfo.shelterKingSq[side] == kingSq) {
+        return pawnInfo.shelterPenalty[side];
     }
 
-    static constexpr uint64_t fileMasks[8] = {
-        0x0101010101010101ULL, 0x0202020202020202ULL, 0x0404040404040404ULL, 0x0808080808080808ULL,
-        0x1010101010101010ULL, 0x2020202020202020ULL, 0x4040404040404040ULL, 0x8080808080808080ULL
-    };
-
-    const uint64_t wPawns = gs.bitboards[0][P - 1];
-    const uint64_t bPawns = gs.bitboards[1][P - 1];
-
-    auto sidePenalty = [&](bool white) {
-        const int side = white ? 0 : 1;
-        const int kingSq = lsbSquare64(gs.bitboards[side][K - 1]);
-        const int kr = rowOfSq(kingSq);
-        const int kc = colOfSq(kingSq);
-        const uint64_t ownPawns = white ? wPawns : bPawns;
-        const uint64_t allPawns = wPawns | bPawns;
-
-        int penalty = 0;
-
-        for (int dc = -1; dc <= 1; ++dc) {
-            const int c = kc + dc;
-            if (c < 0 || c > 7) {
-                continue;
-            }
-
-            const int front1r = white ? (kr - 1) : (kr + 1);
-            const int front2r = white ? (kr - 2) : (kr + 2);
-
-            bool shield1 = false;
-            bool shield2 = false;
-
-            if (front1r >= 0 && front1r < 8) {
-                const int sq = front1r * 8 + c;
-                shield1 = (ownPawns & (1ULL << sq)) != 0;
-            }
-            if (front2r >= 0 && front2r < 8) {
-                const int sq = front2r * 8 + c;
-                shield2 = (ownPawns & (1ULL << sq)) != 0;
-            }
+    const uint64_t ownPawns = gs.bitboards[side][P - 1];
+    const int kc = colOfSq(kingSq);
+    const unsigned shelterFiles = KING_SHELTER_MASKS.files[kc];
+    const int fileCount = popcount64(shelterFiles);
 
-            if (!shield1) penalty += 14;
-            if (!shield2) penalty += 8;
+    int penalty = 0;
+    penalty += 14 * (fileCount - popcount64(ownPawns & KING_SHELTER_MASKS.front1[side][kingSq]));
+    penalty += 8 * (fileCount - popcount64(ownPawns & KING_SHELTER_MASKS.front2[side][kingSq]));
+    penalty += 10 * popcount64(shelterFiles & pawnInfo.halfOpenFiles(side));
+    penalty += 12 * popcount64(shelterFiles & pawnInfo.openFiles());
 
-            const bool ownOnFile = (ownPawns & fileMasks[c]) != 0;
-            const bool anyOnFile = (allPawns & fileMasks[c]) != 0;
-            if (!ownOnFile) penalty += 10;
-            if (!anyOnFile) penalty += 12;
-        }
+    // King exposed in center files is more vulnerable before simplification.
+    if (kc >= 3 && kc <= 4) {
+        penalty += 10;
+    }
 
-        // King exposed in center files is more vulnerable before simplification.
-        if (kc >= 3 && kc <= 4) {
-            penalty += 10;
-        }
+    pawnInfo.shelterKingSq[side] = static_cast<int8_t>(kingSq);
+    pawnInfo.shelterPenalty[side] = static_cast<int16_t>(penalty);
+    return penalty;
+}
 
-        return penalty;
-    };
+static int lightweightKingSafetyScore(const GameState& gs, PawnEvalEntry& pawnInfo, bool eg)
+{
+    if (eg) {
+        return 0;
+    }
 
-    const int whitePenalty = sidePenalty(true);
-    const int blackPenalty = sidePenalty(false);
+    const int whitePenalty = kingShelterPenalty(gs, pawnInfo, 0);
+    const int blackPenalty = kingShelterPenalty(gs, pawnInfo, 1);
     return blackPenalty - whitePenalty;
 }
 
@@ -1644,6 +2625,17 @@ static int computeMoveCoreDeltaNoKing(const GameState& gs, const Move& m)
 
 static inline void searchMakeMove(GameState& gs, const Move& m)
 {
+    // Start the child's TT (and, for pawn moves, pawn-cache) loads now so they overlap the
+    // eval delta and makeMove instead of stalling the child's first probe. makeMove takes the
+    // same keys rather than computing them again.
+    const uint64_t childKey = keyAfter(gs, m);
+    uint64_t childPawnKey = gs.pawnKey;
+    tt.prefetch(childKey);
+    if (m.capturedType() == P || pieceAtSq(gs, m.from()).type == P) {
+        childPawnKey = pawnKeyAfter(gs, m);
+        pawnEvalCache.prefetch(childPawnKey);
+    }
+
     const bool hasRoom = (ss.evalPly + 1 < static_cast<int>(ss.evalCoreNoKingStack.size()));
     if (ss.evalActive && hasRoom) {
         const int delta = computeMoveCoreDeltaNoKing(gs, m);
@@ -1653,7 +2645,7 @@ static inline void searchMakeMove(GameState& gs, const Move& m)
     } else {
         ss.evalActive = false;
     }
-    makeMove(gs, m, false);
+    makeMove(gs, m, childKey, childPawnKey, false);
 }
 
 static inline void searchUndoMove(GameState& gs)
@@ -1700,74 +2692,6 @@ static inline void undoNullMove(GameState& gs, const NullMoveState& st)
     gs.zobristKey = st.zobristKey;
 }
 
-static bool quietMoveMayGiveCheck(const GameState& gs, const Move& m, bool sideToMove)
-{
-    if (m.isCapture() || m.isPromotion()) {
-        return false;
-    }
-
-    if (m.isCastle()) {
-        return true;
-    }
-
-    const int enemy = sideToMove ? 1 : 0;
-    const uint64_t enemyKingBB = gs.bitboards[enemy][K - 1];
-    if (!enemyKingBB) {
-        return true;
-    }
-
-    const int kingSq = lsbSquare64(enemyKingBB);
-    const int kr = rowOfSq(kingSq);
-    const int kc = colOfSq(kingSq);
-    const int fromSq = m.from();
-    const int toSq = m.to();
-    const int fr = rowOfSq(fromSq);
-    const int fc = colOfSq(fromSq);
-    const int tr = rowOfSq(toSq);
-    const int tc = colOfSq(toSq);
-
-    const Piece mover = pieceAtSq(gs, fromSq);
-    switch (mover.type) {
-        case N: {
-            const int dr = std::abs(tr - kr);
-            const int dc = std::abs(tc - kc);
-            if ((dr == 1 && dc == 2) || (dr == 2 && dc == 1)) {
-                return true;
-            }
-            break;
-        }
-        case B:
-            if (std::abs(tr - kr) == std::abs(tc - kc)) {
-                return true;
-            }
-            break;
-        case R:
-            if (tr == kr || tc == kc) {
-                return true;
-            }
-            break;
-        case Q:
-            if (tr == kr || tc == kc || std::abs(tr - kr) == std::abs(tc - kc)) {
-                return true;
-            }
-            break;
-        case K:
-            if (std::max(std::abs(tr - kr), std::abs(tc - kc)) == 1) {
-                return true;
-            }
-            break;
-        default:
-            break;
-    }
-
-    // Discovered checks are only possible if the moved piece vacates a line to the enemy king.
-    if (fr == kr || fc == kc || std::abs(fr - kr) == std::abs(fc - kc)) {
-        return true;
-    }
-
-    return false;
-}
-
 static bool isKRK(const GameState& gs, bool whiteHasRook)
 {
     const int strong = whiteHasRook ? 0 : 1;
@@ -2037,7 +2961,7 @@ struct NnueStyle {
     static constexpr int FEATURES = KING_BUCKETS * PIECE_KIND * 64;
     static constexpr int HIDDEN = 48;
 
-    std::array<std::array<int16_t, HIDDEN>, FEATURES> w1{};
+    LargePageArray<std::array<int16_t, HIDDEN>> w1{ FEATURES };
     std::array<int16_t, HIDDEN> b1{};
     std::array<int16_t, HIDDEN> w2{};
     int16_t b2 = 0;
@@ -2134,7 +3058,21 @@ struct NnueStyle {
     }
 };
 
-static const NnueStyle g_nnueStyle;
+// Built by ensureSearchTablesReady() rather than at process start.
+static const NnueStyle& nnueStyle()
+{
+    static const NnueStyle net;
+    return net;
+}
+
+// Set once the net is built, so evaluate() reads a plain pointer instead of hitting the
+// function-local static's init guard on every call.
+static const NnueStyle* g_nnue = nullptr;
+
+static void ensureNnueReady()
+{
+    g_nnue = &nnueStyle();
+}
 
 static int evaluate(const GameState& gs)
 {
@@ -2148,13 +3086,16 @@ static int evaluate(const GameState& gs)
     mgScore += kingPstMiddleScore(gs);
     egScore += kingPstEndScore(gs);
 
-    int pawnStructure = 0;
-    int rookOpenFile = 0;
-    pawnEvalTerms(gs, pawnStructure, rookOpenFile);
+    PawnEvalEntry& pawnInfo = pawnEntry(gs);
+    const int pawnStructure = pawnInfo.pawnStructure;
+    const int rookOpenFile = rookOpenFileBonus(gs, pawnInfo);
     mgScore += pawnStructure;
     egScore += pawnStructure;
     mgScore += rookOpenFile;
     egScore += rookOpenFile;
+    const int outposts = outpostScore(gs, pawnInfo);
+    mgScore += outposts;
+    egScore += outposts / 2;
 
     const int bishopPair = bishopPairBonus(gs);
     mgScore += bishopPair;
@@ -2168,15 +3109,15 @@ static int evaluate(const GameState& gs)
     mgScore += loosePawns;
     egScore += loosePawns / 2;
 
-    const int whitePasserPressure = sidePasserEndgamePressure(gs, true);
-    const int blackPasserPressure = sidePasserEndgamePressure(gs, false);
+    const int whitePasserPressure = sidePasserEndgamePressure(gs, pawnInfo, true);
+    const int blackPasserPressure = sidePasserEndgamePressure(gs, pawnInfo, false);
     const int passerPressure = whitePasserPressure - blackPasserPressure;
     mgScore += passerPressure / 6;
     egScore += (passerPressure * 3) / 4;
 
     if (eg) {
-        const int whitePawnPlan = sideEndgamePawnPlanScore(gs, true);
-        const int blackPawnPlan = sideEndgamePawnPlanScore(gs, false);
+        const int whitePawnPlan = sideEndgamePawnPlanScore(gs, pawnInfo, true);
+        const int blackPawnPlan = sideEndgamePawnPlanScore(gs, pawnInfo, false);
         const int pawnPlan = whitePawnPlan - blackPawnPlan;
 
         // Increase pawn-plan priority as we approach very low non-pawn material.
@@ -2188,7 +3129,7 @@ static int evaluate(const GameState& gs)
     mgScore += mob;
     egScore += mob / 2;
 
-    const int kingSafety = lightweightKingSafetyScore(gs, false);
+    const int kingSafety = lightweightKingSafetyScore(gs, pawnInfo, false);
     mgScore += kingSafety;
 
     int openingScore = 0;
@@ -2209,7 +3150,7 @@ static int evaluate(const GameState& gs)
     mgScore += awareness;
     egScore += awareness / 2;
 
-    const int nnue = g_nnueStyle.evaluate(gs);
+    const int nnue = g_nnue->evaluate(gs);
     mgScore += (nnue * g_tuningParams.nnueMgWeight) / std::max(1, g_tuningParams.nnueWeightDiv);
     egScore += (nnue * g_tuningParams.nnueEgWeight) / std::max(1, g_tuningParams.nnueWeightDiv);
 
@@ -2287,14 +3228,14 @@ static int scoreMoveForOrdering(const GameState& gs, const Move& m, int ply, con
 
     for (int i = 0; i < MAX_KILLERS; i++)
         if (ply < MAX_PLY &&
-            m.value == ss.killers[ply][i].value)
+            m.packed() == ss.killers[ply][i])
             return 800000 - i * 100;
 
     if (ply > 0 && ply < static_cast<int>(ss.pathMoves.size())) {
         const Move& prev = ss.pathMoves[ply - 1];
         if (isValidMove(prev) && prev.from() < 64 && prev.to() < 64) {
             const int side = gs.whiteToMove ? 0 : 1;
-            if (m.value == ss.counterMoves[side][prev.from()][prev.to()].value) {
+            if (m.packed() == ss.counterMoves[side][prev.from()][prev.to()]) {
                 return 780000;
             }
         }
@@ -2316,7 +3257,8 @@ static int scoreMoveForOrdering(const GameState& gs, const Move& m, int ply, con
     return h;
 }
 
-static void sortMoves(MoveList& moves, const GameState& gs, int ply,
+template <typename MoveRange>
+static void sortMoves(MoveRange& moves, const GameState& gs, int ply,
                       const Move& ttMove)
 {
     std::sort(moves.begin(), moves.end(),
@@ -2331,7 +3273,7 @@ static void storeKiller(int ply, const Move& m)
     if (ply >= MAX_PLY) return;
     if (m.isCapture()) return;
     ss.killers[ply][1] = ss.killers[ply][0];
-    ss.killers[ply][0] = m;
+    ss.killers[ply][0] = m.packed();
 }
 
 static inline void clampHistory(int& v)
@@ -2404,177 +3346,39 @@ static void updateCounterMove(const GameState& gs, int ply, const Move& reply)
         return;
     }
     const int side = gs.whiteToMove ? 0 : 1;
-    ss.counterMoves[side][prev.from()][prev.to()] = reply;
-}
-
-static void generateTacticalLegalMoves(GameState& gs, MoveList& out)
-{
-    out.clear();
-
-    MoveList pseudo;
-    generatePseudoLegalMoves(gs, pseudo);
-    const bool sideToCheck = gs.whiteToMove;
-
-    for (int i = 0; i < pseudo.count; ++i) {
-        const Move& m = pseudo.moves[i];
-        if (!m.isCapture() && !m.isPromotion()) {
-            continue;
-        }
-
-        makeMove(gs, m, false);
-        const bool legal = !isInCheck(gs, sideToCheck);
-        undoMove(gs, false);
-
-        if (legal && out.count < static_cast<int>(out.moves.size())) {
-            out.moves[out.count++] = m;
-        }
-    }
-}
-
-static void generateQuietCheckingMoves(GameState& gs, MoveList& out)
-{
-    out.clear();
-
-    MoveList pseudo;
-    generatePseudoLegalMoves(gs, pseudo);
-    const bool sideToCheck = gs.whiteToMove;
-
-    for (int i = 0; i < pseudo.count; ++i) {
-        const Move& m = pseudo.moves[i];
-        if (m.isCapture() || m.isPromotion()) {
-            continue;
-        }
-        if (!quietMoveMayGiveCheck(gs, m, sideToCheck)) {
-            continue;
-        }
-
-        makeMove(gs, m, false);
-        const bool legal = !isInCheck(gs, sideToCheck);
-        const bool givesCheck = legal && isInCheck(gs, gs.whiteToMove);
-        undoMove(gs, false);
-
-        if (givesCheck && out.count < static_cast<int>(out.moves.size())) {
-            out.moves[out.count++] = m;
-        }
-    }
-}
-
-static inline uint64_t bitAtSq64(int sq)
-{
-    return 1ULL << sq;
-}
-
-static uint64_t attackersToSquare(const std::array<std::array<uint64_t, 6>, 2>& pieces,
-                                  uint64_t occupancy,
-                                  int targetSq,
-                                  int side)
-{
-    uint64_t attackers = 0;
-    const int tr = rowOfSq(targetSq);
-    const int tc = colOfSq(targetSq);
-
-    // Pawn attackers depend on side to move toward the target square.
-    if (side == 0) {
-        if (tr < 7 && tc > 0) {
-            const int sq = targetSq + 7;
-            if (pieces[0][P - 1] & bitAtSq64(sq)) attackers |= bitAtSq64(sq);
-        }
-        if (tr < 7 && tc < 7) {
-            const int sq = targetSq + 9;
-            if (pieces[0][P - 1] & bitAtSq64(sq)) attackers |= bitAtSq64(sq);
-        }
-    } else {
-        if (tr > 0 && tc > 0) {
-            const int sq = targetSq - 9;
-            if (pieces[1][P - 1] & bitAtSq64(sq)) attackers |= bitAtSq64(sq);
-        }
-        if (tr > 0 && tc < 7) {
-            const int sq = targetSq - 7;
-            if (pieces[1][P - 1] & bitAtSq64(sq)) attackers |= bitAtSq64(sq);
-        }
-    }
-
-    static constexpr int knightOffsets[8][2] = {
-        { -2, -1 }, { -2, 1 }, { -1, -2 }, { -1, 2 },
-        { 1, -2 },  { 1, 2 },  { 2, -1 },  { 2, 1 },
-    };
-    for (const auto& d : knightOffsets) {
-        const int nr = tr + d[0];
-        const int nc = tc + d[1];
-        if (nr < 0 || nr > 7 || nc < 0 || nc > 7) continue;
-        const int sq = nr * 8 + nc;
-        const uint64_t m = bitAtSq64(sq);
-        if (pieces[side][N - 1] & m) attackers |= m;
-    }
-
-    static constexpr int kingOffsets[8][2] = {
-        { -1, -1 }, { -1, 0 }, { -1, 1 },
-        { 0, -1 },              { 0, 1 },
-        { 1, -1 },  { 1, 0 },   { 1, 1 },
-    };
-    for (const auto& d : kingOffsets) {
-        const int nr = tr + d[0];
-        const int nc = tc + d[1];
-        if (nr < 0 || nr > 7 || nc < 0 || nc > 7) continue;
-        const int sq = nr * 8 + nc;
-        const uint64_t m = bitAtSq64(sq);
-        if (pieces[side][K - 1] & m) attackers |= m;
-    }
-
-    static constexpr int diag[4][2] = { { -1, -1 }, { -1, 1 }, { 1, -1 }, { 1, 1 } };
-    for (const auto& d : diag) {
-        int nr = tr + d[0];
-        int nc = tc + d[1];
-        while (nr >= 0 && nr < 8 && nc >= 0 && nc < 8) {
-            const int sq = nr * 8 + nc;
-            const uint64_t m = bitAtSq64(sq);
-            if (occupancy & m) {
-                if ((pieces[side][B - 1] & m) || (pieces[side][Q - 1] & m)) {
-                    attackers |= m;
-                }
-                break;
-            }
-            nr += d[0];
-            nc += d[1];
-        }
-    }
-
-    static constexpr int ortho[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
-    for (const auto& d : ortho) {
-        int nr = tr + d[0];
-        int nc = tc + d[1];
-        while (nr >= 0 && nr < 8 && nc >= 0 && nc < 8) {
-            const int sq = nr * 8 + nc;
-            const uint64_t m = bitAtSq64(sq);
-            if (occupancy & m) {
-                if ((pieces[side][R - 1] & m) || (pieces[side][Q - 1] & m)) {
-                    attackers |= m;
-                }
-                break;
-            }
-            nr += d[0];
-            nc += d[1];
-        }
-    }
-
-    return attackers;
+    ss.counterMoves[side][prev.from()][prev.to()] = reply.packed();
 }
 
-static int leastValuableAttackerSquare(const std::array<std::array<uint64_t, 6>, 2>& pieces,
-                                       int side,
-                                       uint64_t attackers,
-                                       int& pieceType)
+// Least valuable attacker of `side` among `attackers`; returns its bit and sets pieceType.
+static uint64_t leastValuableAttacker(const GameState& gs, int side, uint64_t attackers, int& pieceType)
 {
     static constexpr int order[6] = { P, N, B, R, Q, K };
     for (int pt : order) {
-        uint64_t bb = attackers & pieces[side][pt - 1];
+        const uint64_t bb = attackers & gs.bitboards[side][pt - 1];
         if (bb) {
             pieceType = pt;
-            return lsbSquare64(bb);
+            return bb & (~bb + 1);
         }
     }
     pieceType = EMPTY;
-    return -1;
+    return 0;
+}
+
+// After an attacker leaves the line to the target, sliders behind it start attacking.
+static uint64_t revealXrayAttackers(const GameState& gs, int toSq, int removedType, uint64_t occupancy)
+{
+    uint64_t revealed = 0;
+    if (removedType == P || removedType == B || removedType == Q || removedType == K) {
+        const uint64_t bishopsQueens = gs.bitboards[0][B - 1] | gs.bitboards[0][Q - 1]
+                                     | gs.bitboards[1][B - 1] | gs.bitboards[1][Q - 1];
+        revealed |= bishopAttacksFrom(toSq, occupancy) & bishopsQueens;
+    }
+    if (removedType == R || removedType == Q || removedType == K) {
+        const uint64_t rooksQueens = gs.bitboards[0][R - 1] | gs.bitboards[0][Q - 1]
+                                   | gs.bitboards[1][R - 1] | gs.bitboards[1][Q - 1];
+        revealed |= rookAttacksFrom(toSq, occupancy) & rooksQueens;
+    }
+    return revealed & occupancy;
 }
 
 static int staticExchangeEval(const GameState& gs, const Move& m)
@@ -2585,11 +3389,6 @@ static int staticExchangeEval(const GameState& gs, const Move& m)
 
     const int fromSq = m.from();
     const int toSq = m.to();
-    const uint64_t fromMask = bitAtSq64(fromSq);
-    const uint64_t toMask = bitAtSq64(toSq);
-
-    const int us = gs.whiteToMove ? 0 : 1;
-    const int them = us ^ 1;
     const Piece movingPiece = pieceAtSq(gs, fromSq);
     if (movingPiece.type == EMPTY) {
         return 0;
@@ -2603,42 +3402,32 @@ static int staticExchangeEval(const GameState& gs, const Move& m)
         return 0;
     }
 
-    std::array<std::array<uint64_t, 6>, 2> pieces = gs.bitboards;
-    uint64_t occupancy = gs.occupancyBoth;
-
-    pieces[us][movingPiece.type - 1] ^= fromMask;
-    pieces[us][m.isPromotion() ? (m.promotionType() - 1) : (movingPiece.type - 1)] |= toMask;
-    pieces[them][capturedType - 1] ^= toMask;
-    occupancy ^= fromMask;
+    uint64_t occupancy = gs.occupancyBoth ^ (1ULL << fromSq);
+    uint64_t attackers = attackersTo(gs, toSq, occupancy) & occupancy;
 
     int gain[32];
     int depth = 0;
     gain[0] = pieceValue(capturedType);
 
-    int side = them;
+    int side = gs.whiteToMove ? 1 : 0;
     int capturedOnTarget = m.isPromotion() ? m.promotionType() : movingPiece.type;
 
     while (depth < 30) {
-        const uint64_t attackers = attackersToSquare(pieces, occupancy, toSq, side);
         int attackerType = EMPTY;
-        const int attackerSq = leastValuableAttackerSquare(pieces, side, attackers, attackerType);
-        if (attackerSq < 0) {
+        const uint64_t attackerMask = leastValuableAttacker(gs, side, attackers, attackerType);
+        if (!attackerMask) {
             break;
         }
 
-        const uint64_t attackerMask = bitAtSq64(attackerSq);
-        const int other = side ^ 1;
-
         ++depth;
         gain[depth] = pieceValue(capturedOnTarget) - gain[depth - 1];
 
-        pieces[side][attackerType - 1] ^= attackerMask;
         occupancy ^= attackerMask;
-        pieces[other][capturedOnTarget - 1] ^= toMask;
-        pieces[side][attackerType - 1] |= toMask;
+        attackers ^= attackerMask;
+        attackers |= revealXrayAttackers(gs, toSq, attackerType, occupancy);
 
         capturedOnTarget = attackerType;
-        side = other;
+        side ^= 1;
     }
 
     while (depth > 0) {
@@ -2649,9 +3438,76 @@ static int staticExchangeEval(const GameState& gs, const Move& m)
     return gain[0];
 }
 
+// staticExchangeEval(gs, m) >= threshold, stopping as soon as the outcome is decided.
+static bool seeGe(const GameState& gs, const Move& m, int threshold)
+{
+    if (!m.isCapture() || m.isEnPassant()) {
+        return threshold <= 0;
+    }
+
+    const int fromSq = m.from();
+    const int toSq = m.to();
+    const Piece movingPiece = pieceAtSq(gs, fromSq);
+    int capturedType = m.capturedType();
+    if (capturedType == EMPTY) {
+        capturedType = pieceAtSq(gs, toSq).type;
+    }
+    if (movingPiece.type == EMPTY || capturedType == EMPTY) {
+        return threshold <= 0;
+    }
+
+    // swap is what the side to move is ahead of the threshold if the opponent stops now.
+    int swap = pieceValue(capturedType) - threshold;
+    if (swap < 0) {
+        return false;
+    }
+    swap = pieceValue(m.isPromotion() ? m.promotionType() : movingPiece.type) - swap;
+    if (swap <= 0) {
+        return true;
+    }
+
+    uint64_t occupancy = gs.occupancyBoth ^ (1ULL << fromSq);
+    uint64_t attackers = attackersTo(gs, toSq, occupancy) & occupancy;
+    int side = gs.whiteToMove ? 0 : 1;
+    bool result = true;
+
+    while (true) {
+        side ^= 1;
+        if (!(attackers & gs.occupancies[side])) {
+            break;
+        }
+
+        int attackerType = EMPTY;
+        const uint64_t attackerMask = leastValuableAttacker(gs, side, attackers, attackerType);
+        result = !result;
+
+        // A king may only capture last: with defenders left the recapture would be illegal.
+        if (attackerType == K) {
+            occupancy ^= attackerMask;
+            attackers ^= attackerMask;
+            attackers |= revealXrayAttackers(gs, toSq, K, occupancy);
+            return (attackers & gs.occupancies[side ^ 1]) ? !result : result;
+        }
+
+        swap = pieceValue(attackerType) - swap;
+        if (swap < static_cast<int>(result)) {
+            break;
+        }
+
+        occupancy ^= attackerMask;
+        attackers ^= attackerMask;
+        attackers |= revealXrayAttackers(gs, toSq, attackerType, occupancy);
+    }
+
+    return result;
+}
+
 static int quiescence(GameState& gs, int alpha, int beta, int ply, int qDepth)
 {
+    // Only the node budget is checked here; the clock is left to negamax's every-4096 poll.
+    if (ss.nodeLimit != 0 && ss.nodes >= ss.nodeLimit) { ss.stopped = true; return 0; }
     ss.nodes++;
+    SEARCH_STAT(qsearchNodes);
 
     int tbScore = 0;
     if (probeSyzygyWdl(gs, ply, tbScore)) {
@@ -2660,19 +3516,18 @@ static int quiescence(GameState& gs, int alpha, int beta, int ply, int qDepth)
 
     const int alphaOrig = alpha;
     const uint64_t hash = computeHash(gs);
-    TTEntry* entry = tt.probe(hash);
+    const std::optional<TTEntry> entry = tt.probe(hash);
+    SEARCH_STAT(ttProbes);
     Move ttBestMove = invalidMove();
     if (entry) {
-        ttBestMove = entry->bestMove;
+        SEARCH_STAT(ttHits);
+        ttBestMove = entry->move(gs);
         if (entry->depth <= 0) {
             const int ttScore = scoreFromTT(entry->score, ply);
-            if (entry->flag == TT_EXACT) {
-                return ttScore;
-            }
-            if (entry->flag == TT_LOWER && ttScore >= beta) {
-                return ttScore;
-            }
-            if (entry->flag == TT_UPPER && ttScore <= alpha) {
+            if (entry->flag == TT_EXACT
+                || (entry->flag == TT_LOWER && ttScore >= beta)
+                || (entry->flag == TT_UPPER && ttScore <= alpha)) {
+                SEARCH_STAT(ttCutoffs);
                 return ttScore;
             }
         }
@@ -2680,24 +3535,25 @@ static int quiescence(GameState& gs, int alpha, int beta, int ply, int qDepth)
 
     const bool inCheck = isInCheck(gs, gs.whiteToMove);
 
-    if (qDepth >= QSEARCH_MAX_DEPTH || ply >= 254) {
+    MoveArenaFrame moves;
+    if (qDepth >= QSEARCH_MAX_DEPTH || ply >= 254 || !moves.available()) {
         return evaluate(gs);
     }
 
     if (inCheck) {
-        MoveList evasions;
-        generateLegalMoves(gs, evasions);
-        if (evasions.empty()) {
+        moves.commit(generateLegalMoves(gs, moves.first));
+        if (moves.empty()) {
             return -(MATE_SCORE - ply);
         }
 
-        sortMoves(evasions, gs, ply, ttBestMove);
+        sortMoves(moves, gs, ply, ttBestMove);
 
-        for (int i = 0; i < evasions.count; ++i) {
-            Move& m = evasions.moves[i];
+        for (int i = 0; i < moves.count; ++i) {
+            Move& m = moves[i];
             searchMakeMove(gs, m);
             int score = -quiescence(gs, -beta, -alpha, ply + 1, qDepth + 1);
             searchUndoMove(gs);
+            if (ss.stopped) return 0;
 
             if (score >= beta) {
                 tt.store(hash, scoreToTT(beta, ply), 0, TT_LOWER, m);
@@ -2719,13 +3575,12 @@ static int quiescence(GameState& gs, int alpha, int beta, int ply, int qDepth)
     }
     if (stand_pat > alpha)  alpha = stand_pat;
 
-    MoveList moves;
-    generateTacticalLegalMoves(gs, moves);
+    moves.commit(generateLegalTacticalMoves(gs, moves.first));
 
     sortMoves(moves, gs, ply, ttBestMove);
 
     for (int i = 0; i < moves.count; ++i) {
-        Move& m = moves.moves[i];
+        Move& m = moves[i];
         if (m.isCapture()) {
             int captured = pieceValue(m.capturedType());
             if (captured == 0 && !m.isEnPassant()) {
@@ -2739,17 +3594,20 @@ static int quiescence(GameState& gs, int alpha, int beta, int ply, int qDepth)
 
             // Strength-first delta pruning margin to avoid dropping critical tactics.
             if (stand_pat + captured + promotionGain + g_tuningParams.qsearchDeltaMargin <= alpha) {
+                SEARCH_STAT(qsearchDeltaPrunes);
                 continue;
             }
         }
 
-        if (m.isCapture() && !m.isEnPassant() && staticExchangeEval(gs, m) < -g_tuningParams.qsearchSeeThreshold) {
+        if (m.isCapture() && !m.isEnPassant() && !seeGe(gs, m, -g_tuningParams.qsearchSeeThreshold)) {
+            SEARCH_STAT(qsearchSeePrunes);
             continue;
         }
 
         searchMakeMove(gs, m);
         int score = -quiescence(gs, -beta, -alpha, ply + 1, qDepth + 1);
         searchUndoMove(gs);
+        if (ss.stopped) return 0;
 
         if (score >= beta) {
             tt.store(hash, scoreToTT(beta, ply), 0, TT_LOWER, m);
@@ -2759,16 +3617,17 @@ static int quiescence(GameState& gs, int alpha, int beta, int ply, int qDepth)
     }
 
     if (qDepth < QSEARCH_CHECK_DEPTH) {
-        MoveList checks;
-        generateQuietCheckingMoves(gs, checks);
-        sortMoves(checks, gs, ply, ttBestMove);
+        // The capture list is finished with, so the checks reuse its slice.
+        moves.commit(generateLegalQuietChecks(gs, moves.first));
+        sortMoves(moves, gs, ply, ttBestMove);
 
-        for (int i = 0; i < checks.count; ++i) {
-            Move& m = checks.moves[i];
+        for (int i = 0; i < moves.count; ++i) {
+            Move& m = moves[i];
 
             searchMakeMove(gs, m);
             int score = -quiescence(gs, -beta, -alpha, ply + 1, qDepth + 1);
             searchUndoMove(gs);
+            if (ss.stopped) return 0;
 
             if (score >= beta) {
                 tt.store(hash, scoreToTT(beta, ply), 0, TT_LOWER, m);
@@ -2791,6 +3650,7 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
     if (ss.timeUp()) { ss.stopped = true; return 0; }
 
     ss.nodes++;
+    SEARCH_STAT(mainNodes);
 
     int tbScore = 0;
     if (probeSyzygyWdl(gs, ply, tbScore)) {
@@ -2811,7 +3671,11 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
 
     HashHistoryGuard historyGuard(hash);
 
-    TTEntry* entry = tt.probe(hash);
+    const std::optional<TTEntry> entry = tt.probe(hash);
+    SEARCH_STAT(ttProbes);
+    if (entry) {
+        SEARCH_STAT(ttHits);
+    }
     Move ttBestMove = invalidMove();
     const bool pvNode = (beta - alpha) > 1;
 
@@ -2824,28 +3688,33 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
 
     if (entry && entry->depth >= depth && ply > 0) {
         int ttScore = scoreFromTT(entry->score, ply);
-        if (entry->flag == TT_EXACT)              return ttScore;
-        if (entry->flag == TT_LOWER && ttScore >= beta) return ttScore;
-        if (entry->flag == TT_UPPER && ttScore <= alpha) return ttScore;
-        ttBestMove = entry->bestMove;
+        if (entry->flag == TT_EXACT
+            || (entry->flag == TT_LOWER && ttScore >= beta)
+            || (entry->flag == TT_UPPER && ttScore <= alpha)) {
+            SEARCH_STAT(ttCutoffs);
+            return ttScore;
+        }
+        ttBestMove = entry->move(gs);
     } else if (entry) {
-        ttBestMove = entry->bestMove;
+        ttBestMove = entry->move(gs);
     }
 
     const bool inCheck = isInCheck(gs, gs.whiteToMove);
 
     // IID: if no TT move at a deeper node, do a small pre-search to seed TT ordering.
     if (!isValidMove(ttBestMove) && depth >= 6 && !inCheck && !pvNode) {
+        SEARCH_STAT(iidSearches);
         (void)negamax(gs, depth - 2, alpha, beta, ply, false, nullptr);
         if (!ss.stopped) {
-            if (TTEntry* iidEntry = tt.probe(hash)) {
-                ttBestMove = iidEntry->bestMove;
+            if (const std::optional<TTEntry> iidEntry = tt.probe(hash)) {
+                ttBestMove = iidEntry->move(gs);
             }
         }
     }
 
     // Check extension: improve tactical accuracy in forced lines.
     if (inCheck && depth > 0 && depth < 8) {
+        SEARCH_STAT(checkExtensions);
         depth += 1;
     }
 
@@ -2858,27 +3727,35 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
     if (!inCheck) {
         staticEval = evaluate(gs);
         tacticalDanger = sideHangingDanger(gs, gs.whiteToMove);
-        passerDanger = sidePasserEndgamePressure(gs, gs.whiteToMove);
+        passerDanger = sidePasserEndgamePressure(gs, pawnEntry(gs), gs.whiteToMove);
         const bool highDanger = (tacticalDanger >= 56) || (passerDanger >= 95);
         highStrategicDanger = highDanger;
 
         if (!pvNode && !highDanger && depth == 1) {
-            if (staticEval + 120 <= alpha) return staticEval;
+            if (staticEval + 120 <= alpha) {
+                SEARCH_STAT(razorPrunes);
+                return staticEval;
+            }
         }
 
         if (!pvNode && depth <= 2) {
             const int margin = 260 + depth * 140;
             if (!highDanger && staticEval - margin >= beta) {
+                SEARCH_STAT(reverseFutilityPrunes);
                 return staticEval;
             }
         }
     }
 
-    MoveList moves;
-    generatePseudoLegalMoves(gs, moves);
+    MoveArenaFrame moves;
+    if (!moves.available()) {
+        return evaluate(gs);
+    }
+    moves.commit(generatePseudoLegalMoves(gs, moves.first));
 
     if (nullMoveAllowed && depth >= 3 && !inCheck && !highStrategicDanger && hasNonPawnMaterial(gs, gs.whiteToMove))
     {
+        SEARCH_STAT(nullMoveTries);
         const NullMoveState nullState = doNullMove(gs);
         int R = 2;
         if (depth >= 9 && staticEval >= beta + 120) {
@@ -2893,9 +3770,12 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
                 const int verify = negamax(gs, depth - 1 - R, beta - 1, beta, ply + 1, false, nullptr);
                 if (ss.stopped) return 0;
                 if (verify >= beta) {
+                    SEARCH_STAT(nullMoveCutoffs);
                     return beta;
                 }
+                SEARCH_STAT(nullMoveVerifyFails);
             } else {
+                SEARCH_STAT(nullMoveCutoffs);
                 return beta;
             }
         }
@@ -2911,9 +3791,11 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
     int quietTriedCount = 0;
     const bool useFutility = !inCheck && depth == 1 && !highStrategicDanger;
     const int futilityBase = staticEval;
+    const CheckInfo checkInfo = computeCheckInfo(gs);
+    SEARCH_STAT(expandedNodes);
 
     for (int i = 0; i < moves.count; ++i) {
-        Move& m = moves.moves[i];
+        Move& m = moves[i];
         if (excludedMove && sameMoveIdentity(m, *excludedMove)) {
             continue;
         }
@@ -2928,30 +3810,27 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
         if (ply < static_cast<int>(ss.pathMoves.size())) {
             ss.pathMoves[ply] = m;
         }
-
-        searchMakeMove(gs, m);
-        const bool legal = !isInCheck(gs, !gs.whiteToMove);
-        if (!legal) {
-            searchUndoMove(gs);
+
+        if (!checkInfo.isLegal(gs, m)) {
             continue;
         }
 
         moveCount++;
 
-        const bool givesCheck = isInCheck(gs, gs.whiteToMove);
+        // Everything up to the make works on the pre-move position, so pruned moves
+        // never pay for make/unmake.
+        const bool givesCheck = checkInfo.givesCheck(gs, m);
 
-        if (!pvNode && !inCheck && depth <= 4 && m.isCapture() && !m.isPromotion() && !givesCheck) {
-            const int see = staticExchangeEval(gs, m);
-            if (see < -120 * depth) {
-                searchUndoMove(gs);
-                continue;
-            }
+        if (!pvNode && !inCheck && depth <= 4 && m.isCapture() && !m.isPromotion() && !givesCheck
+            && !seeGe(gs, m, -120 * depth)) {
+            SEARCH_STAT(seePrunes);
+            continue;
         }
 
         if (useFutility && moveCount > 3 && quietMove && !givesCheck && quietHistory < 7000) {
             const int futilityMargin = g_tuningParams.futilityBaseMargin + depth * g_tuningParams.futilityDepthMargin;
             if (futilityBase + futilityMargin <= alpha) {
-                searchUndoMove(gs);
+                SEARCH_STAT(futilityPrunes);
                 continue;
             }
         }
@@ -2960,11 +3839,13 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
             && depth <= 3 && moveCount > (6 + depth * 5)) {
             const int lmpMargin = g_tuningParams.lmpBaseMargin + depth * g_tuningParams.lmpDepthMargin;
             if (futilityBase + lmpMargin <= alpha) {
-                searchUndoMove(gs);
+                SEARCH_STAT(lmpPrunes);
                 continue;
             }
         }
 
+        searchMakeMove(gs, m);
+
         if (quietMove && quietTriedCount < static_cast<int>(quietTried.size())) {
             quietTried[quietTriedCount++] = m;
         }
@@ -2981,6 +3862,7 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
             const int margin = g_tuningParams.singularBaseMargin + depth * g_tuningParams.singularDepthMargin;
             const int singularBeta = ttScore - margin;
             const int singularDepth = std::max(1, depth / 2);
+            SEARCH_STAT(singularTries);
 
             const int singular = negamax(gs,
                                          singularDepth,
@@ -2990,6 +3872,7 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
                                          false,
                                          &m);
             if (!ss.stopped && singular < singularBeta) {
+                SEARCH_STAT(singularExtensions);
                 extension += (depth >= 10) ? 2 : 1;
             }
         }
@@ -3002,6 +3885,7 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
         }
         extension = std::min(extension, 2);
         const int searchDepth = depth - 1 + extension;
+        SEARCH_STAT(movesSearched);
 
         int score;
         if (moveCount == 1) {
@@ -3021,15 +3905,18 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
                 const Move& prev = ss.pathMoves[ply - 1];
                 if (isValidMove(prev) && prev.from() < 64 && prev.to() < 64) {
                     const int side = gs.whiteToMove ? 0 : 1;
-                    if (m.value == ss.counterMoves[side][prev.from()][prev.to()].value && reduction > 1) {
+                    if (m.packed() == ss.counterMoves[side][prev.from()][prev.to()] && reduction > 1) {
                         reduction--;
                     }
                 }
             }
 
+            SEARCH_STAT(lmrSearches);
             score = -negamax(gs, std::max(0, searchDepth - reduction), -alpha - 1, -alpha, ply + 1, true, nullptr);
-            if (score > alpha)
+            if (score > alpha) {
+                SEARCH_STAT(lmrResearches);
                 score = -negamax(gs, searchDepth, -beta, -alpha, ply + 1, true, nullptr);
+            }
         } else {
             score = -negamax(gs, searchDepth, -alpha - 1, -alpha, ply + 1, true, nullptr);
             if (score > alpha)
@@ -3069,6 +3956,10 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
         }
 
         if (alpha >= beta) {
+            SEARCH_STAT(failHighs);
+            if (moveCount == 1) {
+                SEARCH_STAT(failHighsFirst);
+            }
             storeKiller(ply, m);
             if (quietMove) {
                 updateHistoryBonus(gs, m, depth + 1);
@@ -3096,35 +3987,197 @@ static int negamax(GameState& gs, int depth, int alpha, int beta, int ply,
     return bestScore;
 }
 
-Move computeBestMove(GameState gs, int maxDepth, int timeLimitMs)
+static Move ponderMoveAfter(GameState& gs, const Move& best, const Move& pvReply)
+{
+    if (!isValidMove(best)) {
+        return invalidMove();
+    }
+
+    makeMove(gs, best, false);
+    Move hint = pvReply;
+    if (!isValidMove(hint)) {
+        if (const std::optional<TTEntry> e = tt.probe(computeHash(gs))) {
+            hint = e->move(gs);
+        }
+    }
+
+    Move reply = invalidMove();
+    if (isValidMove(hint)) {
+        MoveList legal;
+        generateLegalMoves(gs, legal);
+        for (int i = 0; i < legal.count; ++i) {
+            if (sameMoveIdentity(legal.moves[i], hint)) {
+                reply = legal.moves[i];
+                break;
+            }
+        }
+    }
+    undoMove(gs, false);
+    return reply;
+}
+
+struct RootLine {
+    Move move = invalidMove();
+    int score = -INF;
+    std::array<Move, PV_MAX_PLY> pv{};
+    int pvLen = 1;
+};
+
+// Full moves to mate for a mate score (negative when being mated), 0 for any other score.
+static int mateInMoves(int score)
+{
+    if (std::abs(score) < MATE_SCORE - 512) {
+        return 0;
+    }
+    const int mateMoves = (std::max(1, MATE_SCORE - std::abs(score)) + 1) / 2;
+    return score < 0 ? -mateMoves : mateMoves;
+}
+
+// Legal moves of `line`'s PV from the root; lines cut short by a TT cutoff are finished
+// from the table up to `depth` plies.
+static std::vector<Move> principalVariation(const GameState& gs, int depth, const RootLine& line)
+{
+    std::vector<Move> pv;
+    if (!isValidMove(line.move)) {
+        return pv;
+    }
+    pv.push_back(line.move);
+    GameState pvState = gs;
+    makeMove(pvState, line.move, false);
+
+    auto legalMatch = [&](const Move& m) {
+        MoveList legal;
+        generateLegalMoves(pvState, legal);
+        for (int k = 0; k < legal.count; ++k) {
+            if (sameMoveIdentity(legal.moves[k], m)) {
+                return legal.moves[k];
+            }
+        }
+        return invalidMove();
+    };
+
+    const int pvEnd = std::min(line.pvLen, PV_MAX_PLY);
+    for (int j = 1; j < pvEnd && isValidMove(line.pv[j]); ++j) {
+        const Move legalMove = legalMatch(line.pv[j]);
+        if (!isValidMove(legalMove)) {
+            break;
+        }
+        pv.push_back(legalMove);
+        makeMove(pvState, legalMove, false);
+    }
+
+    // Secondary lines often end early on a TT cutoff at ply 1; finish them from the table.
+    while (static_cast<int>(pv.size()) < depth) {
+        const std::optional<TTEntry> e = tt.probe(computeHash(pvState));
+        const Move ttMove = e ? e->move(pvState) : invalidMove();
+        const Move legalMove = isValidMove(ttMove) ? legalMatch(ttMove) : invalidMove();
+        if (!isValidMove(legalMove)) {
+            break;
+        }
+        pv.push_back(legalMove);
+        makeMove(pvState, legalMove, false);
+    }
+    return pv;
+}
+
+// Emits one UCI "info" line; multiPv == 0 omits the multipv field for single-line output.
+static void printSearchInfoLine(const GameState& gs, int depth, int multiPv, const RootLine& line)
+{
+    std::string pvLine;
+    for (const Move& m : principalVariation(gs, depth, line)) {
+        if (!pvLine.empty()) {
+            pvLine += " ";
+        }
+        pvLine += moveToUciString(m);
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    int elapsedMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(now - ss.startTime).count());
+    if (elapsedMs <= 0) elapsedMs = 1;
+    const int nps = static_cast<int>((static_cast<long long>(ss.nodes) * 1000LL) / elapsedMs);
+
+    std::string info = "info depth " + std::to_string(depth);
+    if (multiPv > 0) {
+        info += " multipv " + std::to_string(multiPv);
+    }
+    if (const int mateMoves = mateInMoves(line.score); mateMoves != 0) {
+        info += " score mate " + std::to_string(mateMoves);
+    } else {
+        info += " score cp " + std::to_string(line.score);
+    }
+    info += " nodes " + std::to_string(ss.nodes) + " time " + std::to_string(elapsedMs) + " nps " + std::to_string(nps)
+        + " pv " + pvLine;
+
+    if (g_searchInfoSink) {
+        g_searchInfoSink(info);
+    } else {
+        std::cout << info << "\n";
+    }
+}
+
+static bool moveInList(const std::vector<Move>& list, const Move& m)
+{
+    for (const Move& candidate : list) {
+        if (sameMoveIdentity(candidate, m)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Move computeBestMove(GameState gs, const SearchLimits& limits)
 {
+    ensureSearchTablesReady();
     if (g_experienceLearningEnabled) {
         loadExperienceBookIfNeeded();
     }
 
-    Move bookMove = bookMoveForPosition(gs);
-    if (isValidMove(bookMove)) {
+    int maxDepth = limits.maxDepth;
+    const std::vector<Move>& searchMoves = limits.searchMoves;
+
+    // MultiPV asks for analysed lines, which a book move does not give.
+    Move bookMove = limits.useBook && g_multiPv == 1 ? bookMoveForPosition(gs) : invalidMove();
+    if (isValidMove(bookMove) && (searchMoves.empty() || moveInList(searchMoves, bookMove))) {
         recordPendingExperience(computeHash(gs), bookMove, 0);
         lastSearchStats = SearchStats {};
+        lastSearchStats.ponderMove = ponderMoveAfter(gs, bookMove, invalidMove());
+        lastSearchStats.hasPonderMove = isValidMove(lastSearchStats.ponderMove);
         return bookMove;
     }
 
     MoveList moves;
     generateLegalMoves(gs, moves);
+    if (!searchMoves.empty()) {
+        int kept = 0;
+        for (int i = 0; i < moves.count; ++i) {
+            if (moveInList(searchMoves, moves.moves[i])) {
+                moves.moves[kept++] = moves.moves[i];
+            }
+        }
+        // An unmatched searchmoves list falls back to searching every legal move.
+        if (kept > 0) {
+            moves.count = kept;
+        }
+    }
     if (moves.empty()) {
         lastSearchStats = SearchStats {};
         return invalidMove();
     }
 
-    ss.clear();
+    const std::vector<RootExperience> rootExperience = experienceForPosition(computeHash(gs));
+
+    ss.beginSearch();
     ss.startTime   = std::chrono::steady_clock::now();
-    ss.timeLimitMs = timeLimitMs;
+    ss.timeLimitMs = limits.timeLimitMs;
+    ss.nodeLimit   = limits.nodes;
     ss.hashHistory[ss.hashCount++] = computeHash(gs);
     ss.evalActive = true;
     ss.evalPly = 0;
     ss.evalCoreNoKingStack[0] = computeCoreEvalNoKing(gs);
 
-    maxDepth += phaseDepthBonus(gs);
+    if (!limits.exactDepth) {
+        maxDepth += phaseDepthBonus(gs);
+    }
     const int rootEval = evaluate(gs);
 
     Move fallbackBestMove = moves.moves[0];
@@ -3147,14 +4200,33 @@ Move computeBestMove(GameState gs, int maxDepth, int timeLimitMs)
     int  depthReached = 0;
     int  prevIterScore = 0;
     bool hasPrevIterScore = false;
+    Move bestPvReply = invalidMove();
+    RootLine bestLine;
+    std::uint64_t nodesAtLastIter = 0;
+    std::uint64_t lastIterCost = 0;
+    double effectiveBranching = 0.0;
+
+    // MultiPV: line k is searched with lines [0, k) excluded from the root move list.
+    const int lineCount = std::min(g_multiPv, moves.count);
+    std::vector<RootLine> lines(static_cast<size_t>(lineCount));
+    std::vector<RootLine> prevLines;
+
     auto searchRootWindow = [&](int depth,
                                 int alpha,
                                 int beta,
-                                Move& outBestMove,
-                                std::array<Move, PV_MAX_PLY>& outPv,
-                                int& outPvLen) -> int {
+                                int lineIdx,
+                                RootLine& out) -> int {
+        auto isExcluded = [&](const Move& m) {
+            for (int k = 0; k < lineIdx; ++k) {
+                if (sameMoveIdentity(lines[static_cast<size_t>(k)].move, m)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
         int localBestScore = -INF;
-        Move localBestMove = moves.moves[0];
+        Move localBestMove = invalidMove();
         std::array<Move, PV_MAX_PLY> localPv{};
         for (auto& pm : localPv) {
             pm = invalidMove();
@@ -3162,20 +4234,32 @@ Move computeBestMove(GameState gs, int maxDepth, int timeLimitMs)
         int localPvLen = 1;
 
         uint64_t hash = computeHash(gs);
-        TTEntry* e = tt.probe(hash);
+        const std::optional<TTEntry> e = tt.probe(hash);
         Move ttMove = invalidMove();
-        if (e && isValidMove(e->bestMove)) {
-            ttMove = e->bestMove;
+        if (lineIdx > 0) {
+            if (static_cast<int>(prevLines.size()) > lineIdx) {
+                ttMove = prevLines[static_cast<size_t>(lineIdx)].move;
+            }
+        } else if (e && e->bestMove) {
+            ttMove = e->move(gs);
         } else if (hasPrevIterScore && isValidMove(bestMove)) {
             // Reuse previous iteration's PV head to stabilize root ordering.
             ttMove = bestMove;
         }
         sortMoves(moves, gs, 0, ttMove);
-        if (g_experienceLearningEnabled) {
+        if (!rootExperience.empty()) {
             std::vector<std::pair<Move, int>> decorated;
             decorated.reserve(static_cast<size_t>(moves.count));
             for (int i = 0; i < moves.count; ++i) {
-                decorated.emplace_back(moves.moves[i], experienceMoveBias(hash, moves.moves[i]));
+                const uint16_t packed = moves.moves[i].packed();
+                int bias = 0;
+                for (const RootExperience& r : rootExperience) {
+                    if (r.move == packed) {
+                        bias = r.bias;
+                        break;
+                    }
+                }
+                decorated.emplace_back(moves.moves[i], bias);
             }
 
             std::stable_sort(decorated.begin(), decorated.end(), [](const auto& a, const auto& b) {
@@ -3188,9 +4272,17 @@ Move computeBestMove(GameState gs, int maxDepth, int timeLimitMs)
         }
 
         int localAlpha = alpha;
+        int searched = 0;
 
         for (int i = 0; i < moves.count; ++i) {
             Move& m = moves.moves[i];
+            if (lineIdx > 0 && isExcluded(m)) {
+                continue;
+            }
+            if (!isValidMove(localBestMove)) {
+                localBestMove = m;
+            }
+
             const Piece rootMover = pieceAtSq(gs, m.from());
             const bool rootHeavyMover = (rootMover.type == Q || rootMover.type == R);
             int rootSafetyMalus = 0;
@@ -3213,7 +4305,7 @@ Move computeBestMove(GameState gs, int maxDepth, int timeLimitMs)
             }
 
             int score;
-            if (i == 0) {
+            if (searched++ == 0) {
                 score = -negamax(gs, depth - 1, -beta, -localAlpha, 1, true);
             } else {
                 score = -negamax(gs, depth - 1, -localAlpha - 1, -localAlpha, 1, true);
@@ -3256,10 +4348,7 @@ Move computeBestMove(GameState gs, int maxDepth, int timeLimitMs)
             searchUndoMove(gs);
 
             if (ss.stopped) {
-                outBestMove = localBestMove;
-                outPv = localPv;
-                outPvLen = localPvLen;
-                return localBestScore;
+                break;
             }
 
             if (score > localBestScore) {
@@ -3279,116 +4368,185 @@ Move computeBestMove(GameState gs, int maxDepth, int timeLimitMs)
             }
         }
 
-        outBestMove = localBestMove;
-        outPv = localPv;
-        outPvLen = localPvLen;
+        out.move = localBestMove;
+        out.score = localBestScore;
+        out.pv = localPv;
+        out.pv[0] = localBestMove;
+        out.pvLen = localPvLen;
         return localBestScore;
     };
 
+    // Soft limit: checked between iterations and scaled by best-move stability. The hard
+    // limit stays in SearchState::timeUp and interrupts an iteration in progress.
+    const char* stopReason = "depth";
+    int bestMoveChanges = 0;
+    int stableIterations = 0;
+    double moveInstability = 0.0;
+    double timeScale = 1.0;
+    int scaledSoftMs = limits.softTimeMs;
+    auto hardStopReason = []() {
+        if (g_stopRequested.load(std::memory_order_relaxed)) return "stop";
+        if (ss.nodeLimit != 0 && ss.nodes >= ss.nodeLimit) return "nodes";
+        return "hard";
+    };
+    // After a hard stop, keep line 0's best move if it was fully searched and beat the window floor.
+    auto adoptPartialLine = [&](int lineIdx, const RootLine& line, int lineScore, int alpha) {
+        if (lineIdx != 0 || depthReached == 0 || !isValidMove(line.move)) return;
+        if (lineScore <= alpha || lineScore <= -INF) return;
+        if (!sameMoveIdentity(line.move, bestMove)) ++bestMoveChanges;
+        bestMove = line.move;
+        bestScore = lineScore;
+        bestPvReply = (line.pvLen > 1) ? line.pv[1] : invalidMove();
+        bestLine = line;
+    };
+
     for (int depth = 1; depth <= maxDepth; depth++) {
-        Move currentBest = moves.moves[0];
-        std::array<Move, PV_MAX_PLY> currentPv{};
-        for (auto& pm : currentPv) {
-            pm = invalidMove();
-        }
-        int currentPvLen = 1;
-        int currentBestScore = -INF;
+        const Move iterPrevBest = bestMove;
+        const int iterPrevScore = bestScore;
+        const long long iterStartMs = ss.clockElapsedMs();
+
+        for (int lineIdx = 0; lineIdx < lineCount; ++lineIdx) {
+            RootLine& line = lines[static_cast<size_t>(lineIdx)];
+
+            // Each line gets its own aspiration window centred on its previous score.
+            bool hasLineScore = false;
+            int lineCentre = 0;
+            if (lineIdx == 0) {
+                hasLineScore = hasPrevIterScore;
+                lineCentre = prevIterScore;
+            } else if (static_cast<int>(prevLines.size()) > lineIdx) {
+                hasLineScore = true;
+                lineCentre = prevLines[static_cast<size_t>(lineIdx)].score;
+            }
 
-        int alpha = -INF;
-        int beta = INF;
-        if (hasPrevIterScore && depth >= 3) {
-            const int delta = 22 + depth * 6;
-            alpha = std::max(-INF, prevIterScore - delta);
-            beta = std::min(INF, prevIterScore + delta);
-        }
+            int alpha = -INF;
+            int beta = INF;
+            if (hasLineScore && depth >= 3) {
+                const int delta = 22 + depth * 6;
+                alpha = std::max(-INF, lineCentre - delta);
+                beta = std::min(INF, lineCentre + delta);
+            }
 
-        currentBestScore = searchRootWindow(depth, alpha, beta, currentBest, currentPv, currentPvLen);
-        if (ss.stopped) goto done;
+            int lineScore = searchRootWindow(depth, alpha, beta, lineIdx, line);
+            if (ss.stopped) {
+                stopReason = hardStopReason();
+                adoptPartialLine(lineIdx, line, lineScore, alpha);
+                goto done;
+            }
 
-        if (hasPrevIterScore && depth >= 3 && (currentBestScore <= alpha || currentBestScore >= beta)) {
-            int widen = 64;
-            for (int tries = 0; tries < 4; ++tries) {
-                if (currentBestScore <= alpha) {
-                    alpha = std::max(-INF, alpha - widen);
-                }
-                if (currentBestScore >= beta) {
-                    beta = std::min(INF, beta + widen);
-                }
+            if (hasLineScore && depth >= 3 && (lineScore <= alpha || lineScore >= beta)) {
+                int widen = 64;
+                for (int tries = 0; tries < 4; ++tries) {
+                    if (lineScore <= alpha) {
+                        alpha = std::max(-INF, alpha - widen);
+                    }
+                    if (lineScore >= beta) {
+                        beta = std::min(INF, beta + widen);
+                    }
+
+                    lineScore = searchRootWindow(depth, alpha, beta, lineIdx, line);
+                    if (ss.stopped) {
+                        stopReason = hardStopReason();
+                        adoptPartialLine(lineIdx, line, lineScore, alpha);
+                        goto done;
+                    }
 
-                currentBestScore = searchRootWindow(depth, alpha, beta, currentBest, currentPv, currentPvLen);
-                if (ss.stopped) goto done;
+                    if (lineScore > alpha && lineScore < beta) {
+                        break;
+                    }
 
-                if (currentBestScore > alpha && currentBestScore < beta) {
-                    break;
+                    widen *= 2;
                 }
+            }
 
-                widen *= 2;
+            if (lineIdx == 0) {
+                bestMove  = line.move;
+                bestScore = lineScore;
+                depthReached = depth;
+                prevIterScore = bestScore;
+                hasPrevIterScore = true;
+                bestPvReply = (line.pvLen > 1) ? line.pv[1] : invalidMove();
+                bestLine = line;
             }
         }
 
-        bestMove  = currentBest;
-        bestScore = currentBestScore;
-        depthReached = depth;
-        prevIterScore = bestScore;
-        hasPrevIterScore = true;
-
-        if (g_searchInfoOutputEnabled) {
-            std::string pvLine = moveToUciString(currentBest);
-            {
-                GameState pvState = gs;
-                makeMove(pvState, currentBest, false);
-
-                const int pvEnd = std::min(currentPvLen, PV_MAX_PLY);
-                for (int j = 1; j < pvEnd; ++j) {
-                    const Move& pm = currentPv[j];
-                    if (!isValidMove(pm)) {
-                        break;
-                    }
+        if (lineCount > 1) {
+            // A later line can outscore an earlier one after its own re-search; keep them ordered.
+            std::stable_sort(lines.begin(), lines.end(), [](const RootLine& a, const RootLine& b) {
+                return a.score > b.score;
+            });
+            bestMove = lines[0].move;
+            bestScore = lines[0].score;
+            prevIterScore = bestScore;
+            bestPvReply = (lines[0].pvLen > 1) ? lines[0].pv[1] : invalidMove();
+            bestLine = lines[0];
+        }
+        prevLines = lines;
 
-                    MoveList legal;
-                    generateLegalMoves(pvState, legal);
-                    bool found = false;
-                    Move legalMove = invalidMove();
-                    for (int k = 0; k < legal.count; ++k) {
-                        if (sameMoveIdentity(legal.moves[k], pm)) {
-                            found = true;
-                            legalMove = legal.moves[k];
-                            break;
-                        }
-                    }
+        {
+            // Effective branching factor: growth of iteration cost from one depth to the next.
+            const std::uint64_t iterCost = ss.nodes - nodesAtLastIter;
+            if (lastIterCost > 0 && iterCost > 0) {
+                effectiveBranching = static_cast<double>(iterCost) / static_cast<double>(lastIterCost);
+            }
+            lastIterCost = iterCost;
+            nodesAtLastIter = ss.nodes;
+        }
 
-                    if (!found) {
-                        break;
-                    }
+        if (g_searchInfoOutputEnabled) {
+            for (int lineIdx = 0; lineIdx < lineCount; ++lineIdx) {
+                printSearchInfoLine(gs, depth, lineCount > 1 ? lineIdx + 1 : 0, lines[static_cast<size_t>(lineIdx)]);
+            }
+        }
 
-                    pvLine += " ";
-                    pvLine += moveToUciString(legalMove);
-                    makeMove(pvState, legalMove, false);
-                }
+        if (limits.mateInMoves > 0 && bestScore >= MATE_SCORE - 512) {
+            const int matePlies = std::max(1, MATE_SCORE - bestScore);
+            if ((matePlies + 1) / 2 <= limits.mateInMoves) {
+                stopReason = "mate";
+                break;
             }
+        }
 
-            auto now = std::chrono::steady_clock::now();
-            int elapsedMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(now - ss.startTime).count());
-            if (elapsedMs <= 0) elapsedMs = 1;
-            const int nps = static_cast<int>((static_cast<long long>(ss.nodes) * 1000LL) / elapsedMs);
+        const bool bestChanged = depth > 1 && !sameMoveIdentity(bestMove, iterPrevBest);
+        if (bestChanged) {
+            ++bestMoveChanges;
+            stableIterations = 0;
+        } else if (depth > 1) {
+            ++stableIterations;
+        }
+        moveInstability = moveInstability * 0.5 + (bestChanged ? 1.0 : 0.0);
 
-            auto isMateScore = [](int s) {
-                return std::abs(s) >= (MATE_SCORE - 512);
-            };
+        if (limits.softTimeMs > 0 && !g_ponderActive.load(std::memory_order_acquire)) {
+            if (moves.count == 1) {
+                stopReason = "single";
+                break;
+            }
 
-            std::cout << "info depth " << depth;
-            if (isMateScore(bestScore)) {
-                int matePlies = std::max(1, MATE_SCORE - std::abs(bestScore));
-                int mateMoves = (matePlies + 1) / 2;
-                if (bestScore < 0) mateMoves = -mateMoves;
-                std::cout << " score mate " << mateMoves;
-            } else {
-                std::cout << " score cp " << bestScore;
+            // Spend more while the best move keeps changing or the score is falling, less once it settles.
+            timeScale = 1.0 + 0.6 * moveInstability;
+            if (stableIterations >= 3) {
+                timeScale *= std::max(0.55, 1.0 - 0.1 * (stableIterations - 2));
+            }
+            if (depth > 1) {
+                const int scoreDrop = iterPrevScore - bestScore;
+                timeScale *= std::clamp(1.0 + scoreDrop / 150.0, 1.0, 1.6);
+            }
+            timeScale = std::clamp(timeScale, 0.4, 2.5);
+            scaledSoftMs = std::min(ss.hardLimitMs(),
+                                    static_cast<int>(limits.softTimeMs * timeScale));
+
+            const long long elapsedMs = ss.clockElapsedMs();
+            const long long iterMs = std::max(0LL, elapsedMs - iterStartMs);
+            const double growth = effectiveBranching > 0.0 ? std::clamp(effectiveBranching, 1.5, 6.0) : 2.5;
+            if (elapsedMs >= scaledSoftMs) {
+                stopReason = "soft";
+                break;
+            }
+            // Don't start an iteration that is not expected to finish before the soft limit.
+            if (elapsedMs + static_cast<long long>(iterMs * growth) > scaledSoftMs) {
+                stopReason = "predicted";
+                break;
             }
-            std::cout << " nodes " << ss.nodes
-                      << " time " << elapsedMs
-                      << " nps " << nps
-                      << " pv " << pvLine << "\n";
         }
     }
 
@@ -3409,10 +4567,35 @@ done:
         lastSearchStats.bestScore = bestScore;
         lastSearchStats.timeMs = elapsedMs;
         lastSearchStats.nps = static_cast<double>(ss.nodes) * 1000.0 / static_cast<double>(elapsedMs);
+        lastSearchStats.effectiveBranching = effectiveBranching;
+        lastSearchStats.countersEnabled = ENGINE_SEARCH_STATS != 0;
+        lastSearchStats.counters = ss.counters;
+        lastSearchStats.ponderMove = ponderMoveAfter(gs, bestMove, bestPvReply);
+        lastSearchStats.hasPonderMove = isValidMove(lastSearchStats.ponderMove);
+        lastSearchStats.softLimitMs = limits.softTimeMs;
+        lastSearchStats.scaledSoftLimitMs = scaledSoftMs;
+        lastSearchStats.hardLimitMs = ss.hardLimitMs();
+        lastSearchStats.timeScale = timeScale;
+        lastSearchStats.bestMoveChanges = bestMoveChanges;
+        lastSearchStats.stopReason = stopReason;
+        if (!sameMoveIdentity(bestLine.move, bestMove)) {
+            bestLine = RootLine {};
+            bestLine.move = bestMove;
+        }
+        lastSearchStats.pv = principalVariation(gs, depthReached, bestLine);
+        lastSearchStats.mateIn = mateInMoves(bestScore);
     }
     return bestMove;
 }
 
+Move computeBestMove(GameState gs, int maxDepth, int timeLimitMs)
+{
+    SearchLimits limits;
+    limits.maxDepth = maxDepth;
+    limits.timeLimitMs = timeLimitMs;
+    return computeBestMove(gs, limits);
+}
+
 Move computeBestMove(GameState gs, int depth)
 {
     return computeBestMove(gs, depth, 600000);
@@ -3423,6 +4606,63 @@ SearchStats getLastSearchStats()
     return lastSearchStats;
 }
 
+std::string formatSearchCounters(const SearchStats& stats)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "stats depth " << stats.depthReached
+        << " nodes " << stats.nodes
+        << " ebf " << stats.effectiveBranching;
+    if (!stats.countersEnabled) {
+        out << " counters off";
+        return out.str();
+    }
+
+    const SearchCounters& c = stats.counters;
+    auto pct = [](std::uint64_t part, std::uint64_t whole) {
+        return whole ? (100.0 * static_cast<double>(part) / static_cast<double>(whole)) : 0.0;
+    };
+    auto ratio = [](std::uint64_t part, std::uint64_t whole) {
+        return whole ? (static_cast<double>(part) / static_cast<double>(whole)) : 0.0;
+    };
+
+    out << " qnodes% " << pct(c.qsearchNodes, c.mainNodes + c.qsearchNodes)
+        << " tthit% " << pct(c.ttHits, c.ttProbes)
+        << " ttcut% " << pct(c.ttCutoffs, c.ttProbes)
+        << " fhfirst% " << pct(c.failHighsFirst, c.failHighs)
+        << " avgbf " << ratio(c.movesSearched, c.expandedNodes)
+        << " null " << c.nullMoveCutoffs << "/" << c.nullMoveTries
+        << " nullverifyfail " << c.nullMoveVerifyFails
+        << " razor " << c.razorPrunes
+        << " rfp " << c.reverseFutilityPrunes
+        << " fut " << c.futilityPrunes
+        << " lmp " << c.lmpPrunes
+        << " see " << c.seePrunes
+        << " lmr " << c.lmrSearches
+        << " lmrre% " << pct(c.lmrResearches, c.lmrSearches)
+        << " checkext " << c.checkExtensions
+        << " singular " << c.singularExtensions << "/" << c.singularTries
+        << " iid " << c.iidSearches
+        << " qdelta " << c.qsearchDeltaPrunes
+        << " qsee " << c.qsearchSeePrunes;
+    return out.str();
+}
+
+std::string formatTimeUsage(const SearchStats& stats)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "time used " << stats.timeMs
+        << " soft " << stats.softLimitMs
+        << " scaled " << stats.scaledSoftLimitMs
+        << " hard " << stats.hardLimitMs
+        << " scale " << stats.timeScale
+        << " changes " << stats.bestMoveChanges
+        << " depth " << stats.depthReached
+        << " stop " << (stats.stopReason.empty() ? "book" : stats.stopReason);
+    return out.str();
+}
+
 void requestStopSearch()
 {
     g_stopRequested.store(true, std::memory_order_relaxed);
@@ -3433,16 +4673,210 @@ void clearStopSearch()
     g_stopRequested.store(false, std::memory_order_relaxed);
 }
 
+void setPondering(bool active)
+{
+    g_ponderHitLimitMs.store(-1, std::memory_order_relaxed);
+    g_ponderActive.store(active, std::memory_order_release);
+}
+
+void ponderHit(int timeLimitMs)
+{
+    // Keep the running search and its tables; only arm the clock from this moment.
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    g_ponderHitAtNs.store(static_cast<long long>(now.count()), std::memory_order_relaxed);
+    g_ponderHitLimitMs.store(std::max(1, timeLimitMs), std::memory_order_relaxed);
+    g_ponderActive.store(false, std::memory_order_release);
+}
+
+bool isPondering()
+{
+    return g_ponderActive.load(std::memory_order_acquire);
+}
+
 void setHashSizeMb(int mb)
 {
     tt.resizeMb(mb);
 }
 
+void setHashShared(bool shared)
+{
+    tt.setShared(shared);
+}
+
+void clearHash()
+{
+    if (tt.table.size() > 0) {
+        tt.clear();
+    }
+}
+
 int getHashSizeMb()
 {
     return tt.hashMb;
 }
 
+// On-disk TT image: a fixed header followed by the raw entries. The header carries its own
+// checksum and one over the payload, so a truncated or foreign file is rejected before use.
+struct HashFileHeader {
+    char magic[8] = { 'I', 'K', 'S', 'H', 'T', 'T', '0', '1' };
+    uint32_t version = 2;   // 2: entries store key ^ data
+    uint32_t entrySize = sizeof(TTSlot);
+    uint64_t entryCount = 0;
+    int32_t hashMb = 0;
+    uint32_t reserved = 0;
+    uint64_t payloadChecksum = 0;
+    uint64_t headerChecksum = 0;
+};
+static_assert(sizeof(HashFileHeader) == 48);
+
+static constexpr size_t HASH_FILE_CHUNK_BYTES = 4 * 1024 * 1024;
+
+static uint64_t checksumWords(uint64_t h, const void* data, size_t bytes)
+{
+    const auto* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i + 8 <= bytes; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+static uint64_t headerChecksum(const HashFileHeader& h)
+{
+    return checksumWords(0xCBF29CE484222325ULL, &h, offsetof(HashFileHeader, headerChecksum));
+}
+
+bool saveHashFile(const std::string& path)
+{
+    tt.ensureAllocated();
+    HashFileHeader header;
+    header.entryCount = tt.table.size();
+    header.hashMb = tt.hashMb;
+
+    // Stream into a sibling temp file and rename, so an interrupted save keeps the old image.
+    const std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const char* data = reinterpret_cast<const char*>(tt.table.data());
+    const size_t total = tt.table.size() * sizeof(TTSlot);
+    uint64_t sum = 0;
+    for (size_t off = 0; off < total && out; off += HASH_FILE_CHUNK_BYTES) {
+        const size_t n = std::min(HASH_FILE_CHUNK_BYTES, total - off);
+        sum = checksumWords(sum, data + off, n);
+        out.write(data + off, static_cast<std::streamsize>(n));
+    }
+
+    header.payloadChecksum = sum;
+    header.headerChecksum = headerChecksum(header);
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        std::filesystem::remove(tmpPath);
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    return !ec;
+}
+
+bool loadHashFile(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+
+    HashFileHeader header;
+    const HashFileHeader expected;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0
+        || header.version != expected.version
+        || header.entrySize != expected.entrySize
+        || header.headerChecksum != headerChecksum(header)) {
+        return false;
+    }
+
+    std::error_code ec;
+    const uint64_t payloadBytes = header.entryCount * sizeof(TTSlot);
+    if (std::filesystem::file_size(path, ec) != sizeof(header) + payloadBytes || ec) {
+        return false;
+    }
+
+    tt.resizeMb(header.hashMb);
+    tt.ensureAllocated();
+    if (tt.table.size() != header.entryCount) {
+        return false;
+    }
+
+    char* data = reinterpret_cast<char*>(tt.table.data());
+    uint64_t sum = 0;
+    for (size_t off = 0; off < payloadBytes; off += HASH_FILE_CHUNK_BYTES) {
+        const size_t n = std::min<size_t>(HASH_FILE_CHUNK_BYTES, payloadBytes - off);
+        if (!in.read(data + off, static_cast<std::streamsize>(n))) {
+            tt.clear();
+            return false;
+        }
+        sum = checksumWords(sum, data + off, n);
+    }
+
+    if (sum != header.payloadChecksum) {
+        tt.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ensureSearchTablesReady()
+{
+    const bool pending = tt.table.size() == 0 || pawnEvalCache.table.size() == 0 || g_nnue == nullptr;
+    tt.ensureAllocated();
+    pawnEvalCache.ensureAllocated();
+    ensureNnueReady();
+    return pending;
+}
+
+std::string getLargePageReport()
+{
+    std::ostringstream out;
+    auto mode = [](const auto& array) { return array.size() > 0 ? pageModeName(array.mode()) : "lazy"; };
+    out << "pages tt " << mode(tt.table)
+        << " pawn " << mode(pawnEvalCache.table)
+        << " net " << (g_nnue != nullptr ? pageModeName(g_nnue->w1.mode()) : "lazy");
+    return out.str();
+}
+
+std::string getStartupReport()
+{
+    // Times each lazily built component in the order a first search would touch them.
+    std::ostringstream out;
+    auto timed = [&](const char* name, auto&& build) {
+        const auto start = std::chrono::steady_clock::now();
+        build();
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        out << " " << name << " " << (us / 1000.0) << "ms";
+    };
+    out << std::fixed << std::setprecision(1) << "init";
+    timed("tt", [] { tt.ensureAllocated(); });
+    timed("pawn", [] { pawnEvalCache.ensureAllocated(); });
+    timed("net", [] { ensureNnueReady(); });
+    timed("book", [] {
+        if (binaryBook().size() == 0) {
+            openingBook();
+        }
+    });
+    timed("experience", [] { loadExperienceBookIfNeeded(); });
+    return out.str();
+}
+
 void setTuningParams(const EngineTuningParams& p)
 {
     EngineTuningParams c = p;
@@ -3486,6 +4920,21 @@ int getSyzygyProbeLimit()
     return g_syzygyProbeLimit;
 }
 
+void clearSearchHistory()
+{
+    ss.clearHistory();
+}
+
+void setMultiPv(int lines)
+{
+    g_multiPv = std::clamp(lines, 1, MAX_MULTI_PV);
+}
+
+int getMultiPv()
+{
+    return g_multiPv;
+}
+
 void setSearchInfoOutputEnabled(bool enabled)
 {
     g_searchInfoOutputEnabled = enabled;
@@ -3496,6 +4945,11 @@ bool isSearchInfoOutputEnabled()
     return g_searchInfoOutputEnabled;
 }
 
+void setSearchInfoSink(std::function<void(const std::string&)> sink)
+{
+    g_searchInfoSink = std::move(sink);
+}
+
 void learningStartGame()
 {
     if (!g_experienceLearningEnabled) {
@@ -3522,39 +4976,33 @@ void learningFinalizeGame()
         return;
     }
     loadExperienceBookIfNeeded();
-    bool hadPending = false;
-
-    {
-        std::lock_guard<std::mutex> lock(g_experienceMutex);
-        for (const auto& [_, vec] : g_pendingExperience) {
-            if (!vec.empty()) {
-                hadPending = true;
-                break;
-            }
-        }
-
-        if (!hadPending) {
-            g_learningGameActive = false;
-            return;
-        }
 
-        for (const auto& [hash, vec] : g_pendingExperience) {
-            for (const auto& e : vec) {
-                if (!isValidMove(e.move) || e.visits <= 0) {
-                    continue;
-                }
-                // Replay each visit as one update to preserve averaging behavior.
-                const int avg = e.sumScore / std::max(1, e.visits);
-                for (int i = 0; i < e.visits; ++i) {
-                    updateExperienceBookEntry(hash, e.move, avg);
-                }
+    std::lock_guard<std::mutex> lock(g_experienceMutex);
+    // Each pending visit counts at the game's average score for that move.
+    std::vector<ExperienceRecord> records;
+    for (const auto& [hash, vec] : g_pendingExperience) {
+        for (const auto& e : vec) {
+            if (!isValidMove(e.move) || e.visits <= 0) {
+                continue;
             }
+            const int avg = e.sumScore / e.visits;
+            const int64_t sum = static_cast<int64_t>(avg) * e.visits;
+            records.push_back({ hash, e.move.packed(), static_cast<uint16_t>(e.visits),
+                                static_cast<int32_t>(std::clamp<int64_t>(sum, -EXPERIENCE_MAX_SUM, EXPERIENCE_MAX_SUM)) });
         }
-        g_pendingExperience.clear();
-        g_learningGameActive = false;
+    }
+    g_pendingExperience.clear();
+    g_learningGameActive = false;
+    if (records.empty()) {
+        return;
     }
 
-    saveExperienceBook();
+    normalizeExperienceRecords(records);
+    ExperienceFileLock fileLock;
+    appendExperienceLog(records);
+    pushExperienceSegment(std::move(records));
+    publishExperienceSnapshot();
+    maybeStartExperienceCompaction();
 }
 
 void setExperienceLearningEnabled(bool enabled)
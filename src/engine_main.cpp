@@ -0,0 +1,6 @@
+#include "../include/uci.hpp"
+
+int main(int argc, char** argv)
+{
+    return runHeadless(argc, argv);
+}
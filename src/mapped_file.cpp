@@ -0,0 +1,44 @@
+#include "../include/mapped_file.hpp"
+
+#include <fstream>
+#include <iterator>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path)
+{
+#if defined(__linux__)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            size_ = static_cast<size_t>(st.st_size);
+            data_ = static_cast<const unsigned char*>(p);
+        }
+    }
+    ::close(fd);
+#else
+    std::ifstream in(path, std::ios::binary);
+    buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data_ = reinterpret_cast<const unsigned char*>(buffer_.data());
+    size_ = buffer_.size();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(__linux__)
+    if (data_) {
+        ::munmap(const_cast<unsigned char*>(data_), size_);
+    }
+#endif
+}
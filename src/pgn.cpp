@@ -0,0 +1,308 @@
+#include "../include/pgn.hpp"
+#include "../include/mapped_file.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <thread>
+
+namespace {
+
+bool isSpace(char c)
+{
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+bool endsSymbol(char c)
+{
+    return isSpace(c) || c == '{' || c == '}' || c == '(' || c == ')' || c == ';' || c == '[' || c == ']';
+}
+
+std::string_view tagName(std::string_view tag)
+{
+    size_t end = 0;
+    while (end < tag.size() && !isSpace(tag[end]) && tag[end] != '"') {
+        ++end;
+    }
+    return tag.substr(0, end);
+}
+
+std::string_view tagValue(std::string_view tag)
+{
+    const size_t open = tag.find('"');
+    if (open == std::string_view::npos) {
+        return {};
+    }
+    size_t close = open + 1;
+    while (close < tag.size() && tag[close] != '"') {
+        close += (tag[close] == '\\') ? 2 : 1;
+    }
+    return tag.substr(open + 1, std::min(close, tag.size()) - open - 1);
+}
+
+// First tag line at or after `from` that follows a blank line, i.e. the start of a game's
+// tag section; text.size() if there is none.
+size_t nextGameStart(std::string_view text, size_t from)
+{
+    size_t pos = text.find('\n', from);
+    bool previousBlank = false;
+    while (pos != std::string_view::npos && pos < text.size()) {
+        const size_t lineStart = pos + 1;
+        size_t first = lineStart;
+        while (first < text.size() && (text[first] == ' ' || text[first] == '\t' || text[first] == '\r')) {
+            ++first;
+        }
+        if (first < text.size() && text[first] == '[' && previousBlank) {
+            return lineStart;
+        }
+        previousBlank = first >= text.size() || text[first] == '\n';
+        pos = text.find('\n', lineStart);
+    }
+    return text.size();
+}
+
+} // namespace
+
+bool PgnTokenizer::next(PgnToken& token)
+{
+    const size_t n = text_.size();
+    while (pos_ < n) {
+        const char c = text_[pos_];
+        if (isSpace(c)) {
+            ++pos_;
+            continue;
+        }
+        // A '%' in the first column escapes the whole line.
+        if (c == '%' && (pos_ == 0 || text_[pos_ - 1] == '\n')) {
+            const size_t eol = text_.find('\n', pos_);
+            pos_ = eol == std::string_view::npos ? n : eol + 1;
+            continue;
+        }
+
+        const size_t start = pos_;
+        switch (c) {
+            case '[': {
+                // Brackets inside a quoted value do not close the tag.
+                size_t i = start + 1;
+                bool quoted = false;
+                for (; i < n && (quoted || text_[i] != ']'); ++i) {
+                    if (text_[i] == '\\' && quoted) {
+                        ++i;
+                    } else if (text_[i] == '"') {
+                        quoted = !quoted;
+                    }
+                }
+                token = { PgnTokenType::Tag, text_.substr(start + 1, std::min(i, n) - start - 1) };
+                pos_ = std::min(i + 1, n);
+                return true;
+            }
+            case '{': {
+                const size_t close = text_.find('}', start);
+                const size_t end = close == std::string_view::npos ? n : close;
+                token = { PgnTokenType::Comment, text_.substr(start + 1, end - start - 1) };
+                pos_ = std::min(end + 1, n);
+                return true;
+            }
+            case ';': {
+                const size_t eol = text_.find('\n', start);
+                const size_t end = eol == std::string_view::npos ? n : eol;
+                token = { PgnTokenType::Comment, text_.substr(start + 1, end - start - 1) };
+                pos_ = end;
+                return true;
+            }
+            case '(':
+                token = { PgnTokenType::VariationStart, text_.substr(start, 1) };
+                ++pos_;
+                return true;
+            case ')':
+                token = { PgnTokenType::VariationEnd, text_.substr(start, 1) };
+                ++pos_;
+                return true;
+            case ']':
+            case '}':
+                ++pos_;   // stray closer
+                continue;
+            default:
+                break;
+        }
+
+        if (c == '$') {
+            size_t i = start + 1;
+            while (i < n && isDigit(text_[i])) ++i;
+            token = { PgnTokenType::Nag, text_.substr(start, i - start) };
+            pos_ = i;
+            return true;
+        }
+
+        // "12." / "12..." is a move number even when glued to the SAN that follows it.
+        if (isDigit(c)) {
+            size_t i = start;
+            while (i < n && isDigit(text_[i])) ++i;
+            if (i < n && text_[i] == '.') {
+                while (i < n && text_[i] == '.') ++i;
+                token = { PgnTokenType::MoveNumber, text_.substr(start, i - start) };
+                pos_ = i;
+                return true;
+            }
+        }
+
+        size_t i = start;
+        while (i < n && !endsSymbol(text_[i])) ++i;
+        const std::string_view sym = text_.substr(start, i - start);
+        pos_ = i;
+        const bool result = sym == "1-0" || sym == "0-1" || sym == "1/2-1/2" || sym == "*";
+        token = { result ? PgnTokenType::Result : PgnTokenType::Symbol, sym };
+        return true;
+    }
+    return false;
+}
+
+void PgnGame::clear()
+{
+    tags.clear();
+    fen = {};
+    result = {};
+    moves.clear();
+    complete = true;
+}
+
+void forEachPgnGame(std::string_view text, const std::function<void(const PgnGame&)>& onGame)
+{
+    GameState gs;
+    gs.initStandard();
+    PgnGame game;
+    bool inGame = false;
+    bool skipGame = false;
+    bool badFen = false;   // the FEN tag could not be read, so no move can be replayed
+    int variationDepth = 0;
+
+    const auto finishGame = [&] {
+        if (!inGame && game.moves.empty()) {
+            return;
+        }
+        game.complete = !skipGame && !badFen;
+        onGame(game);
+        game.clear();
+        inGame = false;
+        skipGame = false;
+        badFen = false;
+        variationDepth = 0;
+        gs.initStandard();
+    };
+
+    PgnTokenizer tokens(text);
+    PgnToken token;
+    while (tokens.next(token)) {
+        switch (token.type) {
+            case PgnTokenType::Tag: {
+                if (variationDepth > 0) {
+                    break;
+                }
+                // A tag after movetext without a result token starts the next game.
+                if (!game.moves.empty() || skipGame) {
+                    finishGame();
+                }
+                inGame = true;
+                const std::string_view name = tagName(token.text);
+                const std::string_view value = tagValue(token.text);
+                game.tags.emplace_back(name, value);
+                if (name == "Result") {
+                    game.result = value;
+                } else if (name == "FEN" && !value.empty()) {
+                    game.fen = value;
+                    badFen = !parseFen(value, gs);
+                }
+                break;
+            }
+            case PgnTokenType::VariationStart:
+                ++variationDepth;
+                break;
+            case PgnTokenType::VariationEnd:
+                variationDepth = std::max(0, variationDepth - 1);
+                break;
+            case PgnTokenType::Result:
+                if (variationDepth > 0) {
+                    break;
+                }
+                if (game.result.empty()) {
+                    game.result = token.text;
+                }
+                finishGame();
+                break;
+            case PgnTokenType::Symbol: {
+                if (variationDepth > 0 || skipGame) {
+                    break;
+                }
+                inGame = true;
+                Move m;
+                if (badFen || !parseSanMove(gs, token.text, m)) {
+                    // Keep the moves read so far; the rest of this game cannot be replayed.
+                    skipGame = true;
+                    break;
+                }
+                game.moves.push_back(m);
+                makeMove(gs, m, false);
+                break;
+            }
+            case PgnTokenType::MoveNumber:
+            case PgnTokenType::Nag:
+            case PgnTokenType::Comment:
+                break;
+        }
+    }
+    finishGame();
+}
+
+PgnReadStats readPgnFile(const std::string& path, int threads,
+                         const std::function<void(int, const PgnGame&)>& onGame)
+{
+    const MappedFile file(path);
+    const std::string_view text = file.text();
+
+    // Slices of at least 1 MB, so small files are read on the calling thread only.
+    constexpr size_t MIN_SLICE_BYTES = 1 << 20;
+    const size_t maxSlices = std::max<size_t>(1, text.size() / MIN_SLICE_BYTES);
+    const size_t sliceCount = std::clamp<size_t>(static_cast<size_t>(std::max(1, threads)), 1, maxSlices);
+    std::vector<size_t> bounds { 0 };
+    for (size_t k = 1; k < sliceCount; ++k) {
+        const size_t cut = nextGameStart(text, std::max(bounds.back(), text.size() * k / sliceCount));
+        if (cut < text.size()) {
+            bounds.push_back(cut);
+        }
+    }
+    bounds.push_back(text.size());
+
+    std::vector<PgnReadStats> perSlice(bounds.size() - 1);
+    const auto readSlice = [&](int k) {
+        PgnReadStats& stats = perSlice[static_cast<size_t>(k)];
+        stats.bytes = bounds[k + 1] - bounds[k];
+        forEachPgnGame(text.substr(bounds[k], stats.bytes), [&](const PgnGame& game) {
+            ++stats.games;
+            stats.moves += game.moves.size();
+            stats.incomplete += game.complete ? 0 : 1;
+            onGame(k, game);
+        });
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t k = 1; k < perSlice.size(); ++k) {
+        workers.emplace_back(readSlice, static_cast<int>(k));
+    }
+    readSlice(0);
+    for (std::thread& t : workers) {
+        t.join();
+    }
+
+    PgnReadStats total;
+    for (const PgnReadStats& s : perSlice) {
+        total.games += s.games;
+        total.moves += s.moves;
+        total.incomplete += s.incomplete;
+        total.bytes += s.bytes;
+    }
+    return total;
+}
@@ -0,0 +1,2323 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../include/chess.hpp"
+#include "../include/engine.hpp"
+#include "../include/mapped_file.hpp"
+#include "../include/pgn.hpp"
+#include "../include/uci.hpp"
+
+static int parseSquare(const std::string& s)
+{
+    if (s.size() != 2) return -1;
+    const int file = s[0] - 'a';
+    const int rank = s[1] - '1';
+    if (file < 0 || file > 7 || rank < 0 || rank > 7) return -1;
+    const int row = 7 - rank;
+    return row * 8 + file;
+}
+
+static std::string squareToUci(int sq)
+{
+    const int row = sq / 8;
+    const int col = sq % 8;
+    std::string out;
+    out.push_back(static_cast<char>('a' + col));
+    out.push_back(static_cast<char>('8' - row));
+    return out;
+}
+
+static std::string moveToUci(const Move& m)
+{
+    if (m.value == 0xFFFFFFFFu) {
+        return "0000";
+    }
+    std::string out = squareToUci(m.from()) + squareToUci(m.to());
+    if (m.isPromotion()) {
+        char p = 'q';
+        if (m.promotionType() == N) p = 'n';
+        else if (m.promotionType() == B) p = 'b';
+        else if (m.promotionType() == R) p = 'r';
+        out.push_back(p);
+    }
+    return out;
+}
+
+static bool parseUciMove(GameState& gs, const std::string& uci, Move& out)
+{
+    if (uci.size() < 4) return false;
+    const int from = parseSquare(uci.substr(0, 2));
+    const int to = parseSquare(uci.substr(2, 2));
+    if (from < 0 || to < 0) return false;
+
+    int promo = EMPTY;
+    if (uci.size() >= 5) {
+        const char c = static_cast<char>(std::tolower(static_cast<unsigned char>(uci[4])));
+        if (c == 'q') promo = Q;
+        else if (c == 'r') promo = R;
+        else if (c == 'b') promo = B;
+        else if (c == 'n') promo = N;
+    }
+
+    MoveList legal;
+    generateLegalMoves(gs, legal);
+    for (int i = 0; i < legal.count; ++i) {
+        const Move& m = legal.moves[i];
+        if (m.from() != from || m.to() != to) continue;
+        if (!m.isPromotion() && promo == EMPTY) {
+            out = m;
+            return true;
+        }
+        if (m.isPromotion() && promo != EMPTY && m.promotionType() == promo) {
+            out = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int computeTimeForGo(const GameState& gs,
+                            int movetime,
+                            int wtime,
+                            int btime,
+                            int winc,
+                            int binc,
+                            int movestogo,
+                            int slowMoverPct,
+                            int minThinkMs)
+{
+    if (movetime > 0) {
+        return std::max(minThinkMs, movetime);
+    }
+
+    const bool white = gs.whiteToMove;
+    const int remain = white ? wtime : btime;
+    const int inc = white ? winc : binc;
+    if (remain <= 0) {
+        return std::max(100, minThinkMs);
+    }
+
+    int mtg = movestogo;
+    if (mtg <= 0) {
+        if (remain > 180000) mtg = 34;
+        else if (remain > 90000) mtg = 28;
+        else mtg = 22;
+    }
+
+    int budget = remain / std::max(10, mtg);
+    budget += (movestogo > 0) ? (inc / 2) : ((inc * 7) / 10);
+    budget = (budget * std::clamp(slowMoverPct, 50, 400)) / 100;
+
+    const int reserve = std::max(100, remain / 30);
+    const int hardCap = std::max(minThinkMs, remain - reserve);
+    const int softCap = std::max(minThinkMs, remain / 8 + inc);
+
+    budget = std::max(minThinkMs, budget);
+    budget = std::min(budget, softCap);
+    budget = std::min(budget, hardCap);
+    return budget;
+}
+
+static int antiFlagReserveMs(int remain, int moveOverheadMs)
+{
+    int reserve = std::max(80, moveOverheadMs * 3);
+    if (remain < 1000) {
+        reserve = std::max(reserve, remain / 3);
+    } else if (remain < 3000) {
+        reserve = std::max(reserve, remain / 4);
+    } else {
+        reserve = std::max(reserve, remain / 10);
+    }
+    return reserve;
+}
+
+static int computeClockBudgetMs(const GameState& gs,
+                                int movetime,
+                                int wtime,
+                                int btime,
+                                int winc,
+                                int binc,
+                                int movestogo,
+                                int moveOverheadMs,
+                                int minThinkMs,
+                                int slowMoverPct)
+{
+    const int remain = gs.whiteToMove ? wtime : btime;
+
+    const int adaptiveMinThink =
+        (remain > 0)
+            ? std::clamp(remain / 20, 15, minThinkMs)
+            : minThinkMs;
+
+    int timeMs = computeTimeForGo(gs,
+                                  movetime,
+                                  wtime,
+                                  btime,
+                                  winc,
+                                  binc,
+                                  movestogo,
+                                  slowMoverPct,
+                                  adaptiveMinThink);
+    timeMs = std::max(adaptiveMinThink, timeMs - moveOverheadMs);
+
+    // Hard anti-flag cap: always keep reserve for transport/UI jitter and future moves.
+    if (remain > 0) {
+        const int hardCap = std::max(15, remain - antiFlagReserveMs(remain, moveOverheadMs));
+        timeMs = std::min(timeMs, hardCap);
+        timeMs = std::max(15, timeMs);
+    }
+    return timeMs;
+}
+
+// Hard limit for a clock search whose soft budget is softMs: room to extend an unstable
+// iteration, but never into the anti-flag reserve.
+static int computeHardLimitMs(const GameState& gs,
+                              int softMs,
+                              int wtime,
+                              int btime,
+                              int moveOverheadMs)
+{
+    const int remain = gs.whiteToMove ? wtime : btime;
+    if (remain <= 0) {
+        return softMs;
+    }
+
+    int hardMs = std::min(softMs * 3, remain / 5);
+    hardMs = std::min(hardMs, remain - antiFlagReserveMs(remain, moveOverheadMs));
+    return std::max(softMs, hardMs);
+}
+
+static int parseIntOrDefault(const std::string& s, int fallback)
+{
+    try {
+        size_t idx = 0;
+        const int v = std::stoi(s, &idx);
+        if (idx != s.size()) {
+            return fallback;
+        }
+        return v;
+    } catch (...) {
+        return fallback;
+    }
+}
+
+static bool parseBoolOrDefault(const std::string& s, bool fallback)
+{
+    std::string v = s;
+    std::transform(v.begin(), v.end(), v.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    if (v == "true" || v == "on" || v == "1" || v == "yes") return true;
+    if (v == "false" || v == "off" || v == "0" || v == "no") return false;
+    return fallback;
+}
+
+static double parseOutcomeScore(const std::string& gameOverMsg, bool candidateWasWhite)
+{
+    std::string s = gameOverMsg;
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (s.find("draw") != std::string::npos || s.find("stalemate") != std::string::npos) {
+        return 0.5;
+    }
+    if (s.find("white wins") != std::string::npos) {
+        return candidateWasWhite ? 1.0 : 0.0;
+    }
+    if (s.find("black wins") != std::string::npos) {
+        return candidateWasWhite ? 0.0 : 1.0;
+    }
+    return 0.5;
+}
+
+struct SprtState {
+    int games = 0;
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+    double llr = 0.0;
+};
+
+static void sprtUpdate(SprtState& s, double score, double elo0, double elo1, double alpha, double beta)
+{
+    if (score > 0.75) s.wins++;
+    else if (score < 0.25) s.losses++;
+    else s.draws++;
+    s.games++;
+
+    const double drawRate = (s.games > 0) ? static_cast<double>(s.draws) / static_cast<double>(s.games) : 0.4;
+
+    auto expectedScore = [](double elo) {
+        return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+    };
+
+    const double e0 = expectedScore(elo0);
+    const double e1 = expectedScore(elo1);
+
+    auto probs = [&](double e) {
+        const double d = std::clamp(drawRate, 0.05, 0.95);
+        double w = e - 0.5 * d;
+        w = std::clamp(w, 1e-6, 1.0 - d - 1e-6);
+        double l = 1.0 - d - w;
+        l = std::max(l, 1e-6);
+        return std::array<double, 3> { w, d, l };
+    };
+
+    const auto p0 = probs(e0);
+    const auto p1 = probs(e1);
+    int idx = 1;
+    if (score > 0.75) idx = 0;
+    else if (score < 0.25) idx = 2;
+
+    s.llr += std::log(p1[idx] / p0[idx]);
+
+    const double A = std::log((1.0 - beta) / alpha);
+    const double B = std::log(beta / (1.0 - alpha));
+    (void)A;
+    (void)B;
+}
+
+static int runTuneLoop(int maxGames, int moveTimeMs)
+{
+    std::vector<std::string> tuneFens = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r1bq1rk1/ppp2ppp/2np1n2/3Np3/2B1P3/5N2/PPP2PPP/R1BQ1RK1 w - - 0 8",
+        "8/2p5/3p4/1p1P4/1P3k2/2P2P2/6K1/8 w - - 0 40",
+        "2r2rk1/1bq1bppp/p2ppn2/1pn5/3NP3/1BN1BP2/PPQ2P1P/2RR2K1 w - - 0 14",
+        "r4rk1/1pp1qppp/p1np1n2/4p3/2B1P3/2NP1N2/PPP2PPP/R1BQR1K1 w - - 2 11"
+    };
+
+    std::mt19937 rng(std::random_device{}());
+    EngineTuningParams best = getTuningParams();
+
+    auto mutate = [&](const EngineTuningParams& b) {
+        EngineTuningParams c = b;
+        std::uniform_int_distribution<int> dSmall(-12, 12);
+        std::uniform_int_distribution<int> dMed(-20, 20);
+
+        c.futilityBaseMargin += dMed(rng);
+        c.futilityDepthMargin += dSmall(rng);
+        c.lmpBaseMargin += dMed(rng);
+        c.lmpDepthMargin += dSmall(rng);
+        c.qsearchDeltaMargin += dMed(rng);
+        c.qsearchSeeThreshold += dMed(rng);
+        c.singularBaseMargin += dSmall(rng);
+        c.singularDepthMargin += dSmall(rng) / 2;
+        c.nnueMgWeight += dSmall(rng);
+        c.nnueEgWeight += dSmall(rng);
+        c.nullVerifyMinDepth += dSmall(rng) / 8;
+
+        setTuningParams(c);
+        return getTuningParams();
+    };
+
+    const double alpha = 0.05;
+    const double beta = 0.05;
+    const double elo0 = 0.0;
+    const double elo1 = 10.0;
+    const double A = std::log((1.0 - beta) / alpha);
+    const double B = std::log(beta / (1.0 - alpha));
+
+    const int maxTotalGames = std::max(1, maxGames);
+    int totalGamesPlayed = 0;
+    int iteration = 0;
+    const bool prevInfoOutput = isSearchInfoOutputEnabled();
+    setSearchInfoOutputEnabled(false);
+
+    while (iteration < 24 && totalGamesPlayed < maxTotalGames) {
+        iteration++;
+        EngineTuningParams cand = mutate(best);
+        SprtState s {};
+
+        const int gamesThisCandidate = std::min(8, maxTotalGames - totalGamesPlayed);
+
+        for (int g = 0; g < gamesThisCandidate; ++g) {
+            GameState gs;
+            gs.loadFromFen(tuneFens[static_cast<size_t>(g) % tuneFens.size()]);
+            clearSearchHistory();
+
+            const bool candidateWhite = (g % 2 == 0);
+            bool done = false;
+
+            for (int ply = 0; ply < 220; ++ply) {
+                setTuningParams(gs.whiteToMove == candidateWhite ? cand : best);
+
+                Move mv = computeBestMove(gs, 8, moveTimeMs);
+                if (mv.value == 0xFFFFFFFFu) {
+                    done = true;
+                    sprtUpdate(s, 0.5, elo0, elo1, alpha, beta);
+                    break;
+                }
+                makeMove(gs, mv);
+
+                auto over = checkGameOver(gs);
+                if (over.has_value()) {
+                    const double score = parseOutcomeScore(*over, candidateWhite);
+                    sprtUpdate(s, score, elo0, elo1, alpha, beta);
+                    done = true;
+                    break;
+                }
+            }
+
+            if (!done) {
+                sprtUpdate(s, 0.5, elo0, elo1, alpha, beta);
+            }
+
+            totalGamesPlayed++;
+
+            std::cout << "tune iter " << iteration
+                      << " game " << s.games
+                      << " total " << totalGamesPlayed << "/" << maxTotalGames
+                      << " w/d/l " << s.wins << "/" << s.draws << "/" << s.losses
+                      << " llr " << s.llr << "\n";
+
+            if (s.llr >= A) {
+                best = cand;
+                std::cout << "tune accept candidate at iter " << iteration << "\n";
+                break;
+            }
+            if (s.llr <= B) {
+                std::cout << "tune reject candidate at iter " << iteration << "\n";
+                break;
+            }
+        }
+    }
+
+    setTuningParams(best);
+    setSearchInfoOutputEnabled(prevInfoOutput);
+    std::cout << "tune final params"
+              << " futBase=" << best.futilityBaseMargin
+              << " futDepth=" << best.futilityDepthMargin
+              << " lmpBase=" << best.lmpBaseMargin
+              << " lmpDepth=" << best.lmpDepthMargin
+              << " qDelta=" << best.qsearchDeltaMargin
+              << " qSee=" << best.qsearchSeeThreshold
+              << " singBase=" << best.singularBaseMargin
+              << " singDepth=" << best.singularDepthMargin
+              << " nnueMg=" << best.nnueMgWeight
+              << " nnueEg=" << best.nnueEgWeight
+              << " nullVerify=" << best.nullVerifyMinDepth
+              << "\n";
+
+    return 0;
+}
+
+// Applies the arguments of a UCI "position" command; moves that do not parse are skipped.
+static void parsePositionCommand(std::istringstream& iss, GameState& gs)
+{
+    std::string token;
+    iss >> token;
+    if (token == "startpos") {
+        gs.initStandard();
+        iss >> token;
+    } else if (token == "fen") {
+        std::string fen;
+        int fields = 0;
+        while (iss >> token && token != "moves") {
+            if (fields++) fen += ' ';
+            fen += token;
+        }
+        if (fields == 6) {
+            gs.loadFromFen(fen);
+        }
+    } else {
+        return;
+    }
+
+    if (token == "moves") {
+        std::string mv;
+        while (iss >> mv) {
+            Move m;
+            if (parseUciMove(gs, mv, m)) {
+                makeMove(gs, m);
+            }
+        }
+    }
+}
+
+// Parses the arguments of a UCI "go" into search limits. `ponderBudgetMs` receives the hard
+// limit that ponderhit arms a ponder search with.
+static SearchLimits parseGoLimits(std::istringstream& iss, GameState& gs, int moveOverheadMs, int minThinkTimeMs,
+    int slowMoverPct, bool& ponder, bool& infinite, int& ponderBudgetMs)
+{
+    int movetime = -1;
+    int wtime = -1, btime = -1, winc = 0, binc = 0;
+    int movestogo = -1;
+    int depth = -1;
+    long long nodes = 0;
+    int mate = 0;
+    infinite = false;
+    ponder = false;
+    std::vector<Move> searchMoves;
+    bool readingSearchMoves = false;
+
+    std::string t;
+    while (iss >> t) {
+        // searchmoves runs until the next keyword; anything that parses as a move belongs to it.
+        if (readingSearchMoves) {
+            Move m;
+            if (parseUciMove(gs, t, m)) {
+                searchMoves.push_back(m);
+                continue;
+            }
+            readingSearchMoves = false;
+        }
+
+        if (t == "movetime") iss >> movetime;
+        else if (t == "wtime") iss >> wtime;
+        else if (t == "btime") iss >> btime;
+        else if (t == "winc") iss >> winc;
+        else if (t == "binc") iss >> binc;
+        else if (t == "movestogo") iss >> movestogo;
+        else if (t == "depth") iss >> depth;
+        else if (t == "infinite") infinite = true;
+        else if (t == "ponder") ponder = true;
+        else if (t == "nodes") iss >> nodes;
+        else if (t == "mate") iss >> mate;
+        else if (t == "searchmoves") readingSearchMoves = true;
+    }
+
+    int timeMs = 600000;
+    int maxDepth = 64;
+    const bool hasClock = movetime > 0 || wtime > 0 || btime > 0;
+    const int clockBudgetMs = hasClock
+        ? computeClockBudgetMs(gs, movetime, wtime, btime, winc, binc, movestogo,
+                               moveOverheadMs, minThinkTimeMs, slowMoverPct)
+        : 600000;
+
+    // With a running clock (not movetime) the budget is a soft limit and the hard limit
+    // leaves room to extend when the best move is unstable.
+    const bool useSoftLimit = movetime <= 0 && (wtime > 0 || btime > 0);
+    const int hardLimitMs = useSoftLimit
+        ? computeHardLimitMs(gs, clockBudgetMs, wtime, btime, moveOverheadMs)
+        : clockBudgetMs;
+    int softMs = 0;
+
+    if (depth > 0) {
+        maxDepth = depth;
+    } else if (!infinite && !ponder && (hasClock || (nodes <= 0 && mate <= 0))) {
+        // Pure node or mate searches run unbounded in time unless a clock was also given.
+        timeMs = hardLimitMs;
+        softMs = useSoftLimit ? clockBudgetMs : 0;
+    } else if (ponder && useSoftLimit) {
+        softMs = clockBudgetMs;
+    }
+
+    SearchLimits limits;
+    limits.maxDepth = maxDepth;
+    limits.exactDepth = depth > 0;
+    limits.timeLimitMs = timeMs;
+    limits.softTimeMs = softMs;
+    limits.nodes = nodes > 0 ? static_cast<std::uint64_t>(nodes) : 0;
+    limits.mateInMoves = std::max(0, mate);
+    limits.searchMoves = std::move(searchMoves);
+    // Infinite and ponder searches are analysis that runs until stop; a book move would end them at once.
+    limits.useBook = !infinite && !ponder;
+    // A ponder search runs unbounded until ponderhit arms the clock with this budget.
+    ponderBudgetMs = hardLimitMs;
+    return limits;
+}
+
+// Splits "setoption name <name> [value <value>]"; the name comes back lower-cased. False when
+// there is no name.
+static bool parseSetOption(std::istringstream& iss, std::string& lname, std::string& value)
+{
+    std::vector<std::string> tokens;
+    std::string tok;
+    while (iss >> tok) tokens.push_back(tok);
+
+    size_t namePos = std::find(tokens.begin(), tokens.end(), "name") - tokens.begin();
+    if (namePos >= tokens.size()) {
+        return false;
+    }
+    size_t valuePos = std::find(tokens.begin(), tokens.end(), "value") - tokens.begin();
+
+    std::string name;
+    value.clear();
+    if (valuePos < tokens.size()) {
+        for (size_t i = namePos + 1; i < valuePos; ++i) {
+            if (!name.empty()) name += ' ';
+            name += tokens[i];
+        }
+        for (size_t i = valuePos + 1; i < tokens.size(); ++i) {
+            if (!value.empty()) value += ' ';
+            value += tokens[i];
+        }
+    } else {
+        for (size_t i = namePos + 1; i < tokens.size(); ++i) {
+            if (!name.empty()) name += ' ';
+            name += tokens[i];
+        }
+    }
+
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    lname = name;
+    return true;
+}
+
+static int runUciLoop()
+{
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    GameState gs;
+    gs.initStandard();
+    learningStartGame();
+
+    int optionMoveOverheadMs = 50;
+    int optionMinThinkTimeMs = 80;
+    int optionSlowMoverPct = 125;
+    bool optionExperienceLearning = true;
+    bool optionVerboseInfo = false;
+    int optionHashMb = 256;
+    std::string optionHashFile;
+    std::string optionSyzygyPath;
+    int optionSyzygyProbeLimit = 6;
+    int optionMultiPv = 1;
+    setHashSizeMb(optionHashMb);
+    optionHashMb = getHashSizeMb();
+    setExperienceLearningEnabled(optionExperienceLearning);
+    setSearchInfoOutputEnabled(optionVerboseInfo);
+    setSyzygyPath(optionSyzygyPath);
+    setSyzygyProbeLimit(optionSyzygyProbeLimit);
+    setMultiPv(optionMultiPv);
+    int optionThreads = 1;
+
+    std::thread searchThread;
+    std::atomic<bool> searchRunning { false };
+    std::mutex ioMutex;
+    int ponderBudgetMs = 0;
+
+    auto stopAndJoinSearch = [&]() {
+        if (searchRunning.load(std::memory_order_relaxed)) {
+            requestStopSearch();
+            setPondering(false);
+        }
+        if (searchThread.joinable()) {
+            searchThread.join();
+        }
+        searchRunning.store(false, std::memory_order_relaxed);
+    };
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.empty()) continue;
+
+        std::istringstream iss(line);
+        std::string cmd;
+        iss >> cmd;
+
+        if (cmd == "uci") {
+            std::cout << "id name Ikshvaku\n";
+            std::cout << "id author Ashish\n";
+            std::cout << "option name Hash type spin default 256 min 1 max 2048\n";
+            std::cout << "option name Hash File type string default \n";
+            std::cout << "option name Save Hash type button\n";
+            std::cout << "option name Load Hash type button\n";
+            std::cout << "option name Threads type spin default 1 min 1 max 1\n";
+            std::cout << "option name Ponder type check default false\n";
+            std::cout << "option name MultiPV type spin default 1 min 1 max 64\n";
+            std::cout << "option name Move Overhead type spin default 50 min 0 max 5000\n";
+            std::cout << "option name Min Think Time type spin default 80 min 0 max 5000\n";
+            std::cout << "option name Slow Mover type spin default 125 min 50 max 400\n";
+            std::cout << "option name Verbose Info type check default false\n";
+            std::cout << "option name Experience Learning type check default true\n";
+            std::cout << "option name SyzygyPath type string default \n";
+            std::cout << "option name SyzygyProbeLimit type spin default 6 min 3 max 7\n";
+            std::cout << "uciok\n";
+        } else if (cmd == "isready") {
+            // Hash and net are built here rather than at startup, so `uci` answers immediately
+            // and a Hash setoption sent before the first isready does not allocate twice.
+            if (ensureSearchTablesReady()) {
+                std::cout << "info string " << getLargePageReport() << "\n";
+            }
+            std::cout << "readyok\n";
+        } else if (cmd == "ucinewgame") {
+            stopAndJoinSearch();
+            learningAbortGame();
+            clearSearchHistory();
+            gs.initStandard();
+            learningStartGame();
+        } else if (cmd == "position") {
+            stopAndJoinSearch();
+            parsePositionCommand(iss, gs);
+
+            if (checkGameOver(gs).has_value()) {
+                learningFinalizeGame();
+            }
+        } else if (cmd == "go") {
+            stopAndJoinSearch();
+
+            bool ponder = false;
+            bool infinite = false;
+            const SearchLimits limits = parseGoLimits(iss, gs, optionMoveOverheadMs, optionMinThinkTimeMs,
+                optionSlowMoverPct, ponder, infinite, ponderBudgetMs);
+            GameState gsCopy = gs;
+
+            searchRunning.store(true, std::memory_order_relaxed);
+            clearStopSearch();
+            setPondering(ponder);
+
+            searchThread = std::thread([&, gsCopy, limits]() mutable {
+                Move best = computeBestMove(gsCopy, limits);
+
+                // UCI forbids bestmove while pondering; hold it until ponderhit or stop.
+                while (isPondering()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(ioMutex);
+                    const SearchStats stats = getLastSearchStats();
+                    if (isSearchInfoOutputEnabled()) {
+                        std::cout << "info string " << formatSearchCounters(stats) << "\n";
+                        std::cout << "info string " << formatTimeUsage(stats) << "\n";
+                    }
+                    std::cout << "bestmove " << moveToUci(best);
+                    if (stats.hasPonderMove) {
+                        std::cout << " ponder " << moveToUci(stats.ponderMove);
+                    }
+                    std::cout << "\n";
+                    std::cout.flush();
+                }
+                searchRunning.store(false, std::memory_order_relaxed);
+            });
+        } else if (cmd == "stop") {
+            stopAndJoinSearch();
+        } else if (cmd == "setoption") {
+            // Format: setoption name <name> [value <value>]
+            std::string lname;
+            std::string value;
+            if (!parseSetOption(iss, lname, value)) {
+                continue;
+            }
+
+            if (lname == "move overhead" && !value.empty()) {
+                optionMoveOverheadMs = std::clamp(parseIntOrDefault(value, optionMoveOverheadMs), 0, 5000);
+            } else if (lname == "min think time" && !value.empty()) {
+                optionMinThinkTimeMs = std::clamp(parseIntOrDefault(value, optionMinThinkTimeMs), 0, 5000);
+            } else if (lname == "slow mover" && !value.empty()) {
+                optionSlowMoverPct = std::clamp(parseIntOrDefault(value, optionSlowMoverPct), 50, 400);
+            } else if (lname == "hash" && !value.empty()) {
+                optionHashMb = std::clamp(parseIntOrDefault(value, optionHashMb), 1, 2048);
+                setHashSizeMb(optionHashMb);
+                optionHashMb = getHashSizeMb();
+                std::cout << "info string hash " << optionHashMb << " MB " << getLargePageReport() << "\n";
+            } else if (lname == "hash file") {
+                // Setting the file reloads an existing image, so a restarted session resumes warm.
+                optionHashFile = value;
+                std::error_code ec;
+                if (!optionHashFile.empty() && std::filesystem::exists(optionHashFile, ec)) {
+                    stopAndJoinSearch();
+                    const bool ok = loadHashFile(optionHashFile);
+                    optionHashMb = getHashSizeMb();
+                    std::cout << "info string hash file " << optionHashFile << (ok ? " loaded " : " rejected ")
+                              << optionHashMb << " MB\n";
+                } else {
+                    std::cout << "info string hash file " << (optionHashFile.empty() ? "<empty>" : optionHashFile) << "\n";
+                }
+            } else if (lname == "save hash" || lname == "load hash") {
+                if (optionHashFile.empty()) {
+                    std::cout << "info string hash file not set\n";
+                } else {
+                    stopAndJoinSearch();
+                    const bool save = lname == "save hash";
+                    const bool ok = save ? saveHashFile(optionHashFile) : loadHashFile(optionHashFile);
+                    optionHashMb = getHashSizeMb();
+                    std::cout << "info string hash " << (save ? "save " : "load ") << optionHashFile
+                              << (ok ? " ok " : " failed ") << optionHashMb << " MB\n";
+                }
+            } else if (lname == "experience learning") {
+                optionExperienceLearning = parseBoolOrDefault(value, optionExperienceLearning);
+                setExperienceLearningEnabled(optionExperienceLearning);
+                std::cout << "info string experience_learning " << (optionExperienceLearning ? "on" : "off") << "\n";
+            } else if (lname == "verbose info") {
+                optionVerboseInfo = parseBoolOrDefault(value, optionVerboseInfo);
+                setSearchInfoOutputEnabled(optionVerboseInfo);
+                std::cout << "info string verbose_info " << (optionVerboseInfo ? "on" : "off") << "\n";
+            } else if (lname == "syzygypath") {
+                optionSyzygyPath = value;
+                setSyzygyPath(optionSyzygyPath);
+                std::cout << "info string syzygypath " << (optionSyzygyPath.empty() ? "<empty>" : optionSyzygyPath) << "\n";
+            } else if (lname == "syzygyprobelimit" && !value.empty()) {
+                optionSyzygyProbeLimit = std::clamp(parseIntOrDefault(value, optionSyzygyProbeLimit), 3, 7);
+                setSyzygyProbeLimit(optionSyzygyProbeLimit);
+                std::cout << "info string syzygyprobelimit " << optionSyzygyProbeLimit << "\n";
+            } else if (lname == "multipv" && !value.empty()) {
+                setMultiPv(parseIntOrDefault(value, optionMultiPv));
+                optionMultiPv = getMultiPv();
+                // Extra lines are only visible as info output, so asking for them turns it on;
+                // a later "Verbose Info false" still silences it.
+                if (optionMultiPv > 1 && !optionVerboseInfo) {
+                    optionVerboseInfo = true;
+                    setSearchInfoOutputEnabled(true);
+                    std::cout << "info string verbose_info on\n";
+                }
+                std::cout << "info string multipv " << optionMultiPv << "\n";
+            } else if (lname == "threads" && !value.empty()) {
+                optionThreads = std::clamp(parseIntOrDefault(value, optionThreads), 1, 1);
+                (void)optionThreads;
+            }
+        } else if (cmd == "ponderhit") {
+            // The opponent played the expected move: continue the same search on our clock.
+            if (searchRunning.load(std::memory_order_relaxed) && isPondering()) {
+                ponderHit(ponderBudgetMs);
+            }
+        } else if (cmd == "quit") {
+            stopAndJoinSearch();
+            learningAbortGame();
+            break;
+        }
+
+        std::cout.flush();
+    }
+
+    stopAndJoinSearch();
+    return 0;
+}
+
+// Batch analysis runs each position (or game) as an independent job. With more than one
+// worker the jobs are spread over forked processes, so every worker owns a full copy of the
+// engine's global search state; results come back over pipes and are emitted in job order.
+struct BatchResult {
+    std::string text;
+    long long nodes = 0;
+    int bmMatch = -1;   // 1 or 0 when the job had a bm operation to check, -1 otherwise
+};
+
+using BatchJob = std::function<BatchResult(size_t)>;
+using BatchEmit = std::function<void(size_t, const BatchResult*)>;   // null when the job was lost
+
+struct BatchProgress {
+    const char* unit;
+    size_t total;
+    size_t done = 0;
+    long long nodes = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point lastReport = start;
+
+    void add(long long jobNodes)
+    {
+        ++done;
+        nodes += jobNodes;
+        const auto now = std::chrono::steady_clock::now();
+        if (done == total || now - lastReport >= std::chrono::seconds(1)) {
+            lastReport = now;
+            report(std::cerr, "\r");
+        }
+    }
+
+    double elapsedSec() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void report(std::ostream& out, const char* prefix) const
+    {
+        const double sec = std::max(1e-3, elapsedSec());
+        out << prefix << "progress " << done << "/" << total << " " << unit
+            << "  " << std::fixed << std::setprecision(1) << (done / sec) << " " << unit << "/s"
+            << "  nps " << static_cast<long long>(nodes / sec) << std::flush;
+    }
+};
+
+static void runBatchInProcess(size_t jobCount, const BatchJob& job, const BatchEmit& emit, BatchProgress& progress)
+{
+    for (size_t i = 0; i < jobCount; ++i) {
+        const BatchResult r = job(i);
+        progress.add(r.nodes);
+        emit(i, &r);
+    }
+}
+
+#if defined(__linux__)
+static bool writeAll(int fd, const std::string& data)
+{
+    size_t off = 0;
+    while (off < data.size()) {
+        const ssize_t n = ::write(fd, data.data() + off, data.size() - off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        off += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Workers claim jobs from a shared counter, so a slow job only holds up its own worker.
+// Each result travels as an "index nodes bmMatch length" header line followed by `length` bytes
+// of text. When no worker can be started the jobs run in-process instead.
+static void runBatchForked(size_t jobCount, int workers, const BatchJob& job, const BatchEmit& emit, BatchProgress& progress)
+{
+    void* shared = mmap(nullptr, sizeof(std::atomic<size_t>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        runBatchInProcess(jobCount, job, emit, progress);
+        return;
+    }
+    auto* nextJob = new (shared) std::atomic<size_t>(0);
+
+    std::cout.flush();
+    std::cerr.flush();
+    std::vector<pid_t> pids;
+    std::vector<int> fds;
+    for (int w = 0; w < workers; ++w) {
+        int fd[2];
+        if (pipe(fd) != 0) {
+            break;
+        }
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(fd[0]);
+            for (int other : fds) {
+                close(other);
+            }
+            for (;;) {
+                const size_t i = nextJob->fetch_add(1);
+                if (i >= jobCount) {
+                    break;
+                }
+                const BatchResult r = job(i);
+                const std::string header = std::to_string(i) + " " + std::to_string(r.nodes) + " "
+                    + std::to_string(r.bmMatch) + " " + std::to_string(r.text.size()) + "\n";
+                if (!writeAll(fd[1], header + r.text)) {
+                    break;
+                }
+            }
+            _exit(0);
+        }
+        close(fd[1]);
+        if (pid < 0) {
+            close(fd[0]);
+            break;
+        }
+        pids.push_back(pid);
+        fds.push_back(fd[0]);
+    }
+    if (pids.empty()) {
+        munmap(shared, sizeof(std::atomic<size_t>));
+        runBatchInProcess(jobCount, job, emit, progress);
+        return;
+    }
+
+    std::map<size_t, BatchResult> pending;
+    size_t nextEmit = 0;
+    std::vector<std::string> buffers(fds.size());
+    std::vector<bool> open(fds.size(), true);
+    size_t openCount = fds.size();
+    while (openCount > 0) {
+        std::vector<pollfd> pfds;
+        std::vector<size_t> which;
+        for (size_t k = 0; k < fds.size(); ++k) {
+            if (open[k]) {
+                pfds.push_back({ fds[k], POLLIN, 0 });
+                which.push_back(k);
+            }
+        }
+        if (poll(pfds.data(), pfds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (size_t p = 0; p < pfds.size(); ++p) {
+            if (pfds[p].revents == 0) {
+                continue;
+            }
+            const size_t k = which[p];
+            char chunk[65536];
+            const ssize_t n = read(fds[k], chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                open[k] = false;
+                --openCount;
+                continue;
+            }
+            std::string& buf = buffers[k];
+            buf.append(chunk, static_cast<size_t>(n));
+            size_t nl;
+            while ((nl = buf.find('\n')) != std::string::npos) {
+                size_t index = 0;
+                size_t length = 0;
+                BatchResult r;
+                std::istringstream header(buf.substr(0, nl));
+                if (!(header >> index >> r.nodes >> r.bmMatch >> length) || buf.size() < nl + 1 + length) {
+                    break;
+                }
+                r.text = buf.substr(nl + 1, length);
+                buf.erase(0, nl + 1 + length);
+                progress.add(r.nodes);
+                pending[index] = std::move(r);
+            }
+            while (!pending.empty() && pending.begin()->first == nextEmit) {
+                emit(nextEmit, &pending.begin()->second);
+                pending.erase(pending.begin());
+                ++nextEmit;
+            }
+        }
+    }
+
+    for (int fd : fds) {
+        close(fd);
+    }
+    for (pid_t pid : pids) {
+        waitpid(pid, nullptr, 0);
+    }
+    munmap(shared, sizeof(std::atomic<size_t>));
+
+    // Jobs held by a worker that died are reported as lost rather than silently dropped.
+    for (; nextEmit < jobCount; ++nextEmit) {
+        auto it = pending.find(nextEmit);
+        emit(nextEmit, it != pending.end() ? &it->second : nullptr);
+    }
+}
+#endif
+
+static void runBatch(size_t jobCount, int workers, const BatchJob& job, const BatchEmit& emit, BatchProgress& progress)
+{
+    workers = std::clamp(workers, 1, static_cast<int>(std::max<size_t>(1, jobCount)));
+#if defined(__linux__)
+    if (workers > 1) {
+        runBatchForked(jobCount, workers, job, emit, progress);
+        return;
+    }
+#endif
+    runBatchInProcess(jobCount, job, emit, progress);
+}
+
+static std::string jsonEscape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+// Search budget and pool size shared by the batch modes.
+struct BatchOptions {
+    SearchLimits limits;
+    int workers = 0;
+    int hashMb = 64;   // per worker, so the pool's total is workers * hashMb
+    bool clearHash = false;
+};
+
+// Parses "--depth N --nodes N --movetime MS --workers N --hash MB --clear-hash" from argv[first..];
+// returns false on an unknown flag. Fixed depth 10 applies when no budget is given.
+static bool parseBatchOptions(int argc, char** argv, int first, BatchOptions& opt)
+{
+    bool budget = false;
+    for (int i = first; i < argc; ++i) {
+        const std::string flag = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (flag == "--depth" && hasValue) {
+            opt.limits.maxDepth = std::clamp(std::atoi(argv[++i]), 1, 64);
+            opt.limits.exactDepth = true;
+            budget = true;
+        } else if (flag == "--nodes" && hasValue) {
+            opt.limits.nodes = static_cast<std::uint64_t>(std::max(1LL, std::atoll(argv[++i])));
+            budget = true;
+        } else if (flag == "--movetime" && hasValue) {
+            opt.limits.timeLimitMs = std::max(1, std::atoi(argv[++i]));
+            budget = true;
+        } else if (flag == "--workers" && hasValue) {
+            opt.workers = std::max(1, std::atoi(argv[++i]));
+        } else if (flag == "--hash" && hasValue) {
+            opt.hashMb = std::clamp(std::atoi(argv[++i]), 1, 2048);
+        } else if (flag == "--clear-hash") {
+            opt.clearHash = true;
+        } else {
+            return false;
+        }
+    }
+    if (!budget) {
+        opt.limits.maxDepth = 10;
+        opt.limits.exactDepth = true;
+    }
+    if (opt.workers <= 0) {
+        opt.workers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    opt.limits.useBook = false;
+    return true;
+}
+
+// Batch workers search quietly, without book or experience, on their own hash.
+static void prepareBatchEngine(const BatchOptions& opt)
+{
+    setSearchInfoOutputEnabled(false);
+    setExperienceLearningEnabled(false);
+    setHashSizeMb(opt.hashMb);
+}
+
+static void appendScoreJson(std::string& out, const SearchStats& stats)
+{
+    if (stats.mateIn != 0) {
+        out += "{\"mate\":" + std::to_string(stats.mateIn) + "}";
+    } else {
+        out += "{\"cp\":" + std::to_string(stats.bestScore) + "}";
+    }
+}
+
+struct EpdEntry {
+    std::string fen;
+    std::string id;
+    std::string bm;
+    std::string am;
+};
+
+// Piece placement must have eight ranks of eight squares and exactly one king per side.
+static bool validFenBoard(const std::string& board)
+{
+    int ranks = 1;
+    int files = 0;
+    int whiteKings = 0;
+    int blackKings = 0;
+    for (char c : board) {
+        if (c == '/') {
+            if (files != 8) return false;
+            ++ranks;
+            files = 0;
+        } else if (c >= '1' && c <= '8') {
+            files += c - '0';
+        } else if (std::strchr("pnbrqkPNBRQK", c) != nullptr) {
+            whiteKings += (c == 'K');
+            blackKings += (c == 'k');
+            ++files;
+        } else {
+            return false;
+        }
+        if (files > 8) return false;
+    }
+    return ranks == 8 && files == 8 && whiteKings == 1 && blackKings == 1;
+}
+
+// EPD: four FEN fields, then "opcode operand...;" operations. Plain six-field FEN lines are
+// accepted too; hmvc/fmvn operations fill in the move counters.
+static bool parseEpdLine(const std::string& line, EpdEntry& out)
+{
+    std::istringstream iss(line);
+    std::string board, side, castling, ep;
+    if (!(iss >> board >> side >> castling >> ep) || !validFenBoard(board) || (side != "w" && side != "b")) {
+        return false;
+    }
+
+    std::string rest;
+    std::getline(iss, rest);
+    std::string halfmove = "0";
+    std::string fullmove = "1";
+    {
+        std::istringstream counters(rest);
+        std::string a, b;
+        if (counters >> a >> b && std::all_of(a.begin(), a.end(), ::isdigit) && std::all_of(b.begin(), b.end(), ::isdigit)) {
+            halfmove = a;
+            fullmove = b;
+            std::getline(counters, rest);
+        }
+    }
+
+    size_t pos = 0;
+    while (pos < rest.size()) {
+        size_t end = pos;
+        bool quoted = false;
+        while (end < rest.size() && (quoted || rest[end] != ';')) {
+            quoted ^= (rest[end] == '"');
+            ++end;
+        }
+        std::istringstream op(rest.substr(pos, end - pos));
+        std::string opcode;
+        if (op >> opcode) {
+            std::string operand;
+            std::getline(op, operand);
+            const size_t b = operand.find_first_not_of(" \t");
+            operand = (b == std::string::npos) ? std::string() : operand.substr(b);
+            if (operand.size() >= 2 && operand.front() == '"' && operand.back() == '"') {
+                operand = operand.substr(1, operand.size() - 2);
+            }
+            if (opcode == "id") out.id = operand;
+            else if (opcode == "bm") out.bm = operand;
+            else if (opcode == "am") out.am = operand;
+            else if (opcode == "hmvc") halfmove = operand;
+            else if (opcode == "fmvn") fullmove = operand;
+        }
+        pos = end + 1;
+    }
+
+    out.fen = board + " " + side + " " + castling + " " + ep + " " + halfmove + " " + fullmove;
+    return true;
+}
+
+static bool moveInSanList(const GameState& gs, const std::string& sanList, const Move& move)
+{
+    std::istringstream iss(sanList);
+    std::string san;
+    while (iss >> san) {
+        Move m;
+        if (parseSanMove(gs, san, m) && m.from() == move.from() && m.to() == move.to()
+            && m.promotionType() == move.promotionType()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static BatchResult analyzeEpdEntry(size_t index, const std::string& line, const BatchOptions& opt)
+{
+    BatchResult result;
+    std::string& json = result.text;
+    json = "{\"index\":" + std::to_string(index);
+
+    EpdEntry entry;
+    if (!parseEpdLine(line, entry)) {
+        json += ",\"error\":\"bad epd\",\"line\":\"" + jsonEscape(line) + "\"}";
+        return result;
+    }
+    if (!entry.id.empty()) {
+        json += ",\"id\":\"" + jsonEscape(entry.id) + "\"";
+    }
+    json += ",\"fen\":\"" + jsonEscape(entry.fen) + "\"";
+
+    GameState gs;
+    gs.loadFromFen(entry.fen);
+    if (isInCheck(gs, !gs.whiteToMove)) {
+        json += ",\"error\":\"side not to move is in check\"}";
+        return result;
+    }
+    MoveList legal;
+    generateLegalMoves(gs, legal);
+    if (legal.empty()) {
+        json += ",\"error\":\"no legal moves\"}";
+        return result;
+    }
+
+    if (opt.clearHash) {
+        clearHash();
+    }
+    clearSearchHistory();
+    const Move best = computeBestMove(gs, opt.limits);
+    const SearchStats stats = getLastSearchStats();
+    result.nodes = stats.nodes;
+
+    json += ",\"bestmove\":\"" + moveToUci(best) + "\",\"score\":";
+    appendScoreJson(json, stats);
+    json += ",\"depth\":" + std::to_string(stats.depthReached)
+        + ",\"nodes\":" + std::to_string(stats.nodes)
+        + ",\"timeMs\":" + std::to_string(stats.timeMs)
+        + ",\"pv\":[";
+    for (size_t i = 0; i < stats.pv.size(); ++i) {
+        json += (i ? ",\"" : "\"") + moveToUci(stats.pv[i]) + "\"";
+    }
+    json += "]";
+    if (!entry.bm.empty()) {
+        result.bmMatch = moveInSanList(gs, entry.bm, best) ? 1 : 0;
+        json += ",\"bm\":\"" + jsonEscape(entry.bm) + "\",\"bmMatch\":" + (result.bmMatch ? "true" : "false");
+    }
+    if (!entry.am.empty()) {
+        json += ",\"am\":\"" + jsonEscape(entry.am) + "\",\"amMatch\":"
+            + (moveInSanList(gs, entry.am, best) ? "true" : "false");
+    }
+    json += "}";
+    return result;
+}
+
+static int runAnalyzeEpd(const std::string& path, const BatchOptions& opt)
+{
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        std::cerr << "analyze-epd cannot open " << path << "\n";
+        return 1;
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.find_first_not_of(" \t") != std::string::npos && line[0] != '#') {
+            lines.push_back(line);
+        }
+    }
+
+    prepareBatchEngine(opt);
+    BatchProgress progress { "positions", lines.size() };
+    size_t matched = 0;
+    size_t withBm = 0;
+    runBatch(lines.size(), opt.workers,
+        [&](size_t i) { return analyzeEpdEntry(i, lines[i], opt); },
+        [&](size_t i, const BatchResult* r) {
+            if (r == nullptr) {
+                std::cout << "{\"index\":" << i << ",\"error\":\"worker failed\"}\n";
+                return;
+            }
+            withBm += r->bmMatch >= 0;
+            matched += r->bmMatch > 0;
+            std::cout << r->text << "\n";
+        },
+        progress);
+    std::cout.flush();
+
+    std::cerr << "\nanalyze-epd workers " << std::min<size_t>(opt.workers, std::max<size_t>(1, lines.size()))
+              << "  timeMs " << static_cast<long long>(progress.elapsedSec() * 1000.0);
+    if (withBm > 0) {
+        std::cerr << "  bm " << matched << "/" << withBm;
+    }
+    std::cerr << "\n";
+    return 0;
+}
+
+struct PlyAnnotation {
+    bool terminal = false;   // no legal moves: mate or stalemate
+    bool whiteToMove = true;
+    int fullmove = 1;
+    int score = 0;           // side to move
+    int mateIn = 0;
+    Move best;
+    std::vector<std::string> pvSan;
+    std::string playedSan;
+};
+
+// "[%eval]" text from White's point of view, in pawns or as "#n".
+static std::string evalComment(const PlyAnnotation& p)
+{
+    const int sign = p.whiteToMove ? 1 : -1;
+    std::ostringstream out;
+    out << "{ [%eval ";
+    if (p.mateIn != 0) {
+        out << "#" << sign * p.mateIn;
+    } else {
+        out << std::fixed << std::setprecision(2) << sign * p.score / 100.0;
+    }
+    out << "] }";
+    return out.str();
+}
+
+// Appends movetext tokens, breaking lines before 80 columns as PGN export format asks.
+struct PgnWriter {
+    std::string out;
+    size_t lineStart = 0;
+
+    void token(const std::string& t)
+    {
+        if (out.size() > lineStart) {
+            if (out.size() - lineStart + 1 + t.size() > 79) {
+                out += '\n';
+                lineStart = out.size();
+            } else {
+                out += ' ';
+            }
+        }
+        out += t;
+    }
+};
+
+static std::string moveNumberToken(int fullmove, bool whiteToMove)
+{
+    return std::to_string(fullmove) + (whiteToMove ? "." : "...");
+}
+
+// Centipawn drop of the played move against the engine's choice, with mate scores capped so
+// a missed mate in a won position reads as a mistake rather than an enormous loss.
+static int annotationLoss(const PlyAnnotation& before, const PlyAnnotation& after)
+{
+    if (after.terminal) {
+        return after.mateIn != 0 ? 0 : std::max(0, std::clamp(before.score, -1000, 1000));
+    }
+    const int bestValue = std::clamp(before.score, -1000, 1000);
+    const int playedValue = std::clamp(-after.score, -1000, 1000);
+    return bestValue - playedValue;
+}
+
+static const char* mistakeNag(int loss)
+{
+    if (loss >= 300) return "$4";   // ??
+    if (loss >= 100) return "$2";   // ?
+    if (loss >= 50) return "$6";    // ?!
+    return nullptr;
+}
+
+static constexpr size_t ANNOTATION_PV_PLIES = 6;
+
+// Searches every position of the game from the last one back to the first. The TT is kept
+// from ply to ply, so each earlier search starts with the later positions already scored.
+// Positions are packed during the forward replay and unpacked on the way back, as the
+// undo stack stops recording after 512 plies and long games would otherwise walk back wrong.
+static BatchResult annotateGame(const PgnGame& game, const BatchOptions& opt)
+{
+    BatchResult result;
+    GameState gs;
+    bool loaded = true;
+    if (game.fen.empty()) {
+        gs.initStandard();
+    } else {
+        loaded = parseFen(game.fen, gs);
+        gs.positionHashCounts[positionHash(gs)]++;
+    }
+    const size_t plies = game.moves.size();
+    std::vector<PackedPosition> positions(plies + 1);
+    std::vector<std::uint64_t> hashes(plies + 1);
+    // Moves never add pieces, so only a start position with more than 32 can fail to pack.
+    const bool packed = loaded && packPosition(gs, positions[0]);
+    hashes[0] = positionHash(gs);
+    for (size_t k = 0; packed && k < plies; ++k) {
+        makeMove(gs, game.moves[k]);
+        packPosition(gs, positions[k + 1]);
+        hashes[k + 1] = positionHash(gs);
+    }
+
+    // Repetition counts of the game up to the searched position, as undoMove kept them.
+    std::unordered_map<std::uint64_t, int> history = std::move(gs.positionHashCounts);
+    std::vector<PlyAnnotation> ann(plies + 1);
+    clearHash();
+    clearSearchHistory();
+    for (size_t k = plies + 1; packed && k-- > 0;) {
+        if (k < plies) {
+            auto it = history.find(hashes[k + 1]);
+            if (it != history.end() && --it->second <= 0) {
+                history.erase(it);
+            }
+        }
+        unpackPosition(positions[k], gs);
+        gs.positionHashCounts = history;
+        PlyAnnotation& p = ann[k];
+        p.whiteToMove = gs.whiteToMove;
+        p.fullmove = gs.fullmoveNumber;
+        if (k < plies) {
+            p.playedSan = moveToSan(gs, game.moves[k]);
+        }
+
+        MoveList legal;
+        generateLegalMoves(gs, legal);
+        if (legal.empty()) {
+            p.terminal = true;
+            p.mateIn = isInCheck(gs, gs.whiteToMove) ? -1 : 0;
+            continue;
+        }
+
+        p.best = computeBestMove(gs, opt.limits);
+        const SearchStats stats = getLastSearchStats();
+        result.nodes += stats.nodes;
+        p.score = stats.bestScore;
+        p.mateIn = stats.mateIn;
+        GameState line = gs;
+        for (size_t j = 0; j < stats.pv.size() && j < ANNOTATION_PV_PLIES; ++j) {
+            p.pvSan.push_back(moveToSan(line, stats.pv[j]));
+            makeMove(line, stats.pv[j], false);
+        }
+    }
+
+    std::string& out = result.text;
+    bool annotatorTag = false;
+    for (const auto& [name, value] : game.tags) {
+        annotatorTag |= name == "Annotator";
+        out += "[" + std::string(name) + " \"" + std::string(name == "Annotator" ? "Ikshvaku" : value) + "\"]\n";
+    }
+    if (!annotatorTag) {
+        out += "[Annotator \"Ikshvaku\"]\n";
+    }
+    out += "\n";
+
+    PgnWriter w;
+    bool needNumber = true;
+    for (size_t k = 0; packed && k < plies; ++k) {
+        const PlyAnnotation& before = ann[k];
+        const PlyAnnotation& after = ann[k + 1];
+        if (before.whiteToMove || needNumber) {
+            w.token(moveNumberToken(before.fullmove, before.whiteToMove));
+        }
+        w.token(before.playedSan);
+        needNumber = false;
+
+        const bool playedBest = before.best.from() == game.moves[k].from()
+            && before.best.to() == game.moves[k].to() && before.best.promotionType() == game.moves[k].promotionType();
+        const char* nag = playedBest ? nullptr : mistakeNag(annotationLoss(before, after));
+        if (nag != nullptr) {
+            w.token(nag);
+        }
+        if (!after.terminal) {
+            w.token(evalComment(after));
+            needNumber = true;
+        }
+        if (nag != nullptr && !before.pvSan.empty()) {
+            w.token("(");
+            bool white = before.whiteToMove;
+            int fullmove = before.fullmove;
+            for (size_t j = 0; j < before.pvSan.size(); ++j) {
+                if (white || j == 0) {
+                    w.token(moveNumberToken(fullmove, white));
+                }
+                w.token(before.pvSan[j]);
+                if (j == 0) {
+                    w.token(evalComment(before));
+                }
+                fullmove += white ? 0 : 1;
+                white = !white;
+            }
+            w.token(")");
+            needNumber = true;
+        }
+    }
+    if (!loaded) {
+        w.token("{ unreadable FEN, game not annotated }");
+    } else if (!game.complete || !packed) {
+        w.token("{ annotation stops at an unreadable move }");
+    }
+    w.token(game.result.empty() ? "*" : std::string(game.result));
+    out += w.out + "\n\n";
+    return result;
+}
+
+static int runAnnotatePgn(const std::string& path, const BatchOptions& opt)
+{
+    const MappedFile file(path);
+    if (file.size() == 0) {
+        std::cerr << "annotate-pgn cannot read " << path << "\n";
+        return 1;
+    }
+    // Games keep views into the mapping, which forked workers inherit.
+    std::vector<PgnGame> games;
+    forEachPgnGame(file.text(), [&](const PgnGame& game) { games.push_back(game); });
+
+    prepareBatchEngine(opt);
+    BatchProgress progress { "games", games.size() };
+    runBatch(games.size(), opt.workers,
+        [&](size_t i) { return annotateGame(games[i], opt); },
+        [&](size_t i, const BatchResult* r) {
+            if (r == nullptr) {
+                std::cerr << "\nannotate-pgn lost game " << (i + 1) << "\n";
+                return;
+            }
+            std::cout << r->text;
+        },
+        progress);
+    std::cout.flush();
+
+    std::cerr << "\nannotate-pgn workers " << std::min<size_t>(opt.workers, std::max<size_t>(1, games.size()))
+              << "  timeMs " << static_cast<long long>(progress.elapsedSec() * 1000.0) << "\n";
+    return 0;
+}
+
+#if defined(__linux__)
+// Analysis server: UCI sessions from many clients over a Unix socket or a localhost TCP port.
+// The engine's search state is process-wide, so searches run in a fixed pool of forked worker
+// processes, one search per worker at a time. The hash table is mapped shared before the
+// fork, so every worker, and so every session, probes and fills the same table. Sessions are
+// multiplexed with poll() on the main thread: a `go` goes to an idle worker, or waits for one
+// in request order, and the worker's info and bestmove lines are relayed to the session.
+// Searches without a time limit are cut at maxSearchMs so one client cannot hold a worker
+// indefinitely, except go infinite and go ponder: as UCI requires, those search, and hold
+// their bestmove, until the session sends stop or stops sending input.
+static volatile std::sig_atomic_t g_serverStopRequested = 0;
+
+static void requestServerStop(int)
+{
+    g_serverStopRequested = 1;
+}
+
+struct ServerOptions {
+    std::string endpoint;
+    int hashMb = 256;
+    int maxSearchMs = 60000;
+    int workers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+};
+
+static constexpr size_t MAX_SESSION_OUTPUT = 8u << 20;
+
+struct ServerSession {
+    int fd = -1;
+    int id = 0;
+    bool closing = false;
+    bool inputClosed = false; // client finished sending; close once its searches are answered
+    std::string input;
+    std::string position = "startpos";   // arguments of the last "position" command
+    int multiPv = 1;
+    int moveOverheadMs = 50;
+    int minThinkTimeMs = 80;
+    int slowMoverPct = 125;
+    std::string output;
+};
+
+// A request travels to a worker as one line, "search <id> <multiPv> <moveOverheadMs>
+// <minThinkTimeMs> <slowMoverPct>" then the position and go arguments, tab-separated;
+// "stop <id>" ends it. The worker answers with info lines and one bestmove line.
+struct ServerJob {
+    std::shared_ptr<ServerSession> session;
+    std::string request;
+    std::uint64_t id = 0;
+    bool stopped = false;
+    bool untilStop = false;   // go infinite or go ponder: answered only after a stop
+};
+
+struct SearchWorker {
+    pid_t pid = -1;
+    int fd = -1;
+    std::string input;
+    std::shared_ptr<ServerSession> session;   // owner of the running search; null when idle
+    std::uint64_t jobId = 0;
+    bool untilStop = false;
+};
+
+// Body of a forked search worker. Requests are read on a second thread, so a stop reaches the
+// search in progress; a request stopped before its search starts is answered at depth 1. An
+// infinite or ponder search has no time cap, and its bestmove waits for the stop.
+[[noreturn]] static void runSearchWorker(int fd, int maxSearchMs)
+{
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_IGN);
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::string> requests;
+    std::uint64_t running = 0;
+    std::uint64_t stoppedUpTo = 0;
+    bool closed = false;
+
+    std::thread reader([&]() {
+        std::string buffer;
+        char chunk[4096];
+        for (;;) {
+            const ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+            size_t start = 0;
+            for (size_t nl; (nl = buffer.find('\n', start)) != std::string::npos; start = nl + 1) {
+                std::string line = buffer.substr(start, nl - start);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (line.starts_with("stop ")) {
+                    const std::uint64_t id = std::strtoull(line.c_str() + 5, nullptr, 10);
+                    stoppedUpTo = std::max(stoppedUpTo, id);
+                    if (running == id) {
+                        requestStopSearch();
+                    }
+                    ready.notify_one();
+                } else {
+                    requests.push_back(std::move(line));
+                    ready.notify_one();
+                }
+            }
+            buffer.erase(0, start);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        requestStopSearch();
+        ready.notify_one();
+    });
+    reader.detach();
+
+    setSearchInfoSink([fd](const std::string& line) { writeAll(fd, line + "\n"); });
+    for (;;) {
+        std::string request;
+        bool stoppedBeforeStart = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&]() { return closed || !requests.empty(); });
+            if (closed) {
+                break;
+            }
+            request = std::move(requests.front());
+            requests.pop_front();
+            running = std::strtoull(request.c_str() + request.find(' ') + 1, nullptr, 10);
+            stoppedBeforeStart = stoppedUpTo >= running;
+            clearStopSearch();
+        }
+
+        const size_t tab1 = request.find('\t');
+        const size_t tab2 = request.find('\t', tab1 + 1);
+        std::istringstream header(request.substr(0, tab1));
+        std::string word;
+        std::uint64_t id = 0;
+        int multiPv = 1, moveOverheadMs = 50, minThinkTimeMs = 80, slowMoverPct = 125;
+        header >> word >> id >> multiPv >> moveOverheadMs >> minThinkTimeMs >> slowMoverPct;
+
+        GameState gs;
+        gs.initStandard();
+        std::istringstream position(request.substr(tab1 + 1, tab2 - tab1 - 1));
+        parsePositionCommand(position, gs);
+        std::istringstream go(tab2 == std::string::npos ? std::string() : request.substr(tab2 + 1));
+        bool ponder = false;
+        bool infinite = false;
+        int ponderBudgetMs = 0;
+        // No ponderhit here: a ponder search runs like an infinite one until stopped.
+        SearchLimits limits = parseGoLimits(go, gs, moveOverheadMs, minThinkTimeMs, slowMoverPct, ponder, infinite,
+            ponderBudgetMs);
+        const bool untilStop = infinite || ponder;
+        limits.timeLimitMs = untilStop ? std::numeric_limits<int>::max() : std::min(limits.timeLimitMs, maxSearchMs);
+        if (stoppedBeforeStart) {
+            limits.maxDepth = 1;
+        }
+        setMultiPv(multiPv);
+        const Move best = computeBestMove(gs, limits);
+        const SearchStats stats = getLastSearchStats();
+        std::string reply = "bestmove " + moveToUci(best);
+        if (stats.hasPonderMove) {
+            reply += " ponder " + moveToUci(stats.ponderMove);
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (untilStop) {
+                ready.wait(lock, [&]() { return closed || stoppedUpTo >= id; });
+            }
+            running = 0;
+        }
+        if (!writeAll(fd, reply + "\n")) {
+            break;
+        }
+    }
+    _exit(0);
+}
+
+struct AnalysisServer {
+    ServerOptions opt;
+    int listenFd = -1;
+    int nextSessionId = 1;
+    std::uint64_t nextJobId = 1;
+    std::vector<std::shared_ptr<ServerSession>> sessions;
+    std::vector<SearchWorker> workers;
+    std::deque<ServerJob> jobs;   // waiting for an idle worker, in request order
+
+    void send(ServerSession& session, const std::string& line)
+    {
+        session.output += line;
+        session.output += '\n';
+    }
+
+    // Forks the workers; each talks to the server over its own socket pair.
+    bool startWorkers()
+    {
+        for (int w = 0; w < opt.workers; ++w) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+                break;
+            }
+            const pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                close(listenFd);
+                for (const SearchWorker& other : workers) {
+                    close(other.fd);
+                }
+                runSearchWorker(fds[1], opt.maxSearchMs);
+            }
+            close(fds[1]);
+            if (pid < 0) {
+                close(fds[0]);
+                break;
+            }
+            SearchWorker worker;
+            worker.pid = pid;
+            worker.fd = fds[0];
+            workers.push_back(std::move(worker));
+        }
+        return !workers.empty();
+    }
+
+    // A worker that exited owes its session a bestmove; the session gets a null move.
+    void loseWorker(SearchWorker& worker)
+    {
+        close(worker.fd);
+        worker.fd = -1;
+        std::cerr << "server search worker " << worker.pid << " exited\n";
+        if (worker.session) {
+            send(*worker.session, "info string search worker exited");
+            send(*worker.session, "bestmove 0000");
+            worker.session.reset();
+        }
+    }
+
+    // Hands waiting requests to idle workers in request order.
+    void dispatch()
+    {
+        for (SearchWorker& worker : workers) {
+            if (jobs.empty()) {
+                return;
+            }
+            if (worker.fd < 0 || worker.session) {
+                continue;
+            }
+            ServerJob job = std::move(jobs.front());
+            jobs.pop_front();
+            worker.session = job.session;
+            worker.jobId = job.id;
+            worker.untilStop = job.untilStop;
+            // A search stopped while still queued owes its client a bestmove; the worker
+            // answers it cheaply.
+            const std::string stop = job.stopped ? "stop " + std::to_string(job.id) + "\n" : std::string();
+            if (!writeAll(worker.fd, job.request + stop)) {
+                loseWorker(worker);
+            }
+        }
+        if (!jobs.empty() && std::none_of(workers.begin(), workers.end(), [](const SearchWorker& w) { return w.fd >= 0; })) {
+            for (const ServerJob& job : jobs) {
+                send(*job.session, "info string no search worker");
+                send(*job.session, "bestmove 0000");
+            }
+            jobs.clear();
+        }
+    }
+
+    // Relays what a worker wrote to the session whose search it runs.
+    void relay(SearchWorker& worker)
+    {
+        char chunk[65536];
+        const ssize_t n = read(worker.fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) {
+            return;
+        }
+        if (n <= 0) {
+            loseWorker(worker);
+            return;
+        }
+        worker.input.append(chunk, static_cast<size_t>(n));
+        size_t start = 0;
+        for (size_t nl; (nl = worker.input.find('\n', start)) != std::string::npos; start = nl + 1) {
+            const std::string line = worker.input.substr(start, nl - start);
+            if (worker.session && worker.session->fd >= 0) {
+                send(*worker.session, line);
+            }
+            if (line.starts_with("bestmove")) {
+                worker.session.reset();
+                worker.jobId = 0;
+            }
+        }
+        worker.input.erase(0, start);
+    }
+
+    // Ends the session's search: a running one is stopped, queued ones answer at depth 1.
+    // `untilStopOnly` leaves searches with their own limit running.
+    void stopSession(const ServerSession& session, bool untilStopOnly = false)
+    {
+        for (SearchWorker& worker : workers) {
+            if (worker.session.get() == &session && worker.fd >= 0 && (worker.untilStop || !untilStopOnly)) {
+                writeAll(worker.fd, "stop " + std::to_string(worker.jobId) + "\n");
+            }
+        }
+        for (ServerJob& job : jobs) {
+            if (job.session.get() == &session && (job.untilStop || !untilStopOnly)) {
+                job.stopped = true;
+            }
+        }
+    }
+
+    void startSearch(const std::shared_ptr<ServerSession>& session, std::istringstream& iss)
+    {
+        std::string goArgs;
+        std::getline(iss, goArgs);
+        ServerJob job;
+        job.session = session;
+        job.id = nextJobId++;
+        std::istringstream words(goArgs);
+        for (std::string word; words >> word;) {
+            job.untilStop = job.untilStop || word == "infinite" || word == "ponder";
+        }
+        job.request = "search " + std::to_string(job.id) + " " + std::to_string(session->multiPv) + " "
+            + std::to_string(session->moveOverheadMs) + " " + std::to_string(session->minThinkTimeMs) + " "
+            + std::to_string(session->slowMoverPct) + "\t" + session->position + "\t" + goArgs + "\n";
+        jobs.push_back(std::move(job));
+        dispatch();
+    }
+
+    void handleCommand(const std::shared_ptr<ServerSession>& session, std::string line)
+    {
+        // Tabs separate the fields of a worker request.
+        std::replace(line.begin(), line.end(), '\t', ' ');
+        std::istringstream iss(line);
+        std::string cmd;
+        iss >> cmd;
+
+        if (cmd == "uci") {
+            send(*session, "id name Ikshvaku");
+            send(*session, "id author Ashish");
+            send(*session, "option name MultiPV type spin default 1 min 1 max 64");
+            send(*session, "option name Move Overhead type spin default 50 min 0 max 5000");
+            send(*session, "option name Min Think Time type spin default 80 min 0 max 5000");
+            send(*session, "option name Slow Mover type spin default 125 min 50 max 400");
+            send(*session, "uciok");
+        } else if (cmd == "isready") {
+            send(*session, "readyok");
+        } else if (cmd == "ucinewgame") {
+            // The hash is shared with the other sessions, so a new game keeps it warm.
+            stopSession(*session);
+            session->position = "startpos";
+        } else if (cmd == "position") {
+            stopSession(*session);
+            std::string args;
+            std::getline(iss >> std::ws, args);
+            session->position = args;
+        } else if (cmd == "go") {
+            stopSession(*session);
+            startSearch(session, iss);
+        } else if (cmd == "stop") {
+            stopSession(*session);
+        } else if (cmd == "setoption") {
+            std::string lname;
+            std::string value;
+            if (!parseSetOption(iss, lname, value) || value.empty()) {
+                return;
+            }
+            if (lname == "multipv") {
+                session->multiPv = std::clamp(parseIntOrDefault(value, session->multiPv), 1, 64);
+            } else if (lname == "move overhead") {
+                session->moveOverheadMs = std::clamp(parseIntOrDefault(value, session->moveOverheadMs), 0, 5000);
+            } else if (lname == "min think time") {
+                session->minThinkTimeMs = std::clamp(parseIntOrDefault(value, session->minThinkTimeMs), 0, 5000);
+            } else if (lname == "slow mover") {
+                session->slowMoverPct = std::clamp(parseIntOrDefault(value, session->slowMoverPct), 50, 400);
+            } else {
+                send(*session, "info string " + lname + " is set by the server");
+            }
+        } else if (cmd == "quit") {
+            session->closing = true;
+        }
+    }
+
+    // Writes as much pending output as the socket takes; false when the client is gone.
+    bool flush(ServerSession& session)
+    {
+        while (!session.output.empty()) {
+            const ssize_t n = ::send(session.fd, session.output.data(), session.output.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            session.output.erase(0, static_cast<size_t>(n));
+        }
+        return true;
+    }
+
+    bool searching(const ServerSession& session) const
+    {
+        return std::any_of(workers.begin(), workers.end(), [&](const SearchWorker& w) { return w.session.get() == &session; })
+            || std::any_of(jobs.begin(), jobs.end(), [&](const ServerJob& job) { return job.session.get() == &session; });
+    }
+
+    // Reads what the client sent and runs each complete line; false on a read error.
+    bool receive(const std::shared_ptr<ServerSession>& session)
+    {
+        char buf[4096];
+        for (;;) {
+            const ssize_t n = read(session->fd, buf, sizeof(buf));
+            if (n == 0) {
+                session->inputClosed = true;
+                break;
+            }
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+                break;
+            }
+            session->input.append(buf, static_cast<size_t>(n));
+        }
+
+        size_t start = 0;
+        for (size_t nl; (nl = session->input.find('\n', start)) != std::string::npos; start = nl + 1) {
+            std::string line = session->input.substr(start, nl - start);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                handleCommand(session, line);
+            }
+            if (session->closing) {
+                break;
+            }
+        }
+        session->input.erase(0, start);
+        // A client that stopped sending can no longer send the stop its infinite search waits for.
+        if (session->inputClosed) {
+            stopSession(*session, true);
+        }
+        return true;
+    }
+
+    void closeSession(const std::shared_ptr<ServerSession>& session)
+    {
+        stopSession(*session);
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [&](const ServerJob& job) {
+            return job.session == session;
+        }), jobs.end());
+        close(session->fd);
+        session->fd = -1;
+        std::cerr << "server session " << session->id << " closed\n";
+    }
+
+    void acceptSessions()
+    {
+        for (;;) {
+            const int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            auto session = std::make_shared<ServerSession>();
+            session->fd = fd;
+            session->id = nextSessionId++;
+            sessions.push_back(session);
+            std::cerr << "server session " << session->id << " connected (" << sessions.size() << " open)\n";
+        }
+    }
+
+    bool listenOn(const std::string& endpoint)
+    {
+        const bool tcp = !endpoint.empty() && std::all_of(endpoint.begin(), endpoint.end(), ::isdigit);
+        if (tcp) {
+            listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listenFd < 0) return false;
+            const int one = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<std::uint16_t>(std::atoi(endpoint.c_str())));
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) return false;
+        } else {
+            sockaddr_un addr {};
+            if (endpoint.size() >= sizeof(addr.sun_path)) return false;
+            listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listenFd < 0) return false;
+            // A socket file left by a previous server would make bind fail.
+            struct stat st {};
+            if (stat(endpoint.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+                unlink(endpoint.c_str());
+            }
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, endpoint.c_str(), endpoint.size());
+            if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) return false;
+        }
+        return listen(listenFd, 64) == 0;
+    }
+
+    int run()
+    {
+        if (!listenOn(opt.endpoint)) {
+            std::cerr << "server cannot listen on " << opt.endpoint << ": " << std::strerror(errno) << "\n";
+            return 1;
+        }
+
+        setHashSizeMb(opt.hashMb);
+        setHashShared(true);
+        setExperienceLearningEnabled(false);
+        setSearchInfoOutputEnabled(true);
+        ensureSearchTablesReady();
+        if (!startWorkers()) {
+            std::cerr << "server cannot start search workers: " << std::strerror(errno) << "\n";
+            return 1;
+        }
+        std::cerr << "server listening on " << opt.endpoint << "  workers " << workers.size()
+                  << "  hash " << getHashSizeMb() << " MB shared  " << getLargePageReport() << "\n";
+
+        std::vector<pollfd> fds;
+        while (!g_serverStopRequested) {
+            // Layout: the listening socket, every worker (closed ones are ignored), every session.
+            fds.clear();
+            fds.push_back({ listenFd, POLLIN, 0 });
+            for (const SearchWorker& worker : workers) {
+                fds.push_back({ worker.fd, POLLIN, 0 });
+            }
+            for (const auto& session : sessions) {
+                const short events = static_cast<short>((session->inputClosed ? 0 : POLLIN) | (session->output.empty() ? 0 : POLLOUT));
+                fds.push_back({ session->fd, events, 0 });
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            for (size_t w = 0; w < workers.size(); ++w) {
+                if (workers[w].fd >= 0 && (fds[w + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    relay(workers[w]);
+                }
+            }
+            dispatch();
+
+            // Sessions accepted below are not in `fds` yet; they are polled from the next round.
+            const size_t polled = sessions.size();
+            if (fds[0].revents & POLLIN) {
+                acceptSessions();
+            }
+            for (size_t i = 0; i < polled; ++i) {
+                const auto& session = sessions[i];
+                const short revents = fds[i + 1 + workers.size()].revents;
+                bool alive = true;
+                if ((revents & (POLLIN | POLLHUP | POLLERR)) && !session->inputClosed) {
+                    alive = receive(session);
+                } else if (revents & (POLLHUP | POLLERR)) {
+                    alive = false;
+                }
+                alive = alive && !session->closing && flush(*session);
+                if (alive && !session->output.empty()) {
+                    alive = session->output.size() <= MAX_SESSION_OUTPUT;
+                } else if (alive && session->inputClosed) {
+                    alive = searching(*session);
+                }
+                if (!alive) {
+                    closeSession(session);
+                }
+            }
+            sessions.erase(std::remove_if(sessions.begin(), sessions.end(), [](const auto& session) {
+                return session->fd < 0;
+            }), sessions.end());
+        }
+
+        for (const auto& session : sessions) {
+            closeSession(session);
+        }
+        // Workers stop their search and exit when their socket closes.
+        for (SearchWorker& worker : workers) {
+            if (worker.fd >= 0) {
+                close(worker.fd);
+            }
+            waitpid(worker.pid, nullptr, 0);
+        }
+
+        close(listenFd);
+        if (!std::all_of(opt.endpoint.begin(), opt.endpoint.end(), ::isdigit)) {
+            unlink(opt.endpoint.c_str());
+        }
+        std::cerr << "server stopped\n";
+        return 0;
+    }
+};
+
+
+static int runAnalysisServer(const ServerOptions& opt)
+{
+    struct sigaction sa {};
+    sa.sa_handler = requestServerStop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    // A worker that died must not take the server down with it on the next write.
+    signal(SIGPIPE, SIG_IGN);
+
+    AnalysisServer server;
+    server.opt = opt;
+    return server.run();
+}
+#endif
+
+int runHeadless(int argc, char** argv)
+{
+    const std::string modeArg = (argc > 1) ? std::string(argv[1]) : std::string();
+
+    if (modeArg == "--build-book") {
+        if (argc < 3) {
+            std::cerr << "usage: --build-book <out.bin> [lines.txt|games.pgn ...]\n";
+            return 1;
+        }
+        std::vector<std::string> inputs(argv + 3, argv + argc);
+        const auto start = std::chrono::steady_clock::now();
+        const int records = buildOpeningBook(argv[2], inputs);
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (records < 0) {
+            std::cerr << "build-book failed to write " << argv[2] << "\n";
+            return 1;
+        }
+        std::cout << "build-book records=" << records << " out=" << argv[2] << " timeMs=" << ms << "\n";
+        return 0;
+    }
+
+    if (modeArg == "--analyze-epd") {
+        BatchOptions opt;
+        if (argc < 3 || !parseBatchOptions(argc, argv, 3, opt)) {
+            std::cerr << "usage: --analyze-epd <file.epd> [--depth N] [--nodes N] [--movetime ms]"
+                         " [--workers N] [--hash MB] [--clear-hash]\n";
+            return 1;
+        }
+        return runAnalyzeEpd(argv[2], opt);
+    }
+
+    if (modeArg == "--annotate-pgn") {
+        BatchOptions opt;
+        if (argc < 3 || !parseBatchOptions(argc, argv, 3, opt)) {
+            std::cerr << "usage: --annotate-pgn <games.pgn> [--depth N] [--nodes N] [--movetime ms]"
+                         " [--workers N] [--hash MB]\n";
+            return 1;
+        }
+        return runAnnotatePgn(argv[2], opt);
+    }
+
+    if (modeArg == "--server") {
+#if defined(__linux__)
+        ServerOptions opt;
+        bool ok = argc > 2;
+        if (ok) {
+            opt.endpoint = argv[2];
+        }
+        for (int i = 3; ok && i < argc; ++i) {
+            const std::string flag = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (flag == "--hash" && hasValue) {
+                opt.hashMb = std::clamp(std::atoi(argv[++i]), 1, 2048);
+            } else if (flag == "--max-search-ms" && hasValue) {
+                opt.maxSearchMs = std::max(1, std::atoi(argv[++i]));
+            } else if (flag == "--workers" && hasValue) {
+                opt.workers = std::clamp(std::atoi(argv[++i]), 1, 256);
+            } else {
+                ok = false;
+            }
+        }
+        if (!ok) {
+            std::cerr << "usage: --server <socket-path|port> [--hash MB] [--max-search-ms ms] [--workers N]\n";
+            return 1;
+        }
+        return runAnalysisServer(opt);
+#else
+        std::cerr << "--server is only available on Linux\n";
+        return 1;
+#endif
+    }
+
+    if (modeArg == "--pgn-bench") {
+        if (argc < 3) {
+            std::cerr << "usage: --pgn-bench <games.pgn> [threads]\n";
+            return 1;
+        }
+        const int threads = argc > 3 ? std::max(1, std::atoi(argv[3]))
+                                     : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        const auto start = std::chrono::steady_clock::now();
+        const PgnReadStats stats = readPgnFile(argv[2], threads, [](int, const PgnGame&) {});
+        const double sec = std::max(1e-6, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        std::cout << "pgn-bench games " << stats.games << "  moves " << stats.moves
+                  << "  incomplete " << stats.incomplete << "  threads " << threads
+                  << "  timeMs " << static_cast<long long>(sec * 1000.0)
+                  << "  games/s " << static_cast<long long>(stats.games / sec)
+                  << "  MB/s " << std::fixed << std::setprecision(1) << (stats.bytes / sec / 1e6) << "\n";
+        return 0;
+    }
+
+    if (modeArg == "--startup-report") {
+        const auto start = std::chrono::steady_clock::now();
+        const std::string report = getStartupReport();
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "startup " << report << " totalMs=" << ms << "\n";
+        std::cout << "startup " << getLargePageReport() << "\n";
+        return 0;
+    }
+
+    if (modeArg == "--tune") {
+        int maxGames = 24;
+        int moveTimeMs = 120;
+        if (argc > 2) {
+            maxGames = std::clamp(std::atoi(argv[2]), 4, 200);
+        }
+        if (argc > 3) {
+            moveTimeMs = std::clamp(std::atoi(argv[3]), 20, 2000);
+        }
+        std::cout << "tune maxGames=" << maxGames << " moveTimeMs=" << moveTimeMs << "\n";
+        return runTuneLoop(maxGames, moveTimeMs);
+    }
+
+    if (modeArg == "--bench") {
+        int depth = 7;
+        int timeLimitMs = 2000;
+        if (argc > 2) {
+            depth = std::max(1, std::atoi(argv[2]));
+        }
+        if (argc > 3) {
+            timeLimitMs = std::max(100, std::atoi(argv[3]));
+        }
+        int hashMb = 0;
+        if (argc > 4) {
+            hashMb = std::max(1, std::atoi(argv[4]));
+            setHashSizeMb(hashMb);
+        }
+
+        const std::vector<std::string> fens = {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "r1bq1rk1/ppp2ppp/2np1n2/3Np3/2B1P3/5N2/PPP2PPP/R1BQ1RK1 w - - 0 8",
+            "8/2p5/3p4/1p1P4/1P3k2/2P2P2/6K1/8 w - - 0 40",
+            "2r2rk1/1bq1bppp/p2ppn2/1pn5/3NP3/1BN1BP2/PPQ2P1P/2RR2K1 w - - 0 14",
+            "r4rk1/1pp1qppp/p1np1n2/4p3/2B1P3/2NP1N2/PPP2PPP/R1BQR1K1 w - - 2 11"
+        };
+
+        std::uint64_t totalNodes = 0;
+        long long totalTimeMs = 0;
+
+        std::cout << "bench depth=" << depth << " timeLimitMs=" << timeLimitMs;
+        if (hashMb > 0) {
+            std::cout << " hashMb=" << hashMb;
+        }
+        std::cout << "\n";
+        for (size_t i = 0; i < fens.size(); ++i) {
+            GameState benchState;
+            benchState.loadFromFen(fens[i]);
+            clearSearchHistory();
+            (void)computeBestMove(benchState, depth, timeLimitMs);
+            const SearchStats stats = getLastSearchStats();
+            totalNodes += stats.nodes;
+            totalTimeMs += stats.timeMs;
+
+            std::cout << "pos " << (i + 1)
+                      << "  nodes " << stats.nodes
+                      << "  timeMs " << stats.timeMs
+                      << "  nps " << static_cast<long long>(stats.nps)
+                      << "  depth " << stats.depthReached
+                      << "  score " << stats.bestScore << "\n";
+            std::cout << "      " << formatSearchCounters(stats) << "\n";
+        }
+
+        const double totalNps = (totalTimeMs > 0)
+            ? (static_cast<double>(totalNodes) * 1000.0 / static_cast<double>(totalTimeMs))
+            : 0.0;
+        std::cout << "total nodes " << totalNodes
+                  << "  totalTimeMs " << totalTimeMs
+                  << "  totalNps " << static_cast<long long>(totalNps) << "\n";
+        return 0;
+    }
+
+    // Default mode is UCI (for compatibility with GUIs that don't pass args).
+    return runUciLoop();
+}